@@ -0,0 +1,100 @@
+/** @file AllocationTracker.hpp
+ *  @brief Opt-in counting of heap allocations, per frame and per subsystem.
+ *
+ *  Build with -D TRACK_ALLOCATIONS (see build.py) to replace the global
+ *  operator new/delete with versions that count every allocation, its
+ *  size and the address it was made from. Without it, nothing is
+ *  replaced and AllocationScope compiles to nothing.
+ *
+ *  Allocations are charged to the subsystem of the innermost
+ *  AllocationScope on the allocating thread, e.g.
+ *
+ *      AllocationScope scope(AllocationSubsystem::Image);
+ *
+ *  BeginFrame()/EndFrame() bracket a frame; what every thread allocated
+ *  in between is the frame's cost. This backs the allocation test mode
+ *  (main.cpp, --allocation-test), which fails if a steady-state frame
+ *  goes over its budget.
+ *
+ *  The hooks run inside operator new, so nothing in here may allocate
+ *  while counting. All counters live in static storage.
+ */
+#ifndef ALLOCATIONTRACKER_HPP
+#define ALLOCATIONTRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Who an allocation is charged to
+enum class AllocationSubsystem : unsigned int{
+    Other = 0,
+    Image,
+    Geometry,
+    Shader,
+    RenderLoop,
+    Count
+};
+
+const unsigned int ALLOCATION_SUBSYSTEM_COUNT = (unsigned int)AllocationSubsystem::Count;
+
+// Number of distinct call sites remembered per frame
+const unsigned int ALLOCATION_CALL_SITES = 256;
+
+struct AllocationCounts{
+    uint64_t allocations{0};
+    uint64_t bytes{0};
+};
+
+// What one frame (or the whole run) allocated
+struct AllocationStats{
+    AllocationCounts subsystems[ALLOCATION_SUBSYSTEM_COUNT];
+    // Sum over all subsystems
+    AllocationCounts Total() const;
+};
+
+class AllocationTracker{
+public:
+    // True if the program was built with TRACK_ALLOCATIONS
+    static bool IsEnabled();
+    // Starts a new frame: the frame counters and call sites go to zero
+    static void BeginFrame();
+    // What was allocated since BeginFrame()
+    static AllocationStats GetFrameStats();
+    // What was allocated since the program started
+    static AllocationStats GetTotalStats();
+    // Prints 'stats' per subsystem, followed by the busiest call
+    // sites of the current frame (at most 'maxCallSites')
+    static void Log(const char* title, const AllocationStats& stats, unsigned int maxCallSites=8);
+    static const char* GetSubsystemName(AllocationSubsystem subsystem);
+
+    // Subsystem the calling thread charges allocations to.
+    // Set returns the previous one (see AllocationScope).
+    static AllocationSubsystem GetSubsystem();
+    static AllocationSubsystem SetSubsystem(AllocationSubsystem subsystem);
+
+    // Called by the operator new replacements
+    static void Record(size_t bytes, void* callSite);
+};
+
+// Charges allocations on this thread to 'subsystem' until it goes out of scope
+#ifdef TRACK_ALLOCATIONS
+class AllocationScope{
+public:
+    explicit AllocationScope(AllocationSubsystem subsystem)
+        : m_previous(AllocationTracker::SetSubsystem(subsystem)){}
+    ~AllocationScope(){
+        AllocationTracker::SetSubsystem(m_previous);
+    }
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+private:
+    AllocationSubsystem m_previous;
+};
+#else
+class AllocationScope{
+public:
+    explicit AllocationScope(AllocationSubsystem){}
+};
+#endif
+
+#endif
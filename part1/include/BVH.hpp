@@ -0,0 +1,63 @@
+/** @file BVH.hpp
+ *  @brief A bounding volume hierarchy over object bounds for culling.
+ *
+ *  Items are referred to by index (e.g. the object index in the
+ *  ObjectManager). The tree is built once and then refit as items move,
+ *  and is rebuilt when refitting has made the boxes too loose.
+ */
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+
+#include <vector>
+
+class BVH{
+public:
+    // Constructor
+    BVH();
+    // Destructor
+    ~BVH();
+    // Builds a new tree with one item per box in 'bounds'
+    void Build(const std::vector<AABB>& bounds);
+    // Updates the tree after the boxes of 'movedItems' changed.
+    // Only the nodes on the path from each item to the root are touched.
+    void Refit(const std::vector<AABB>& bounds, const std::vector<unsigned int>& movedItems);
+    // Appends the index of every item whose box is in the frustum.
+    // 'bounds' must be the boxes the tree was last built or refit with.
+    void Cull(const Frustum& frustum, const std::vector<AABB>& bounds, std::vector<unsigned int>& visibleItems) const;
+    // Number of items the tree was built with
+    unsigned int GetItemCount() const;
+    // True once refits have made the tree noticeably worse than a rebuild
+    bool NeedsRebuild() const;
+
+private:
+    struct Node{
+        AABB bounds;
+        int parent{-1};
+        // Children, -1 for leaves
+        int left{-1};
+        int right{-1};
+        // Range in m_items covered by this node (and all its children)
+        unsigned int first{0};
+        unsigned int count{0};
+    };
+    // Recursively splits m_items[first, first+count)
+    int BuildNode(const std::vector<AABB>& bounds, unsigned int first, unsigned int count, int parent);
+    // Recomputes the box of a node from its items or children.
+    // Returns true if the box changed.
+    bool UpdateNodeBounds(int node, const std::vector<AABB>& bounds);
+
+    // Nodes, the root is node 0
+    std::vector<Node> m_nodes;
+    // Item indices, ordered so every node covers a contiguous range
+    std::vector<unsigned int> m_items;
+    // The leaf that holds each item
+    std::vector<int> m_itemLeaf;
+    // Sum of node surface areas right after Build, and now
+    float m_builtArea{0.0f};
+    float m_currentArea{0.0f};
+};
+
+#endif
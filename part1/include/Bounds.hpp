@@ -0,0 +1,54 @@
+/** @file Bounds.hpp
+ *  @brief Axis aligned bounding boxes used for culling.
+ */
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+
+#include "glm/glm.hpp"
+
+// An axis aligned bounding box.
+// A default constructed box is 'empty' (min > max) so that
+// expanding it by the first point gives a box around that point.
+struct AABB{
+    glm::vec3 min{ 1e30f, 1e30f, 1e30f};
+    glm::vec3 max{-1e30f,-1e30f,-1e30f};
+
+    // True if nothing has been added to the box
+    bool IsEmpty() const;
+    // Grow the box to contain a point
+    void Expand(const glm::vec3& point);
+    // Grow the box to contain another box
+    void Expand(const AABB& other);
+    // Middle of the box
+    glm::vec3 GetCenter() const;
+    // Half the size of the box along each axis
+    glm::vec3 GetExtents() const;
+    // Used to decide how to split boxes in the BVH
+    float GetSurfaceArea() const;
+    // Returns the box around this box after it has been transformed.
+    // (Arvo's method, this is exact for the transformed corners.)
+    AABB Transformed(const glm::mat4& matrix) const;
+};
+
+bool operator==(const AABB& lhs, const AABB& rhs);
+bool operator!=(const AABB& lhs, const AABB& rhs);
+
+// A rectangle of pixels, x/y is the bottom left corner like glScissor.
+// A default constructed rectangle is empty.
+struct ScreenRect{
+    int x{0};
+    int y{0};
+    int width{0};
+    int height{0};
+
+    // True if the rectangle covers no pixels
+    bool IsEmpty() const;
+    // Grow the rectangle to also cover 'other'
+    void Expand(const ScreenRect& other);
+};
+
+// Pixels the box may cover on a width x height screen, padded by a pixel.
+// Boxes that reach behind the camera cover the whole screen.
+ScreenRect ProjectToScreen(const AABB& box, const glm::mat4& viewProjection, int width, int height);
+
+#endif
@@ -6,14 +6,30 @@
 
 #include "glm/glm.hpp"
 
+// Where the camera is and where it looks, small enough to copy
+// between threads every frame (see SeqLock.hpp)
+struct CameraPose{
+    glm::vec3 eyePosition;
+    glm::vec3 viewDirection;
+    glm::vec3 upVector;
+    // Camera::GetVersion() when the pose was taken
+    unsigned int version;
+};
+
 class Camera{
 public:
     // Constructor to create a camera
     Camera();
     // Return a 'view' matrix with our camera transformation applied.
     glm::mat4 GetViewMatrix() const;
+    // Same, for a pose captured earlier
+    static glm::mat4 GetViewMatrix(const CameraPose& pose);
+    // Snapshot of our position and direction
+    CameraPose GetPose() const;
     // Move the camera around
     void MouseLook(int mouseX, int mouseY);
+    // Turn by a mouse movement in pixels (e.g. all the motion of one frame)
+    void Look(float deltaX, float deltaY);
     void MoveForward(float speed);
     void MoveBackward(float speed);
     void MoveLeft(float speed);
@@ -34,6 +50,9 @@ public:
     float GetViewYDirection();
     // Returns the Z 'view' direction
     float GetViewZDirection(); 
+    // Incremented every time the camera moves or turns, so
+    // callers can tell if the view changed since they last looked
+    unsigned int GetVersion() const;
 
 private:
     // Track the old mouse position
@@ -45,6 +64,8 @@ private:
     // which direction is 'up' in our world 
     // Generally this is constant
     glm::vec3 m_upVector;
+    // See GetVersion
+    unsigned int m_version{0};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,124 @@
+/** @file FrameArena.hpp
+ *  @brief A linear (bump) allocator for memory that lives for one frame.
+ *
+ *  Allocating moves a pointer forward; nothing is freed on its own.
+ *  Reset() hands back everything at once by moving the pointer back to
+ *  the start, so a frame's transient data costs no calls to malloc or
+ *  free. Every FramePacket owns an arena, which makes one arena per
+ *  frame in flight: the render thread can still read the previous
+ *  frame while the main thread fills the next one.
+ *
+ *  If a frame needs more than the arena holds, the rest comes from the
+ *  heap, and the next Reset() grows the arena to fit. Frames of a
+ *  similar size then stop touching the heap after the first few.
+ *
+ *  ArenaAllocator adapts an arena to the STL allocator interface, e.g.
+ *  FrameVector<float> values(ArenaAllocator<float>(&arena));
+ */
+#ifndef FRAMEARENA_HPP
+#define FRAMEARENA_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+class FrameArena{
+public:
+    // Constructor, 'capacity' bytes are allocated up front
+    explicit FrameArena(size_t capacity=0);
+    // Destructor
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Returns 'size' bytes aligned to 'alignment' (a power of two).
+    // Safe to call from several threads at once, e.g. from ParallelFor.
+    void* Allocate(size_t size, size_t alignment=alignof(std::max_align_t));
+    // Room for 'count' T, not constructed
+    template<typename T>
+    T* AllocateArray(size_t count){
+        return static_cast<T*>(Allocate(sizeof(T)*count, alignof(T)));
+    }
+    // Frees everything allocated since the last Reset in O(1).
+    // Nothing may use memory from the arena afterwards, so only call
+    // it once the frame is done (FramePacket::Clear does).
+    void Reset();
+
+    // Bytes handed out since the last Reset
+    size_t GetUsed() const;
+    // Bytes the arena holds without going to the heap
+    size_t GetCapacity() const;
+    // Most bytes a single frame used so far
+    size_t GetPeak() const;
+    // Number of allocations so far that did not fit and came from the heap
+    unsigned int GetOverflowCount() const;
+
+private:
+    // Slow path: the allocation does not fit into our block
+    void* AllocateOverflow(size_t size, size_t alignment);
+
+    // The block we bump through
+    char* m_block{nullptr};
+    size_t m_capacity{0};
+    // Offset of the first free byte in m_block
+    std::atomic<size_t> m_head{0};
+
+    // Allocations that did not fit, freed by Reset()
+    std::mutex m_overflowMutex;
+    std::vector<void*> m_overflow;
+    size_t m_overflowBytes{0};
+    unsigned int m_overflowCount{0};
+    size_t m_peak{0};
+};
+
+// Lets standard containers allocate from a FrameArena.
+// Deallocating is a no-op; the memory comes back with the next Reset().
+// Without an arena it falls back to the heap.
+template<typename T>
+class ArenaAllocator{
+public:
+    typedef T value_type;
+    // Containers that are moved or swapped take their arena along
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator(FrameArena* arena=nullptr) noexcept : m_arena(arena){}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.GetArena()){}
+
+    T* allocate(size_t count){
+        if(m_arena == nullptr){
+            return static_cast<T*>(::operator new(sizeof(T)*count));
+        }
+        return m_arena->AllocateArray<T>(count);
+    }
+    void deallocate(T* pointer, size_t){
+        if(m_arena == nullptr){
+            ::operator delete(pointer);
+        }
+    }
+
+    FrameArena* GetArena() const noexcept{ return m_arena; }
+
+private:
+    FrameArena* m_arena;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+    return a.GetArena() == b.GetArena();
+}
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+    return a.GetArena() != b.GetArena();
+}
+
+// A vector whose storage lives in a FrameArena
+template<typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
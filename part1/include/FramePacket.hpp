@@ -0,0 +1,67 @@
+/** @file FramePacket.hpp
+ *  @brief Everything the render thread needs to draw one frame.
+ *
+ *  The main thread fills a packet (camera, per-object constants and the
+ *  sorted draw list) and hands it to the render thread, which owns the
+ *  OpenGL context. Packets are recycled, and each one owns a FrameArena
+ *  that its per-frame lists are allocated from. Clearing a packet for
+ *  its next frame frees all of them at once.
+ */
+#ifndef FRAMEPACKET_HPP
+#define FRAMEPACKET_HPP
+
+#include "RenderQueue.hpp"
+#include "UniformBlocks.hpp"
+#include "Bounds.hpp"
+#include "FrameArena.hpp"
+
+#include <vector>
+
+// Bytes each packet's arena starts with, it grows if a frame needs more
+const size_t FRAME_ARENA_CAPACITY = 1024*1024;
+
+struct FramePacket{
+    // Transient memory for the lists below, declared first so
+    // that it outlives them
+    FrameArena arena{FRAME_ARENA_CAPACITY};
+    // Camera and lights for the frame
+    FrameConstants frameConstants;
+    // Written by Object::Update, indexed by DrawPacket::constantsIndex
+    FrameVector<ObjectConstants> objectConstants{ArenaAllocator<ObjectConstants>(&arena)};
+    // Sorted draws
+    RenderQueue queue;
+    // Camera::GetVersion() of the camera the frame was built with
+    unsigned int cameraVersion{0};
+    // Draw into the persistent scene framebuffer, so that the next
+    // frame can redraw only part of it
+    bool persistentTarget{false};
+    // Only 'redrawRegion' changed since the previous frame
+    bool partialRedraw{false};
+    ScreenRect redrawRegion;
+    // ObjectManager pin taken while the frame was built. It keeps the
+    // objects (and GL resources) the frame uses alive, and is released
+    // by the render thread once the frame is drawn.
+    unsigned int epochPin{~0u};
+    // Tells the render thread to finish up
+    bool quit{false};
+
+    // Constructor
+    FramePacket(){
+        queue.SetArena(&arena);
+    }
+
+    // Empties the packet for reuse.
+    // The render thread must be done with it.
+    void Clear(){
+        objectConstants = FrameVector<ObjectConstants>(ArenaAllocator<ObjectConstants>(&arena));
+        queue.Clear();
+        // Nothing points into the arena anymore
+        arena.Reset();
+        persistentTarget = false;
+        partialRedraw = false;
+        redrawRegion = ScreenRect();
+        quit = false;
+    }
+};
+
+#endif
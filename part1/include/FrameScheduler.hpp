@@ -0,0 +1,81 @@
+/** @file FrameScheduler.hpp
+ *  @brief Decides when the next frame starts and measures how long frames take.
+ *
+ *  Policies:
+ *   - VSync:         swap waits for the display refresh (swap interval 1)
+ *   - AdaptiveVSync: like VSync, but a late frame swaps right away instead
+ *                    of waiting a whole extra refresh (swap interval -1)
+ *   - TargetFPS:     no vsync, we pace ourselves with a sleep that wakes up
+ *                    a little early and a short spin for the last bit
+ *   - Uncapped:      as fast as possible, for benchmarking
+ *
+ *  The swap interval belongs to the GL context, so BeginFrame/EndFrame must
+ *  be called on the thread that owns it. The policy can be changed and the
+ *  timings read from any thread.
+ */
+#ifndef FRAMESCHEDULER_HPP
+#define FRAMESCHEDULER_HPP
+
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include <atomic>
+
+enum class FramePacing{
+    VSync = 0,
+    AdaptiveVSync = 1,
+    TargetFPS = 2,
+    Uncapped = 3
+};
+
+class FrameScheduler{
+public:
+    // Constructor
+    FrameScheduler();
+    // Destructor
+    ~FrameScheduler();
+    // Selects a policy, targetFPS is only used by FramePacing::TargetFPS.
+    // Takes effect at the next BeginFrame.
+    void SetPolicy(FramePacing policy, double targetFPS=60.0);
+    FramePacing GetPolicy() const;
+    // Human readable name of a policy
+    static const char* GetPolicyName(FramePacing policy);
+    // Call before drawing (GL thread)
+    void BeginFrame();
+    // Call right after swapping buffers (GL thread).
+    // Waits if we are ahead of the target frame rate.
+    void EndFrame();
+    // Time from one EndFrame to the next, including any waiting
+    double GetFrameMilliseconds() const;
+    // Time spent drawing and swapping, without our own waiting
+    double GetWorkMilliseconds() const;
+    // Frame time smoothed over roughly the last second
+    double GetAverageFrameMilliseconds() const;
+
+private:
+    // Seconds since an arbitrary point, from the high resolution counter
+    double Now() const;
+    // Sets the swap interval for the policy we are switching to
+    void ApplyPolicy(FramePacing policy);
+
+    std::atomic<FramePacing> m_requestedPolicy{FramePacing::VSync};
+    std::atomic<double> m_targetFPS{60.0};
+    // What the context is currently set up for
+    FramePacing m_appliedPolicy{FramePacing::VSync};
+    bool m_applied{false};
+
+    // Seconds per counter tick
+    double m_secondsPerTick{0.0};
+    // When the last frame ended, and when the next one should
+    double m_lastFrameEnd{0.0};
+    double m_nextDeadline{0.0};
+    // Results
+    std::atomic<double> m_frameMilliseconds{0.0};
+    std::atomic<double> m_workMilliseconds{0.0};
+    std::atomic<double> m_averageMilliseconds{0.0};
+};
+
+#endif
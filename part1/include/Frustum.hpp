@@ -0,0 +1,39 @@
+/** @file Frustum.hpp
+ *  @brief View frustum planes for culling bounding boxes.
+ *
+ *  The planes are stored 'structure of arrays' style (all x's, then all
+ *  y's, ...) so that four planes can be tested at once with SSE.
+ */
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include "Bounds.hpp"
+#include "glm/glm.hpp"
+
+// Result of testing a box against the frustum
+enum class CullResult{
+    Outside,    // Completely outside, skip it (and its children)
+    Intersects, // Partially inside, children need testing
+    Inside      // Completely inside, children do not need testing
+};
+
+class Frustum{
+public:
+    // Constructor, the default frustum contains everything
+    Frustum();
+    // Extracts the six planes from projection * view
+    // (Gribb and Hartmann). Normals point into the frustum.
+    void Extract(const glm::mat4& viewProjection);
+    // Test a box against all planes
+    CullResult Test(const AABB& box) const;
+
+private:
+    // Six planes padded to eight so they fill two SSE registers.
+    // The padding planes (0,0,0,+1) accept every box.
+    alignas(16) float m_nx[8];
+    alignas(16) float m_ny[8];
+    alignas(16) float m_nz[8];
+    alignas(16) float m_d[8];
+};
+
+#endif
@@ -0,0 +1,96 @@
+/** @file GLExtensions.hpp
+ *  @brief Loads the OpenGL extensions we use beyond the OpenGL 3.3 core
+ *         functions that glad provides.
+ *
+ *  Our glad loader was generated for 'gl=3.3' with no extensions, so
+ *  anything newer is looked up here through SDL after the context exists.
+ */
+#ifndef GLEXTENSIONS_HPP
+#define GLEXTENSIONS_HPP
+
+// The glad library helps setup OpenGL extensions.
+#include <glad/glad.h>
+
+// ARB_buffer_storage (core in OpenGL 4.4)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+// KHR_parallel_shader_compile (ARB_parallel_shader_compile uses the same values)
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// ARB_get_program_binary (core in OpenGL 4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC_EXT)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT)(GLuint count);
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC_EXT)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC_EXT)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC_EXT)(GLuint program, GLenum pname, GLint value);
+
+// Purpose:
+// Single place to ask 'is this extension available?' and
+// to call the extension functions that we loaded.
+class GLExtensions{
+public:
+    // Singleton pattern, there is only one set of
+    // extensions for our one OpenGL context.
+    static GLExtensions& Instance();
+
+    // Query and load all extensions.
+    // Must be called after gladLoadGLLoader with a current context.
+    void Load();
+    // Prints which of the extensions we care about were found
+    void PrintSupport() const;
+
+    // ARB_buffer_storage: immutable, persistently mappable buffers
+    bool HasBufferStorage() const;
+    void BufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags) const;
+    // KHR/ARB_parallel_shader_compile: the driver compiles in the background
+    // and GL_COMPLETION_STATUS_KHR can be polled without blocking
+    bool HasParallelShaderCompile() const;
+    // How many threads the driver may compile with (0xFFFFFFFF: driver decides)
+    void MaxShaderCompilerThreads(GLuint count) const;
+    // ARB_get_program_binary: save linked programs and load them back
+    // later without compiling. Also false if the driver offers no
+    // binary formats, which some do despite the extension.
+    bool HasProgramBinary() const;
+    void GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary) const;
+    void ProgramBinary(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length) const;
+    void ProgramParameteri(GLuint program, GLenum pname, GLint value) const;
+
+private:
+    // Constructor is private, use Instance()
+    GLExtensions();
+
+    // Function pointers, nullptr when the extension is missing
+    PFNGLBUFFERSTORAGEPROC_EXT m_bufferStorage{nullptr};
+    PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT m_maxShaderCompilerThreads{nullptr};
+    PFNGLGETPROGRAMBINARYPROC_EXT m_getProgramBinary{nullptr};
+    PFNGLPROGRAMBINARYPROC_EXT m_programBinary{nullptr};
+    PFNGLPROGRAMPARAMETERIPROC_EXT m_programParameteri{nullptr};
+};
+
+#endif
@@ -0,0 +1,136 @@
+/** @file GLHandle.hpp
+ *  @brief Move-only owners for OpenGL object names.
+ *
+ *  A handle deletes the object it owns when it is destroyed or given a
+ *  new object. It cannot be copied (two owners would delete the same
+ *  name twice) but can be moved, so classes built from handles can be
+ *  stored by value in containers such as std::vector. Shader is the
+ *  exception: it is only shared through Shader::Create, since the
+ *  ShaderCompiler refers to it by address while it compiles.
+ *
+ *  Like the objects themselves, handles must be destroyed, reset or
+ *  created on the thread that owns the GL context (or one sharing it).
+ *  Moving a handle makes no GL calls.
+ */
+#ifndef GLHANDLE_HPP
+#define GLHANDLE_HPP
+
+#include <glad/glad.h>
+
+#include <utility>
+
+// How to create and delete each kind of object.
+// Create() is only provided where no arguments are needed.
+struct GLProgramTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static Type Create(){ return glCreateProgram(); }
+    static void Delete(Type name){ glDeleteProgram(name); }
+};
+
+struct GLShaderTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static void Delete(Type name){ glDeleteShader(name); }
+};
+
+struct GLTextureTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static Type Create(){ Type name = 0; glGenTextures(1, &name); return name; }
+    static void Delete(Type name){ glDeleteTextures(1, &name); }
+};
+
+struct GLBufferTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static Type Create(){ Type name = 0; glGenBuffers(1, &name); return name; }
+    static void Delete(Type name){ glDeleteBuffers(1, &name); }
+};
+
+struct GLVertexArrayTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static Type Create(){ Type name = 0; glGenVertexArrays(1, &name); return name; }
+    static void Delete(Type name){ glDeleteVertexArrays(1, &name); }
+};
+
+struct GLFramebufferTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static Type Create(){ Type name = 0; glGenFramebuffers(1, &name); return name; }
+    static void Delete(Type name){ glDeleteFramebuffers(1, &name); }
+};
+
+struct GLRenderbufferTraits{
+    typedef GLuint Type;
+    static Type Null(){ return 0; }
+    static Type Create(){ Type name = 0; glGenRenderbuffers(1, &name); return name; }
+    static void Delete(Type name){ glDeleteRenderbuffers(1, &name); }
+};
+
+struct GLSyncTraits{
+    typedef GLsync Type;
+    static Type Null(){ return nullptr; }
+    // Fences are the only kind of sync object
+    static Type Create(){ return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); }
+    static void Delete(Type name){ glDeleteSync(name); }
+};
+
+template<typename Traits>
+class GLHandle{
+public:
+    typedef typename Traits::Type Type;
+
+    // Owns nothing
+    GLHandle(){}
+    // Takes ownership of 'name'
+    explicit GLHandle(Type name) : m_name(name){}
+    // Destructor deletes the object
+    ~GLHandle(){ Reset(); }
+
+    GLHandle(GLHandle&& other) noexcept : m_name(other.Release()){}
+    GLHandle& operator=(GLHandle&& other) noexcept{
+        if(this != &other){
+            Reset(other.Release());
+        }
+        return *this;
+    }
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+
+    // Creates a new object (see the traits above for which kinds can)
+    static GLHandle Create(){ return GLHandle(Traits::Create()); }
+
+    // The name to pass to OpenGL
+    Type Get() const{ return m_name; }
+    // True if we own an object
+    explicit operator bool() const{ return m_name != Traits::Null(); }
+    // Deletes the object we own (if any) and takes ownership of 'name'
+    void Reset(Type name = Traits::Null()){
+        if(m_name != Traits::Null() && m_name != name){
+            Traits::Delete(m_name);
+        }
+        m_name = name;
+    }
+    // Gives up ownership without deleting, returns the name
+    Type Release(){
+        Type name = m_name;
+        m_name = Traits::Null();
+        return name;
+    }
+
+private:
+    Type m_name{Traits::Null()};
+};
+
+typedef GLHandle<GLProgramTraits> GLProgramHandle;
+typedef GLHandle<GLShaderTraits> GLShaderHandle;
+typedef GLHandle<GLTextureTraits> GLTextureHandle;
+typedef GLHandle<GLBufferTraits> GLBufferHandle;
+typedef GLHandle<GLVertexArrayTraits> GLVertexArrayHandle;
+typedef GLHandle<GLFramebufferTraits> GLFramebufferHandle;
+typedef GLHandle<GLRenderbufferTraits> GLRenderbufferHandle;
+typedef GLHandle<GLSyncTraits> GLSyncHandle;
+
+#endif
@@ -8,6 +8,8 @@
 
 #include <vector>
 
+#include "Bounds.hpp"
+
 // Purpose of this class is to store vertice and triangle information
 class Geometry{
 public:
@@ -25,16 +27,69 @@ public:
 	// Add a new vertex 
 	void AddVertex(float x, float y, float z, float s, float t);
     // gen pushes all attributes into a single vector
+	// (see Interleave for writing them somewhere else)
 	void Gen();
+
+	// Bulk building, for large meshes.
+	// Makes room for this many more vertices and indices, so adding
+	// them does not reallocate.
+	void Reserve(unsigned int vertexCount, unsigned int indexCount);
+	// Adds 'count' vertices at once. positions holds x,y,z and texCoords
+	// s,t per vertex; without texCoords they are all 0.
+	void AddVertices(const float* positions, const float* texCoords, unsigned int count);
+	// Adds count/3 triangles at once, same as calling MakeTriangle for each
+	void AddTriangles(const unsigned int* indices, unsigned int count);
+	// In-place building, for loaders that write vertices from many
+	// threads. BeginAddVertices makes room for 'count' vertices (with
+	// AddVertex's defaults), returns the index of the first and where
+	// their positions (x,y,z), texture coordinates (s,t) and normals
+	// (x,y,z) start. Once they are written, FinishAddVertices grows the
+	// bounds. With 'normalsGiven' GenerateTangentFrames keeps the normals
+	// instead of computing them (AddVertex and AddVertices turn that off).
+	unsigned int BeginAddVertices(unsigned int count, float** positions, float** texCoords, float** normals);
+	void FinishAddVertices(unsigned int first, unsigned int count, bool normalsGiven);
+	// Makes room for 'count' indices (whole triangles) and returns where
+	// they start; they must be written before GenerateTangentFrames
+	unsigned int* BeginAddTriangles(unsigned int count);
+	// Computes every vertex's normal, tangent and bitangent from the
+	// triangles around it, if triangles were added since the last time.
+	// Gen does this itself; anything that reads the attributes without
+	// Gen (Interleave, PackCompactVertices) needs it called first.
+	void GenerateTangentFrames();
+	// Writes vertices [first, first+count) to 'destination' in the layout
+	// Gen builds (NORMAL_MAP_LAYOUT, FLOAT_VERTEX_COMPONENTS floats each),
+	// in one pass. Any thread, e.g. straight into a mapped vertex buffer;
+	// different ranges can be written in parallel.
+	void Interleave(float* destination, unsigned int first, unsigned int count) const;
+	// Interleave for every vertex, split over the workers
+	void InterleaveAll(float* destination) const;
 	// Functions for working with Indices
 	// Creates a triangle from 3 indices
-	// When a triangle is made, the tangents and bi-tangents are also
-	// computed
+	// The normals, tangents and bi-tangents are computed for all
+	// triangles at once (see GenerateTangentFrames)
 	void MakeTriangle(unsigned int vert0, unsigned int vert1, unsigned int vert2);  
     // Retrieve how many indices there are
-	unsigned int GetIndicesSize();
+	unsigned int GetIndicesSize() const;
     // Retrieve the pointer to the indices
 	unsigned int* GetIndicesDataPtr();
+	const unsigned int* GetIndicesDataPtr() const;
+	// Box around every vertex position (in object space)
+	const AABB& GetLocalBounds() const;
+	// Number of vertices added
+	unsigned int GetVertexCount() const;
+	// Vertex positions only (x,y,z per vertex)
+	const float* GetVertexPositionsPtr() const;
+	// Texture coordinates only (s,t per vertex)
+	const float* GetTextureCoordsPtr() const;
+	// Frees the interleaved buffer data and the attributes it was built
+	// from, once they are uploaded. Positions and indices stay (bounds,
+	// occlusion culling).
+	void ReleaseUploadData();
+	// Frees every CPU side copy, positions and indices included. The
+	// vertex and index counts and the bounds stay.
+	void ReleaseCPUData();
+	// False after ReleaseCPUData
+	bool HasCPUData() const;
 
 private:
 	// m_bufferData stores all of the vertexPositons, coordinates, normals, etc.
@@ -50,6 +105,16 @@ private:
 
 	// The indices for a indexed-triangle mesh
 	std::vector<unsigned int> m_indices;
+
+	// Grown as vertices are added
+	AABB m_localBounds;
+	// Kept when the arrays are released
+	unsigned int m_vertexCount{0};
+	unsigned int m_indexCount{0};
+	// Triangles were added since GenerateTangentFrames last ran
+	bool m_framesDirty{false};
+	// m_normals came with the vertices (see FinishAddVertices)
+	bool m_normalsGiven{false};
 };
 
 
@@ -16,6 +16,10 @@ public:
     ~Image();
     // Loads a PPM from memory.
     void LoadPPM(bool flip);
+    // Halves the image 'levels' times (a 2x2 box filter, like building
+    // mipmaps), stopping at 1x1. Level n of the original mip chain is
+    // level 0 of the result.
+    void Downsample(unsigned int levels);
     // Return the width
     inline int GetWidth(){
         return m_width;
@@ -50,7 +54,7 @@ private:
     // Filepath to the image loaded
     std::string m_filepath;
     // Raw pixel data
-    uint8_t* m_pixelData;
+    uint8_t* m_pixelData{nullptr};
     // Size and format of image
     int m_width{0}; // Width of the image
     int m_height{0}; // Height of the image
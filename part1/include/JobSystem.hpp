@@ -0,0 +1,168 @@
+/** @file JobSystem.hpp
+ *  @brief A shared pool of worker threads that run small jobs.
+ *
+ *  Every worker owns a deque of jobs. A worker pushes and pops its own
+ *  jobs at the back (most recent first, which keeps caches warm) and,
+ *  when it runs dry, steals the oldest job from the front of another
+ *  worker's deque. Threads outside the pool (main, render) submit to a
+ *  shared injection queue that the workers also drain.
+ *
+ *  A job may depend on other jobs; it is queued only once all of them
+ *  have finished, which is how continuations are expressed. Jobs that
+ *  must make OpenGL calls can be pinned to the GL thread, which runs
+ *  them from RunGLJobs().
+ *
+ *  Waiting never just blocks: a thread waiting on a job runs other jobs
+ *  until it is done, so nested waits cannot starve the pool.
+ *
+ *  ParallelFor does not create jobs. Its loop is described by one record
+ *  on the caller's stack that idle threads take chunks from, so running
+ *  it every frame allocates nothing.
+ */
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "AllocationTracker.hpp"
+
+// Internal bookkeeping for one job
+struct Job;
+// Refers to a scheduled job, used to wait on it or depend on it.
+// An empty handle counts as already finished.
+typedef std::shared_ptr<Job> JobHandle;
+
+class JobSystem{
+public:
+    // Singleton pattern for having one pool of workers
+    static JobSystem& Instance();
+    // Destructor
+    ~JobSystem();
+    // Starts the workers (0 picks one less than the number of cores,
+    // since the main thread helps while it waits).
+    // Calling this again without Shutdown() does nothing.
+    void Initialize(unsigned int workerCount=0);
+    // Finishes queued jobs and joins the workers
+    void Shutdown();
+
+    // Queues 'work' to run on any worker once every dependency finished
+    JobHandle Schedule(std::function<void()> work,
+                       const std::vector<JobHandle>& dependencies = {});
+    // Same, but 'work' runs on the GL thread from RunGLJobs()
+    JobHandle ScheduleOnGLThread(std::function<void()> work,
+                                 const std::vector<JobHandle>& dependencies = {});
+    // Runs other jobs until 'job' has finished
+    void Wait(const JobHandle& job);
+    // True once the job has finished
+    bool IsFinished(const JobHandle& job) const;
+
+    // Splits [begin, end) into chunks of at most 'grainSize' items and
+    // calls work(chunkBegin, chunkEnd) for each of them in parallel.
+    // Returns once every chunk is done; the calling thread helps.
+    // 'work' is called through a pointer, never copied or wrapped in a
+    // std::function, so nothing is allocated.
+    template<typename Work>
+    void ParallelFor(size_t begin, size_t end, size_t grainSize, Work&& work){
+        typedef typename std::remove_reference<Work>::type Function;
+        ParallelForLoop loop;
+        loop.run = [](void* context, size_t chunkBegin, size_t chunkEnd){
+            (*static_cast<Function*>(context))(chunkBegin, chunkEnd);
+        };
+        loop.context = const_cast<void*>(static_cast<const void*>(&work));
+        RunParallelFor(loop, begin, end, grainSize);
+    }
+
+    // Marks the calling thread as the one that owns the GL context
+    void SetGLThread();
+    // True on the thread that owns the GL context
+    bool IsGLThread() const;
+    // Runs every GL job that is ready (GL thread only)
+    void RunGLJobs();
+
+    // Number of worker threads (not counting threads that help out)
+    unsigned int GetWorkerCount() const;
+    // Number of jobs taken from another worker's deque since startup
+    unsigned int GetStealCount() const;
+
+private:
+    // Singleton, so the constructor is private
+    JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Creates a job and links it behind its dependencies
+    JobHandle Create(std::function<void()> work, bool glThread,
+                     const std::vector<JobHandle>& dependencies);
+    // Queues a job whose dependencies have all finished
+    void Enqueue(const JobHandle& job);
+    // Runs a job and releases the jobs waiting on it
+    void Execute(const JobHandle& job);
+    // Finds a job for the calling thread, nullptr if there is none
+    JobHandle TryGetJob();
+    // Body of each worker thread
+    void WorkerMain(unsigned int index);
+
+    // One ParallelFor call, on the caller's stack. Open loops are kept
+    // in an intrusive list, so publishing one allocates nothing.
+    struct ParallelForLoop{
+        void (*run)(void* context, size_t chunkBegin, size_t chunkEnd){nullptr};
+        void* context{nullptr};
+        size_t begin{0};
+        size_t end{0};
+        size_t grainSize{1};
+        size_t chunkCount{0};
+        // Next chunk to hand out (guarded by m_loopMutex)
+        size_t nextChunk{0};
+        // Chunks handed out but not finished, plus the ones not handed
+        // out; the loop may go away once this reaches 0
+        std::atomic<size_t> unfinished{0};
+        AllocationSubsystem subsystem{AllocationSubsystem::Other};
+        ParallelForLoop* next{nullptr};
+    };
+    // Runs 'loop', with help from idle threads
+    void RunParallelFor(ParallelForLoop& loop, size_t begin, size_t end, size_t grainSize);
+    // Takes a chunk from the oldest open loop and runs it.
+    // False if there was none.
+    bool RunLoopChunk();
+    // Takes the next chunk of 'loop' (m_loopMutex held), unlinking the
+    // loop once every chunk is handed out. False if none was left.
+    bool ClaimChunk(ParallelForLoop& loop, size_t& chunk);
+    // Runs a chunk claimed from 'loop'; 'loop' may be gone afterwards
+    void RunChunk(ParallelForLoop& loop, size_t chunk);
+
+    // A deque guarded by its own lock, so stealing only
+    // contends with the owner of that one deque
+    struct WorkQueue{
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    // Jobs submitted from threads that are not workers
+    WorkQueue m_injectionQueue;
+    // Jobs pinned to the GL thread
+    WorkQueue m_glQueue;
+    // ParallelFor loops that still have chunks to hand out
+    std::mutex m_loopMutex;
+    ParallelForLoop* m_loops{nullptr};
+    std::atomic<unsigned int> m_openLoops{0};
+    std::atomic<std::thread::id> m_glThread;
+
+    std::vector<std::thread> m_workers;
+    // Idle workers sleep here until a job is queued
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+    std::atomic<unsigned int> m_queuedJobs{0};
+    std::atomic<bool> m_quit{false};
+    std::atomic<unsigned int> m_steals{0};
+};
+
+#endif
@@ -0,0 +1,41 @@
+/** @file ObjLoader.hpp
+ *  @brief Loads Wavefront OBJ meshes straight into a Geometry.
+ *
+ *  Made for scans of hundreds of megabytes, so nothing is read through
+ *  streams or line by line:
+ *
+ *    1. The file is memory mapped (read in one go where that is not
+ *       available) and split into chunks that end at line breaks.
+ *    2. The chunks are parsed in parallel with a float parser that only
+ *       handles what OBJ files contain, into per-chunk arrays of
+ *       positions, texture coordinates, normals and face corners.
+ *       Polygons are split into fans of triangles.
+ *    3. Corners are resolved to file wide indices (relative, negative
+ *       indices included) once every chunk knows how many of each
+ *       element came before it.
+ *    4. Every distinct position/texture coordinate/normal combination
+ *       becomes one vertex. Corners are deduplicated in parallel through
+ *       a lock-free hash table, and vertices are numbered in the order
+ *       they first appear in the file, so the result is the same on
+ *       every run and with any number of threads.
+ *    5. The vertices and indices are written into the Geometry's own
+ *       arrays (Geometry::BeginAddVertices).
+ *
+ *  Only v, vt, vn and f lines are read; groups, smoothing groups and
+ *  materials are skipped. If every corner has a normal, the file's
+ *  normals are kept, otherwise they are computed from the faces.
+ *  Tangent frames are left to Geometry::GenerateTangentFrames.
+ */
+#ifndef OBJLOADER_HPP
+#define OBJLOADER_HPP
+
+#include <string>
+
+class Geometry;
+
+// Adds the mesh in 'filepath' to 'geometry'. Returns false, and leaves
+// 'geometry' as it was, if the file cannot be read or is malformed.
+// Uses the job system's workers; any thread may call it.
+bool LoadOBJ(const std::string& filepath, Geometry& geometry);
+
+#endif
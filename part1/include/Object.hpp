@@ -10,36 +10,87 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <functional>
 
 #include "Shader.hpp"
 #include "VertexBufferLayout.hpp"
 #include "Texture.hpp"
 #include "Transform.hpp"
 #include "Geometry.hpp"
+#include "ResourceManager.hpp"
+#include "UniformBlocks.hpp"
+#include "RenderQueue.hpp"
+#include "JobSystem.hpp"
+#include "SceneStorage.hpp"
+#include "VertexFormat.hpp"
 
 #include "glm/vec3.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
+// Levels of detail, picked from how tall an object is on screen.
+// Small objects skip the most expensive parts of the fragment shader,
+// where the difference cannot be seen anyway.
+enum ObjectLOD{
+    LOD_FULL = 0,            // Everything that is switched on
+    LOD_NO_SELF_SHADOW = 1,  // Parallax mapping without the shadow march
+    LOD_NORMAL_MAP_ONLY = 2  // No parallax mapping at all
+};
+
 // Purpose:
 // An abstraction to create multiple objects
 //
-//
+// Everything the per-frame passes need (transform, bounds, flags,
+// material, level of detail) lives in our entity in the SceneStorage.
+// The Object is a facade over it, and holds the heavier resources
+// (shader, textures, mesh) that the passes never touch. Those come from
+// the ResourceManager and are shared with every object using the same
+// files.
+// Like the passes, the setters and getters are meant for the thread
+// that builds frames (or any thread before the object is added).
 class Object{
 public:
     // Object Constructor
     Object();
     // Object destructor
     ~Object();
-    // Load a texture
+    // Load a texture (blocks until it is uploaded, GL thread)
     void LoadTexture(std::string fileName);
-    // Create a textured quad
-    void MakeTexturedQuad(std::string fileName);
+    // Create a textured quad, its vertices stored in 'format'
+    void MakeTexturedQuad(std::string fileName, VertexFormat format=VertexFormat::Float);
+    // Same, as a graph of jobs: file reads, image decoding and geometry
+    // run on workers, every OpenGL call runs on the GL thread once what
+    // it needs is ready. Wait on the returned job before using the object.
+    JobHandle MakeTexturedQuadAsync(std::string fileName, VertexFormat format=VertexFormat::Float);
+    // Same, with the mesh loaded from a Wavefront OBJ file (see ObjLoader.hpp)
+    JobHandle MakeTexturedMeshAsync(std::string objFile, std::string fileName, VertexFormat format=VertexFormat::Float);
     // Updates and transformations applied to object
-    void Update(unsigned int screenWidth, unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+    // Picks a level of detail and writes our per-object constants
+    // into 'constants', which is entry 'constantsIndex' of the frame.
+    // No OpenGL calls are made and nothing shared is written, so
+    // different objects can be updated in parallel.
+    void Update(unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                ObjectConstants& constants, uint32_t constantsIndex);
     // How to draw the object
-    void Render();
+    // Adds a draw packet for this object to 'queue'.
+    // farPlane is used to quantize the object's depth for sorting.
+    void Submit(RenderQueue& queue, float farPlane);
     // Returns an objects transform
+    // Changes to it reach our entity at the next UpdateWorldBounds
+    // (the ObjectManager does this every frame).
     Transform& GetTransform();
+    // Recomputes the world space bounds if our transform changed.
+    // Returns true if the bounds were recomputed.
+    bool UpdateWorldBounds();
+    // Box around the object in world space (see UpdateWorldBounds)
+    const AABB& GetWorldBounds() const;
+    // Occluders are drawn into the software occlusion buffer
+    // and can hide other objects (e.g. large walls)
+    void SetOccluder(bool occluder);
+    bool IsOccluder() const;
+    // Our geometry, e.g. for the occlusion culler
+    // (empty until our mesh is loaded)
+    const Geometry& GetGeometry() const;
     // Decide if to implement normal map
     void SetUseNormalMap(bool useNormalMap);
     // Decide if to implement parallax map
@@ -50,38 +101,72 @@ public:
     void AdjustDepthScale(float delta);
     // Set the shadow
     void SetUseSelfShadowing(bool useSelfShadowing);
+    // Level of detail picked by the last Update (see ObjectLOD)
+    unsigned int GetLodLevel() const;
+    // Changes whenever anything that affects how we look changes
+    // (transform, toggles, depth scale, our program becoming ready),
+    // for redrawing only the parts of the screen that changed
+    unsigned int GetVersion() const;
+
+    // Our entity in the ObjectManager's SceneStorage
+    // (INVALID_ENTITY if the storage was full)
+    EntityID GetEntity() const;
+    // Copies our Transform into our entity if it changed since last
+    // time. Returns true if it did.
+    bool SyncTransform();
+    // Copies what is needed to draw us (program, buffers, textures,
+    // bounds) into our entity. Call once loading finished.
+    void PublishDrawData();
+
+    // The per-frame work, done directly on an entity's components so
+    // the ObjectManager can stream through the chunks without touching
+    // the Objects themselves. The member functions above forward here.
+    // Recomputes world bounds if the world matrix changed, returns true if it did
+    static bool UpdateEntityBounds(SceneChunk& chunk, unsigned int lane);
+    // See Update()
+    static void UpdateEntity(SceneChunk& chunk, unsigned int lane, unsigned int screenHeight,
+                             const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                             ObjectConstants& constants, uint32_t constantsIndex);
+    // See Submit()
+    static void SubmitEntity(const SceneChunk& chunk, unsigned int lane, RenderQueue& queue, float farPlane);
+    // See GetVersion()
+    static unsigned int GetEntityVersion(const SceneChunk& chunk, unsigned int lane);
 
 private:
-	// Helper method for when we are ready to draw or update our object
-	void Bind();
+    // Objects own GL resources and are referred to by the registry
+    Object(const Object&) = delete;
+    Object& operator=(const Object&) = delete;
 
-    // Object vertices
-    std::vector<GLfloat> m_vertices;
-    // Object indices
-    std::vector<GLuint> m_indices;
+    // What MakeTexturedQuadAsync and MakeTexturedMeshAsync share: the
+    // mesh 'meshName', built by 'build' if nobody has it yet, the
+    // textures and the shader
+    JobHandle MakeTexturedAsync(const std::string& meshName, std::function<void(Geometry&)> build,
+                                const std::string& fileName, VertexFormat format);
 
-    // For now we have one shader per object.
-    Shader m_shader;
-    // For now we have one buffer per object.
-    VertexBufferLayout m_vertexBufferLayout;
-    // For now we have one texture per object
-    Texture m_textureDiffuse;
+    // Shared with every object drawn with the same shader files
+    std::shared_ptr<Shader> m_shader;
+    // Our geometry and the buffers it lives in on the GPU
+    std::shared_ptr<Mesh> m_mesh;
+    // Diffuse texture
+    std::shared_ptr<Texture> m_textureDiffuse;
     // NOTE: that we have a normal map per object as well!
-    Texture m_normalMap;
+    std::shared_ptr<Texture> m_normalMap;
     // Store the depthMap/Height Map
-    Texture m_depthMap;
+    std::shared_ptr<Texture> m_depthMap;
     // Store the objects transformations
+    // (our entity has a copy of the matrix, see SyncTransform)
     Transform m_transform; 
-    // Store the 'camera' projection
-    glm::mat4 m_projectionMatrix;
-    // Store the objects Geometry
-	Geometry m_geometry;
 
-    // For interaction
-    bool m_useNormalMap = true;
-    bool m_useParallaxMapping = false;
-    float m_depthScale = 0.05f;
-    bool m_useSelfShadowing = false;
+    // Sets or clears one of our EntityFlags, bumping our state
+    // version if that changed anything
+    void SetFlag(uint8_t flag, bool value);
+
+    // Our entity, and where its components are
+    EntityID m_entity{INVALID_ENTITY};
+    SceneChunk* m_chunk{nullptr};
+    unsigned int m_lane{0};
+    // Components of our own if the storage was full
+    std::unique_ptr<SceneChunk> m_detached;
 };
 
 
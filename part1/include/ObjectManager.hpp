@@ -1,13 +1,48 @@
 /** @file ObjectManager.hpp
  *  @brief Class to manage creation of objects 
  *  
- *  
+ *  Every Object is an entity in our SceneStorage, and the registry
+ *  lives next to its components in the storage's chunks, which never
+ *  move. So any thread can add an object (lock-free) while another
+ *  walks the chunks. Objects are referred to by ObjectHandle, whose
+ *  generation tells a removed object apart from whatever reuses its
+ *  entity later.
+ *
+ *  The per-frame passes (bounds, culling, update, submission) work on
+ *  the entities' components directly and stream through the chunks.
+ *
+ *  Removing an object only unlinks it. It is deleted (together with its
+ *  OpenGL resources, on the GL thread) by Reclaim() once no thread and
+ *  no frame in flight can still see it. Readers announce themselves by
+ *  pinning the current epoch (Pin() or a ReadScope); an object retired
+ *  in epoch E is deleted once every pin is newer than E.
  */
 #ifndef OBJECTMANAGER_HPP
 #define OBJECTMANAGER_HPP
 
 
 #include "Object.hpp"
+#include "BVH.hpp"
+#include "Frustum.hpp"
+#include "OcclusionCuller.hpp"
+#include "SceneStorage.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Refers to an object in the ObjectManager
+struct ObjectHandle{
+    uint32_t index{~0u};
+    uint32_t generation{0};
+
+    // False for a default constructed handle
+    bool IsValid() const{ return index != ~0u; }
+};
+
+// Threads and frames in flight that can hold a pin at the same time
+const unsigned int MAX_EPOCH_PINS = 64;
 
 // Purpose:
 // This class sets up a full graphics program using SDL
@@ -22,24 +57,127 @@ public:
 
     // Destructor
     ~ObjectManager();
-    // Add a new object
-    void AddObject(Object*& o);
-    // Retrieve a reference to an object
-    Object& GetObject(unsigned int index);
-    // Deletes all of the objects
+    // Add a new object, the manager owns it from now on.
+    // Safe from any thread and never takes a lock.
+    // 'o' should have finished loading, its draw data is copied now.
+    // Returns an invalid handle (and leaves 'o' with the caller)
+    // if it has no entity.
+    ObjectHandle AddObject(Object* o);
+    // Retrieve the object behind a handle, nullptr once it was removed.
+    // The pointer stays valid for as long as the caller holds a pin.
+    Object* GetObject(ObjectHandle handle);
+    // Unlinks an object (any thread), Reclaim() deletes it later.
+    // Returns false if the handle was stale.
+    bool RemoveObject(ObjectHandle handle);
+    // Deletes all of the objects (GL thread, with nothing pinned)
     void RemoveAll();
-    // Update all objects
-    void UpdateAll(unsigned int screenWidth, unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
-    // Render All Objects
-    void RenderAll();
+
+    // Identifies a pin, see Pin()
+    typedef unsigned int EpochPin;
+    static const EpochPin NO_EPOCH_PIN = ~0u;
+    // Keeps every object reachable right now from being deleted until
+    // the matching Unpin(). Any thread; a pin may be released on
+    // another thread than the one that took it (frames in flight).
+    EpochPin Pin();
+    void Unpin(EpochPin pin);
+    // Holds a pin for as long as it exists
+    class ReadScope{
+    public:
+        ReadScope();
+        ~ReadScope();
+    private:
+        EpochPin m_pin;
+    };
+    // Moves to a new epoch and deletes the removed objects that no pin
+    // can see anymore. GL thread only, since objects own GL resources.
+    // Returns how many objects were deleted.
+    unsigned int Reclaim();
+    // Number of objects that have not been removed
+    unsigned int GetObjectCount() const;
+    // Where the components of every object live
+    SceneStorage& GetSceneStorage();
+
+    // Update all objects.
+    // Objects outside the view frustum are culled first and are
+    // neither updated nor submitted this frame. The visible ones are
+    // updated in parallel on the JobSystem, writing one entry of
+    // 'frameConstants' each; no OpenGL calls are made.
+    // Takes a snapshot of the objects, so the caller must hold a pin
+    // until SubmitAll and the frame it builds are done with them.
+    void UpdateAll(unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, FrameVector<ObjectConstants>& frameConstants);
+    // Submit every object to the render queue
+    void SubmitAll(RenderQueue& queue, float farPlane);
+    // Number of objects that passed culling in the last UpdateAll
+    unsigned int GetVisibleCount() const;
+    // Turn software occlusion culling on or off
+    void SetOcclusionCulling(bool enabled);
+    // Access to the occlusion culler (for its settings and statistics)
+    OcclusionCuller& GetOcclusionCuller();
+    // Goes up whenever any object changes how it looks, or objects are
+    // added or removed. A single counter, so it never comes back to a
+    // value it had before.
+    unsigned long long GetSceneVersion() const;
+    // Bumps the scene version. Objects call this when they change; it is
+    // also for changes outside them, like programs finishing compiling.
+    void MarkSceneChanged();
+    // Screen area that needs redrawing because objects changed since the
+    // last call: where they were then and where they are now.
+    // If the camera moved everything did, so the whole screen is returned.
+    // Call after UpdateAll so world bounds are current.
+    ScreenRect UpdateDirtyRegion(const glm::mat4& viewProjection, int width, int height, bool cameraMoved);
 
 private:
 	// Constructor is private because we should
     // not be able to construct any other managers,
     // this how we ensure only one is ever created
     ObjectManager();
-    // Objects in our scene 
+    // An unlinked object waiting for Reclaim()
+    struct RetiredObject{
+        Object* object;
+        uint64_t epoch;
+    };
+    // Copies the current objects into m_objects for this frame
+    void Snapshot();
+    // Updates world bounds and refits (or rebuilds) our BVH
+    void UpdateBounds();
+    // Removes objects hidden behind occluders from m_visibleObjects
+    void CullOccluded(const glm::mat4& viewProjection);
+
+    // Components of every object, and our registry
+    SceneStorage m_scene;
+    std::atomic<unsigned int> m_objectCount{0};
+    // See GetSceneVersion()
+    std::atomic<unsigned long long> m_sceneVersion{0};
+
+    // Epoch reclamation. A pin holds the epoch it was taken in, 0 is free.
+    std::atomic<uint64_t> m_epoch{1};
+    std::atomic<uint64_t> m_pins[MAX_EPOCH_PINS];
+    std::mutex m_retiredMutex;
+    std::vector<RetiredObject> m_retired;
+
+    // Objects in our scene, as of the last UpdateAll (nullptr for
+    // entities that are not in it). Indexed by entity, like everything below.
     std::vector<Object*> m_objects;
+    std::vector<uint32_t> m_generations;
+    // World bounds of every object, indexed like m_objects
+    std::vector<AABB> m_worldBounds;
+    // Objects whose bounds changed this frame
+    std::vector<unsigned int> m_movedObjects;
+    // Per object flag written by the parallel bounds update
+    std::vector<char> m_moved;
+    // Hierarchy over m_worldBounds used for culling
+    BVH m_bvh;
+    // Frustum for the current frame
+    Frustum m_frustum;
+    // Indices of the objects that passed culling
+    std::vector<unsigned int> m_visibleObjects;
+    // CPU depth buffer of the occluders
+    OcclusionCuller m_occlusionCuller;
+    bool m_occlusionCulling{true};
+    // Object versions and screen rectangles as of the last UpdateDirtyRegion
+    std::vector<unsigned int> m_drawnVersions;
+    std::vector<uint32_t> m_drawnGenerations;
+    std::vector<ScreenRect> m_drawnRects;
 };
 
 #endif
@@ -0,0 +1,96 @@
+/** @file OcclusionCuller.hpp
+ *  @brief Software occlusion culling with a small CPU depth buffer.
+ *
+ *  Objects marked as occluders (e.g. large walls) are rasterized into a
+ *  low resolution depth buffer, and the bounds of other objects are then
+ *  tested against it. Nothing here talks to OpenGL, so results are
+ *  available before any draw is issued and without reading back from
+ *  the GPU.
+ *
+ *  The buffer is split into tiles. Triangles are binned per tile and each
+ *  tile is rasterized by one job on the JobSystem, so no two threads write
+ *  the same pixels. Rasterization stops when the time budget runs out; anything not
+ *  drawn by then simply occludes nothing, which is always safe.
+ */
+#ifndef OCCLUSIONCULLER_HPP
+#define OCCLUSIONCULLER_HPP
+
+#include "Bounds.hpp"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+class OcclusionCuller{
+public:
+    // Constructor, width/height are the depth buffer resolution
+    OcclusionCuller(unsigned int width=320, unsigned int height=192);
+    // Destructor
+    ~OcclusionCuller();
+    // Limit on how long RasterizeOccluders may take
+    void SetTimeBudget(double milliseconds);
+    // Clears the depth buffer and occluder list for a new frame
+    void BeginFrame(const glm::mat4& viewProjection);
+    // Adds an occluding triangle mesh.
+    // positions: x,y,z per vertex in object space
+    // indices: three per triangle
+    // modelMatrix: object to world transform
+    void AddOccluder(const float* positions, unsigned int vertexCount,
+                     const unsigned int* indices, unsigned int indexCount,
+                     const glm::mat4& modelMatrix);
+    // Draws every occluder added this frame into the depth buffer
+    void RasterizeOccluders();
+    // False only if the box is certainly hidden behind the occluders
+    bool IsVisible(const AABB& worldBounds) const;
+
+    // Depth buffer (bottom row first), 0 is the near plane, 1 the far plane
+    const float* GetDepthBuffer() const;
+    unsigned int GetWidth() const;
+    unsigned int GetHeight() const;
+    // Statistics from the last RasterizeOccluders
+    unsigned int GetTriangleCount() const;
+    unsigned int GetSkippedTileCount() const;
+    double GetRasterizeMilliseconds() const;
+
+private:
+    // A triangle in screen space: pixel x,y and depth in [0,1]
+    struct ScreenTriangle{
+        float x[3];
+        float y[3];
+        float z[3];
+        // Used to draw the most useful triangles first
+        float priority;
+    };
+    // Clips a clip space triangle against the near plane and
+    // stores the (up to two) resulting screen space triangles
+    void AddClipSpaceTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    // Rasterizes every triangle binned to one tile
+    void RasterizeTile(unsigned int tile, double deadline);
+    // Draws one triangle, limited to the pixels of one tile
+    void RasterizeTriangle(const ScreenTriangle& triangle, int minX, int minY, int maxX, int maxY);
+
+    // Depth buffer size
+    unsigned int m_width;
+    unsigned int m_height;
+    // Tiles across and down
+    unsigned int m_tilesX;
+    unsigned int m_tilesY;
+    // Depth values, cleared to 1 (far)
+    std::vector<float> m_depth;
+    // Farthest depth in each tile after rasterization
+    std::vector<float> m_tileMaxDepth;
+    // Triangle indices for each tile
+    std::vector<std::vector<unsigned int>> m_bins;
+    // This frame's occluder triangles
+    std::vector<ScreenTriangle> m_triangles;
+    // Tiles that ran out of time this frame (kept to reuse the memory)
+    std::vector<char> m_tileSkipped;
+    // This frame's camera
+    glm::mat4 m_viewProjection;
+    // Configuration
+    double m_budgetMilliseconds{1.0};
+    // Statistics
+    unsigned int m_skippedTiles{0};
+    double m_rasterizeMilliseconds{0.0};
+};
+
+#endif
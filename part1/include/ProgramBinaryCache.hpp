@@ -0,0 +1,65 @@
+/** @file ProgramBinaryCache.hpp
+ *  @brief Keeps linked shader programs on disk between runs.
+ *
+ *  After a program links, the driver's binary (glGetProgramBinary) is
+ *  written to '<directory>/<key>.bin'. On later runs the same sources
+ *  load with glProgramBinary instead of being compiled again.
+ *
+ *  The key is a 64-bit FNV-1a hash of the shader sources, the defines
+ *  and the driver's vendor, renderer and version strings, so a driver
+ *  update simply misses the cache. A binary the driver refuses anyway
+ *  is deleted and the program is compiled as usual.
+ *
+ *  Everything but PrepareForLink must be called on the GL thread.
+ *  Files are written by the job system, so saving never waits on the disk.
+ */
+#ifndef PROGRAMBINARYCACHE_HPP
+#define PROGRAMBINARYCACHE_HPP
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+
+class ProgramBinaryCache{
+public:
+    // Constructor
+    ProgramBinaryCache();
+    // Destructor
+    ~ProgramBinaryCache();
+    // Checks for ARB_get_program_binary, reads the driver strings for
+    // our keys and creates 'directory'. Returns false if caching is off.
+    bool Initialize(const std::string& directory);
+    // True if Initialize() succeeded
+    bool IsEnabled() const;
+    // Key for a program built from these sources
+    uint64_t MakeKey(const std::string& vertexShaderSource, const std::string& fragmentShaderSource,
+                     const std::string& defines) const;
+    // Creates a linked program from the cached binary for 'key'.
+    // Returns 0 if there is none (or the driver rejected it).
+    GLuint Load(uint64_t key);
+    // Asks the driver for the binary of a linked program and writes it
+    // out for 'key'. The program must have been linked with
+    // GL_PROGRAM_BINARY_RETRIEVABLE_HINT (see PrepareForLink).
+    void Save(uint64_t key, GLuint program);
+    // Call before glLinkProgram so the driver keeps the binary around
+    // (any thread with a current context)
+    void PrepareForLink(GLuint program) const;
+
+    // Statistics
+    unsigned int GetHitCount() const;
+    unsigned int GetMissCount() const;
+
+private:
+    // Where the binary for 'key' lives
+    std::string GetPath(uint64_t key) const;
+
+    bool m_enabled{false};
+    std::string m_directory;
+    // GL_VENDOR, GL_RENDERER and GL_VERSION, part of every key
+    std::string m_driverSignature;
+    unsigned int m_hits{0};
+    unsigned int m_misses{0};
+};
+
+#endif
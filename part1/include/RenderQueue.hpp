@@ -0,0 +1,98 @@
+/** @file RenderQueue.hpp
+ *  @brief Collects draw packets for a frame, sorts them by a 64-bit key
+ *         and issues them with as few OpenGL state changes as possible.
+ *
+ *  Key layout, most significant bits first:
+ *
+ *    | pass (2) | program (10) | material (16) | vertex array (12) | depth (24) |
+ *
+ *  Sorting on the key groups draws that share a program, then textures,
+ *  then buffers. Within a group, opaque draws go front-to-back so the
+ *  depth test can reject hidden (expensive) parallax fragments early.
+ */
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <glad/glad.h>
+
+#include "FrameArena.hpp"
+
+#include <vector>
+#include <cstdint>
+
+// Passes are drawn in this order
+enum class RenderPass : uint64_t{
+    Opaque = 0,
+    Transparent = 1
+};
+
+// Number of texture slots a packet may bind
+const unsigned int DRAW_PACKET_TEXTURES = 3;
+
+// Everything needed to issue one draw call
+struct DrawPacket{
+    uint64_t key{0};
+    GLuint program{0};
+    GLuint vertexArray{0};
+    GLuint textures[DRAW_PACKET_TEXTURES]{0,0,0};
+    GLsizei indexCount{0};
+    // Which of the frame's ObjectConstants this draw uses
+    uint32_t constantsIndex{0};
+};
+
+class RenderQueue{
+public:
+    // Constructor
+    RenderQueue();
+    // Destructor
+    ~RenderQueue();
+    // Builds a sort key.
+    // viewDepth is the distance in front of the camera, and is
+    // quantized against farPlane (opaque: front-to-back,
+    // transparent: back-to-front).
+    static uint64_t MakeKey(RenderPass pass, GLuint program, const GLuint textures[DRAW_PACKET_TEXTURES],
+                            GLuint vertexArray, float viewDepth, float farPlane);
+    // Same, with the textures already folded by MakeMaterialId
+    static uint64_t MakeKey(RenderPass pass, GLuint program, uint32_t materialId,
+                            GLuint vertexArray, float viewDepth, float farPlane);
+    // Folds a set of texture names into the material field of the key
+    static uint32_t MakeMaterialId(const GLuint textures[DRAW_PACKET_TEXTURES]);
+    // Allocate packets (and sort scratch) from 'arena' from the next
+    // Clear() on. Without an arena the heap is used and the memory is
+    // kept from frame to frame instead.
+    void SetArena(FrameArena* arena);
+    // Removes all packets. Call before the arena is reset.
+    void Clear();
+    // Makes room for 'count' packets up front, so that submitting
+    // does not grow (and copy) the lists
+    void Reserve(size_t count);
+    // Adds a draw to the queue
+    void Submit(const DrawPacket& packet);
+    // Radix sorts the packets by their key
+    void Sort();
+    // Issues every packet in sorted order.
+    // The per-object constants of the frame were uploaded to
+    // 'constantsBuffer' starting at 'constantsBase', one every
+    // 'constantsStride' bytes.
+    void Execute(GLuint constantsBuffer, GLintptr constantsBase, GLsizeiptr constantsStride);
+    // Number of packets submitted this frame
+    unsigned int GetPacketCount() const;
+    // Number of state changes issued by the last Execute()
+    unsigned int GetStateChangeCount() const;
+
+private:
+    // Where the lists below live, nullptr for the heap
+    FrameArena* m_arena{nullptr};
+    // Packets in submission order
+    FrameVector<DrawPacket> m_packets;
+    // Keys and packet indices, sorted by Sort()
+    FrameVector<uint64_t> m_keys;
+    FrameVector<uint32_t> m_order;
+    // Scratch space for the radix sort
+    FrameVector<uint64_t> m_tempKeys;
+    FrameVector<uint32_t> m_tempOrder;
+    // Statistics
+    unsigned int m_stateChanges{0};
+};
+
+#endif
@@ -0,0 +1,124 @@
+/** @file ResourceManager.hpp
+ *  @brief Shares textures, shader programs and meshes between objects.
+ *
+ *  Resources are looked up by a key (the normalized file path for
+ *  textures, both shader paths plus defines for programs, a name for
+ *  meshes). The first request loads the resource as a small job graph;
+ *  later requests get the same resource and the same 'ready' job, so
+ *  memory grows with the number of unique assets rather than with the
+ *  number of objects using them.
+ *
+ *  Resources are reference counted with std::shared_ptr. The manager
+ *  itself only keeps weak references, so a resource goes away with its
+ *  last user. Since that deletes OpenGL objects, the last release is
+ *  forwarded to the GL thread if it happens anywhere else.
+ *
+ *  CPU copies of the data (decoded images, interleaved vertices) are
+ *  released once they are uploaded.
+ */
+#ifndef RESOURCEMANAGER_HPP
+#define RESOURCEMANAGER_HPP
+
+#include "Texture.hpp"
+#include "Shader.hpp"
+#include "Geometry.hpp"
+#include "VertexBufferLayout.hpp"
+#include "VertexFormat.hpp"
+#include "JobSystem.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Geometry and the buffers it was uploaded to
+struct Mesh{
+    Geometry geometry;
+    VertexBufferLayout layout;
+    // How the vertices are stored in 'layout', and how to turn stored
+    // positions back into object space (see VertexFormat.hpp)
+    VertexFormat format{VertexFormat::Float};
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+};
+
+// Deletes a resource on the GL thread, scheduling the delete there
+// if the last reference was dropped somewhere else
+struct GLThreadDeleter{
+    template<typename T>
+    void operator()(T* resource) const{
+        if(JobSystem::Instance().IsGLThread()){
+            delete resource;
+        }else{
+            JobSystem::Instance().ScheduleOnGLThread([resource](){ delete resource; });
+        }
+    }
+};
+
+class ResourceManager{
+public:
+    // Singleton pattern for having one cache of resources
+    static ResourceManager& Instance();
+    // Destructor
+    ~ResourceManager();
+
+    // Returns the texture for 'path'. 'ready' finishes once it is
+    // decoded and uploaded; wait on it (or depend on it) before drawing.
+    std::shared_ptr<Texture> GetTexture(const std::string& path, JobHandle& ready);
+    // Returns the program built from the two shader files and 'defines'
+    // (see Shader::CreateShaderAsync). 'onReady' runs once, when the
+    // program linked, and only for the request that created it.
+    // 'ready' finishes once the program was submitted for compiling;
+    // until it linked, objects draw with the fallback program.
+    std::shared_ptr<Shader> GetShader(const std::string& vertexPath, const std::string& fragmentPath,
+                                      const std::string& defines, std::function<void(Shader&)> onReady,
+                                      JobHandle& ready);
+    // Returns the mesh called 'name'. If nobody holds it, 'build' fills
+    // in its geometry (on a worker) and it is uploaded on the GL thread,
+    // with its vertices stored in 'format'. 'ready' finishes once the
+    // upload did. Once uploaded the geometry keeps only its positions
+    // and indices (for occlusion culling), or nothing at all but its
+    // counts and bounds without 'keepPositions'.
+    std::shared_ptr<Mesh> GetMesh(const std::string& name, std::function<void(Geometry&)> build,
+                                  JobHandle& ready, VertexFormat format=VertexFormat::Float,
+                                  bool keepPositions=true);
+
+    // Number of resources alive right now
+    unsigned int GetTextureCount();
+    unsigned int GetShaderCount();
+    unsigned int GetMeshCount();
+
+private:
+    // Singleton, so the constructor is private
+    ResourceManager();
+    ResourceManager(const ResourceManager&) = delete;
+    ResourceManager& operator=(const ResourceManager&) = delete;
+
+    // A resource and the job that finishes loading it
+    template<typename T>
+    struct Entry{
+        std::weak_ptr<T> resource;
+        JobHandle ready;
+    };
+    template<typename T>
+    using Cache = std::unordered_map<std::string, Entry<T>>;
+
+    // Looks up 'key' (with m_mutex held). Returns true and fills in
+    // 'resource' and 'ready' if the resource is alive; otherwise the
+    // caller creates it and schedules its loading before unlocking, so
+    // nobody can see it without its 'ready' job.
+    template<typename T>
+    bool Find(Cache<T>& cache, const std::string& key, std::shared_ptr<T>& resource, JobHandle& ready);
+    // Drops entries whose resource is gone, returns how many are left
+    template<typename T>
+    unsigned int Prune(Cache<T>& cache);
+
+    // Guards the caches, loaders may ask from any thread
+    std::mutex m_mutex;
+    Cache<Texture> m_textures;
+    Cache<Shader> m_shaders;
+    Cache<Mesh> m_meshes;
+};
+
+#endif
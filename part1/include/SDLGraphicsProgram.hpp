@@ -18,6 +18,19 @@
 // The glad library helps setup OpenGL extensions.
 #include <glad/glad.h>
 #include "Camera.hpp"
+#include "StreamBuffer.hpp"
+#include "GLHandle.hpp"
+#include "RenderQueue.hpp"
+#include "FramePacket.hpp"
+#include "SPSCQueue.hpp"
+#include "FrameScheduler.hpp"
+#include "VertexFormat.hpp"
+#include "SeqLock.hpp"
+#include "ObjectManager.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 // Purpose:
@@ -28,22 +41,33 @@
 class SDLGraphicsProgram{
 public:
 
-    // Constructor
-    SDLGraphicsProgram(int w, int h);
+    // Constructor, our objects store their vertices in 'vertexFormat'
+    // and are quads, or the mesh in 'meshFile' (an OBJ) if one is given
+    SDLGraphicsProgram(int w, int h, VertexFormat vertexFormat=VertexFormat::Float, std::string meshFile="");
     // Destructor
     ~SDLGraphicsProgram();
     // Setup OpenGL
     bool InitGL();
-    // Per frame update
-    void Update();
-    // Renders shapes to the screen
-    void Render();
+    // Per frame update, fills 'frame' with everything needed to draw it.
+    // Runs on the main thread and makes no OpenGL calls.
+    void Update(FramePacket& frame);
+    // Renders shapes to the screen (render thread only). Returns false,
+    // having drawn nothing, if the GPU is too far behind to take the
+    // frame's constants yet.
+    bool Render(FramePacket& frame);
     // loop that runs forever
     void Loop();
     // Get Pointer to Window
     SDL_Window* GetSDLWindow();
     // Helper Function to Query OpenGL information.
     void GetOpenGLVersionInfo();
+    // Allocation test mode (needs TRACK_ALLOCATIONS, see AllocationTracker.hpp).
+    // Animates the scene, skips 'warmupFrames' frames and then checks that
+    // each of the next 'testFrames' makes at most 'budget' heap allocations
+    // on any thread. Loop() returns once they ran.
+    void EnableAllocationTest(unsigned int warmupFrames, unsigned int testFrames, unsigned long long budget);
+    // True if a tested frame went over its allocation budget
+    bool AllocationTestFailed() const;
 
 private:
     // Screen dimension constants
@@ -55,6 +79,69 @@ private:
     SDL_GLContext m_openGLContext;
 
     Camera m_camera; // Add a camera instance
+    // The camera as of the latest input, written by the main
+    // thread and read by the render thread just before drawing
+    SeqLock<CameraPose> m_latchedCamera;
+
+    // Ring buffer that per-frame and per-object uniforms are streamed through
+    StreamBuffer m_constantStream;
+    // Paces frames (vsync, frame rate limit, ...) and measures them
+    FrameScheduler m_frameScheduler;
+
+    // Owns the OpenGL context while Loop() runs.
+    // Drains m_submittedFrames, draws and swaps, then hands
+    // the packet back through m_freeFrames.
+    void RenderThreadMain();
+    std::thread m_renderThread;
+    // Two packets: one being filled by the main thread
+    // while the render thread submits the other.
+    static const unsigned int FRAMES_IN_FLIGHT = 2;
+    FramePacket m_framePackets[FRAMES_IN_FLIGHT];
+    SPSCQueue<FramePacket*,4> m_submittedFrames; // main -> render
+    SPSCQueue<FramePacket*,4> m_freeFrames;      // render -> main
+    // The render thread sleeps here while no frame is submitted,
+    // and the main thread while no packet is free
+    std::mutex m_frameMutex;
+    std::condition_variable m_frameSubmitted;
+    std::condition_variable m_frameReturned;
+
+    // On-demand rendering: only build a frame when something changed,
+    // and otherwise sleep until the next event (main thread)
+    bool m_onDemand{false};
+    // Scene and camera versions of the last frame we submitted
+    unsigned long long m_submittedVersion{0};
+    // Something outside our scene needs a full redraw (e.g. the window was uncovered)
+    bool m_redrawRequested{true};
+    // TextureResidency version we last drew with, textures changing
+    // size changes the whole picture
+    unsigned int m_residencyVersion{0};
+    // Our brick wall
+    ObjectHandle m_wall;
+    // Rotate the wall
+    bool m_animate{false};
+    // Draw into a persistent framebuffer and only redraw the changed part
+    bool m_partialRedraw{false};
+    unsigned int m_lastCameraVersion{0};
+
+    // Allocation test mode (main thread).
+    // Called after each submitted frame, returns true once the test is done.
+    bool CheckAllocationBudget();
+    bool m_allocationTest{false};
+    unsigned int m_allocationWarmupFrames{0};
+    unsigned int m_allocationTestFrames{0};
+    unsigned long long m_allocationBudget{0};
+    unsigned int m_allocationFrames{0};
+    bool m_allocationTestFailed{false};
+
+    // Persistent scene framebuffer (render thread)
+    void CreateSceneFramebuffer();
+    void DestroySceneFramebuffer();
+    GLFramebufferHandle m_sceneFramebuffer;
+    GLRenderbufferHandle m_sceneColor;
+    GLRenderbufferHandle m_sceneDepth;
+    // Does the framebuffer hold a complete image, and for which camera
+    bool m_sceneValid{false};
+    unsigned int m_sceneCameraVersion{0};
 };
 
 #endif
@@ -0,0 +1,49 @@
+/** @file SPSCQueue.hpp
+ *  @brief A lock-free, fixed size, single producer single consumer queue.
+ *
+ *  Exactly one thread may call TryPush and exactly one (other) thread may
+ *  call TryPop. Neither call ever blocks or takes a lock.
+ */
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <atomic>
+
+template<typename T, unsigned int Capacity>
+class SPSCQueue{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity-1)) == 0,
+                  "SPSCQueue capacity must be a power of two");
+public:
+    // Adds an item, returns false if the queue is full (producer only)
+    bool TryPush(const T& value){
+        unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_head.load(std::memory_order_acquire) == Capacity){
+            return false;
+        }
+        m_items[tail & (Capacity-1)] = value;
+        // Publish the item before the consumer can see the new tail
+        m_tail.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    // Removes an item, returns false if the queue is empty (consumer only)
+    bool TryPop(T& value){
+        unsigned int head = m_head.load(std::memory_order_relaxed);
+        if(head == m_tail.load(std::memory_order_acquire)){
+            return false;
+        }
+        value = m_items[head & (Capacity-1)];
+        // Hand the slot back to the producer
+        m_head.store(head+1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Head and tail on separate cache lines so the two threads
+    // do not keep stealing the same line from each other.
+    alignas(64) std::atomic<unsigned int> m_head{0};
+    alignas(64) std::atomic<unsigned int> m_tail{0};
+    T m_items[Capacity];
+};
+
+#endif
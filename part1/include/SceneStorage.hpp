@@ -0,0 +1,126 @@
+/** @file SceneStorage.hpp
+ *  @brief Per-object data kept as structure-of-arrays.
+ *
+ *  Every object is an entity: an index into chunks of SCENE_CHUNK_SIZE
+ *  entities. Each chunk keeps one array per component (transforms,
+ *  bounds, material ids, flags, ...), so the per-frame passes over the
+ *  scene (bounds, culling, update, sorting) read memory linearly and
+ *  only touch the components they need. Chunks are allocated on demand
+ *  and never move, so entities can be allocated from any thread while
+ *  another thread walks the chunks.
+ *
+ *  Object is a facade over its entity (see Object.hpp), and the
+ *  ObjectManager keeps its registry in the chunks as well.
+ */
+#ifndef SCENESTORAGE_HPP
+#define SCENESTORAGE_HPP
+
+#include <glad/glad.h>
+
+#include "Bounds.hpp"
+#include "RenderQueue.hpp"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+class Object;
+class Shader;
+class Texture;
+
+// Index of an entity in the SceneStorage
+typedef uint32_t EntityID;
+const EntityID INVALID_ENTITY = ~0u;
+
+// Entities per chunk
+const unsigned int SCENE_CHUNK_SIZE = 256;
+// So at most SCENE_CHUNK_SIZE*MAX_SCENE_CHUNKS entities
+const unsigned int MAX_SCENE_CHUNKS = 4096;
+
+// Bits of SceneChunk::flags
+enum EntityFlags : uint8_t{
+    ENTITY_OCCLUDER          = 1 << 0, // Hides other objects
+    ENTITY_NORMAL_MAP        = 1 << 1,
+    ENTITY_PARALLAX          = 1 << 2,
+    ENTITY_SELF_SHADOW       = 1 << 3,
+    ENTITY_TRANSFORM_DIRTY   = 1 << 4, // The Transform may have changed since we copied it
+    ENTITY_BOUNDS_VALID      = 1 << 5  // worldBounds matches the current local bounds
+};
+
+// The components of SCENE_CHUNK_SIZE entities
+struct SceneChunk{
+    // Registry, owned by the ObjectManager
+    std::atomic<Object*> objects[SCENE_CHUNK_SIZE];
+    std::atomic<uint32_t> generations[SCENE_CHUNK_SIZE];
+    // Next entry of the free list (id+1, 0 ends the list)
+    std::atomic<uint32_t> nextFree[SCENE_CHUNK_SIZE];
+
+    // World matrix, and the Transform version it was copied from
+    glm::mat4 worldMatrices[SCENE_CHUNK_SIZE];
+    uint32_t transformVersions[SCENE_CHUNK_SIZE];
+    // Bounds in object and world space, and the transform
+    // version the world bounds were computed for
+    AABB localBounds[SCENE_CHUNK_SIZE];
+    AABB worldBounds[SCENE_CHUNK_SIZE];
+    uint32_t boundsVersions[SCENE_CHUNK_SIZE];
+
+    // What to draw with. materialIds is folded from the textures once,
+    // so sorting does not have to.
+    uint32_t materialIds[SCENE_CHUNK_SIZE];
+    const Shader* shaders[SCENE_CHUNK_SIZE];
+    GLuint vertexArrays[SCENE_CHUNK_SIZE];
+    GLuint textures[SCENE_CHUNK_SIZE][DRAW_PACKET_TEXTURES];
+    // The same textures, to tell the TextureResidency they are in view
+    const Texture* textureObjects[SCENE_CHUNK_SIZE][DRAW_PACKET_TEXTURES];
+    GLsizei indexCounts[SCENE_CHUNK_SIZE];
+    // Decodes the mesh's stored positions, see VertexFormat.hpp
+    glm::vec3 positionScales[SCENE_CHUNK_SIZE];
+    glm::vec3 positionOffsets[SCENE_CHUNK_SIZE];
+
+    // EntityFlags
+    uint8_t flags[SCENE_CHUNK_SIZE];
+    float depthScales[SCENE_CHUNK_SIZE];
+    // Bumped whenever a setting changes, for on-demand rendering
+    uint32_t stateVersions[SCENE_CHUNK_SIZE];
+
+    // Written by the update every frame
+    float viewDepths[SCENE_CHUNK_SIZE];
+    uint8_t lodLevels[SCENE_CHUNK_SIZE];
+    uint32_t constantsIndices[SCENE_CHUNK_SIZE];
+};
+
+class SceneStorage{
+public:
+    // Constructor
+    SceneStorage();
+    // Destructor
+    ~SceneStorage();
+    // Claims an entity with every component reset (any thread, lock-free).
+    // Returns INVALID_ENTITY if the storage is full.
+    EntityID Allocate();
+    // Gives an entity back for reuse (any thread, lock-free)
+    void Free(EntityID id);
+    // Every allocated id is below this
+    uint32_t GetEntityLimit() const;
+    // Chunk number 'index', nullptr if it was never allocated
+    SceneChunk* GetChunk(uint32_t index) const{
+        return index < MAX_SCENE_CHUNKS ? m_chunks[index].load(std::memory_order_acquire) : nullptr;
+    }
+    // Puts every component of an entity back to its default
+    static void ResetEntity(SceneChunk& chunk, unsigned int lane);
+
+private:
+    SceneStorage(const SceneStorage&) = delete;
+    SceneStorage& operator=(const SceneStorage&) = delete;
+    // Lock-free free list of entities (tagged against ABA)
+    bool PopFree(EntityID& id);
+
+    std::atomic<SceneChunk*> m_chunks[MAX_SCENE_CHUNKS];
+    // Ids handed out so far (some may be free again)
+    std::atomic<uint32_t> m_entityLimit{0};
+    // Head of the free list: tag in the upper 32 bits, id+1 below
+    std::atomic<uint64_t> m_freeList{0};
+};
+
+#endif
@@ -0,0 +1,66 @@
+/** @file SeqLock.hpp
+ *  @brief Publishes a small value from one writer to any number of readers.
+ *
+ *  The writer never waits. A reader copies the value and retries if the
+ *  writer changed it in the meantime, which is cheap because writes are
+ *  short and rare compared to the copy. The value is stored as relaxed
+ *  atomic words so a torn read is only ever thrown away, never undefined.
+ */
+#ifndef SEQLOCK_HPP
+#define SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+template<typename T>
+class SeqLock{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SeqLock values are copied as raw bytes");
+public:
+    // Replaces the value (one writer thread only)
+    void Store(const T& value){
+        uint32_t words[WORD_COUNT] = {0};
+        std::memcpy(words, &value, sizeof(T));
+
+        unsigned int sequence = m_sequence.load(std::memory_order_relaxed);
+        // Odd means 'being written'
+        m_sequence.store(sequence+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(unsigned int i=0; i < WORD_COUNT; ++i){
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+        m_sequence.store(sequence+2, std::memory_order_release);
+    }
+
+    // Returns the latest complete value (any thread)
+    T Load() const{
+        uint32_t words[WORD_COUNT];
+        unsigned int before, after;
+        do{
+            before = m_sequence.load(std::memory_order_acquire);
+            if(before & 1){
+                std::this_thread::yield();
+                continue;
+            }
+            for(unsigned int i=0; i < WORD_COUNT; ++i){
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        }while((before & 1) || before != after);
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    static const unsigned int WORD_COUNT = (sizeof(T)+3)/4;
+    std::atomic<unsigned int> m_sequence{0};
+    std::atomic<uint32_t> m_words[WORD_COUNT] = {};
+};
+
+#endif
@@ -2,6 +2,9 @@
 #define SHADER_HPP
 
 #include <string>
+#include <atomic>
+#include <functional>
+#include <memory>
 
 #if defined(LINUX) || defined(MINGW)
     #include <SDL2/SDL.h>
@@ -11,12 +14,20 @@
 
 #include <glad/glad.h>
 
+#include "GLHandle.hpp"
+
+struct GLThreadDeleter;
+
 class Shader{
 public:
-    // Shader constructor
-    Shader();
-    // Shader Destructor
-    ~Shader();
+    // Shaders are only made here. The last reference deletes them on the
+    // GL thread (see GLThreadDeleter), since a program still compiling
+    // can only be cancelled there.
+    static std::shared_ptr<Shader> Create();
+    // Shaders are neither copied nor moved, only shared through Create:
+    // a program still compiling refers to its Shader by address.
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
     // Use this shader in our pipeline.
     void Bind() const;
     // Remove shader from our pipeline
@@ -24,7 +35,19 @@ public:
     // Load a shader
     std::string LoadShader(const std::string& fname);
     // Create a Shader from a loaded vertex and fragment shader
-    void CreateShader(const std::string& vertexShaderSource, const std::string& fragmentShaderSource);
+    // Blocks until the program is linked.
+    // 'defines' are preprocessor lines added after the #version line
+    // of both sources, e.g. "#define USE_FOG 1\n".
+    // Programs linked on an earlier run load from the binary cache.
+    void CreateShader(const std::string& vertexShaderSource, const std::string& fragmentShaderSource,
+                      const std::string& defines = "");
+    // Same, but returns right away (see ShaderCompiler.hpp).
+    // onReady runs on the GL thread once the program linked, e.g. to set
+    // uniforms. Until then IsReady() is false and GetID() is 0.
+    void CreateShaderAsync(const std::string& vertexShaderSource, const std::string& fragmentShaderSource,
+                           std::function<void(Shader&)> onReady = nullptr, const std::string& defines = "");
+    // True once our program linked (safe to ask from any thread)
+    bool IsReady() const;
     // return the shader id
     GLuint GetID() const;
     // Set our uniforms for our shader.
@@ -32,19 +55,25 @@ public:
 	void SetUniform3f(const GLchar* name, float v0, float v1, float v2);
     void SetUniform1i(const GLchar* name, int value);
     void SetUniform1f(const GLchar* name, float value);
+    // Connects a uniform block in our shader to a buffer binding point.
+    // Blocks the shader does not use are ignored.
+    void SetUniformBlockBinding(const GLchar* name, GLuint binding);
 
 private:
-    // Compiles loaded shaders
-    unsigned int CompileShader(unsigned int type, const std::string& source);
-    // Makes sure shaders 'linked' successfully
-    bool CheckLinkStatus(GLuint programID);
-    // Shader loading utility programs
-    void PrintProgramLog( GLuint program );
-    void PrintShaderLog( GLuint shader );
+    // Shader constructor
+    Shader();
+    // Shader Destructor (GL thread only, see Create)
+    ~Shader();
+    friend struct GLThreadDeleter;
+    // The compiler hands us our program once it linked
+    friend class ShaderCompiler;
+    void SetProgram(GLuint program);
     // Logs an error message 
     void Log(const char* system, const char* message);
-    // The unique shaderID
-    GLuint m_shaderID;
+    // The linked program
+    GLProgramHandle m_program;
+    // Set once m_program holds a linked program
+    std::atomic<bool> m_ready{false};
 };
 
 #endif
@@ -0,0 +1,144 @@
+/** @file ShaderCompiler.hpp
+ *  @brief Compiles shader programs without stalling the frame.
+ *
+ *  Querying GL_COMPILE_STATUS or GL_LINK_STATUS right after a compile
+ *  makes the driver finish the compile there and then. Instead, every
+ *  program is submitted first and only checked once it is done, using
+ *  the best mechanism the driver offers:
+ *
+ *    - KHR/ARB_parallel_shader_compile: the driver compiles on its own
+ *      threads and GL_COMPLETION_STATUS_KHR is polled each frame.
+ *    - Otherwise a second context, shared with ours, compiles and links
+ *      on a thread of its own.
+ *    - If that context cannot be created, programs are submitted as
+ *      usual and their status is checked on the next Update().
+ *
+ *  Programs linked before, with the same sources, defines and driver,
+ *  come straight from the ProgramBinaryCache instead.
+ *
+ *  Until a program is ready, objects draw with a cheap fallback program
+ *  (shaders/fallback_*.glsl) that only samples the diffuse texture.
+ *
+ *  Everything except the compile thread itself runs on the GL thread.
+ */
+#ifndef SHADERCOMPILER_HPP
+#define SHADERCOMPILER_HPP
+
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include <glad/glad.h>
+
+#include "ProgramBinaryCache.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Shader;
+
+// How programs are compiled in the background
+enum class ShaderCompileMode{
+    Deferred,         // Submitted as usual, checked on the next Update()
+    ParallelExtension,// KHR/ARB_parallel_shader_compile
+    CompileThread     // Shared context on a thread of its own
+};
+
+class ShaderCompiler{
+public:
+    // Singleton pattern for having one compiler
+    static ShaderCompiler& Instance();
+    // Destructor
+    ~ShaderCompiler();
+    // Picks a mode and builds the fallback program.
+    // Call on the GL thread with 'context' current on 'window'.
+    void Initialize(SDL_Window* window, SDL_GLContext context);
+    // Stops the compile thread and releases what is left (GL thread)
+    void Shutdown();
+
+    // Starts compiling a program for 'shader'; onReady runs on the GL
+    // thread from Update() once it linked (used by Shader::CreateShaderAsync).
+    // 'defines' are preprocessor lines (e.g. "#define USE_FOG 1\n")
+    // inserted into both sources right after their #version line.
+    void Submit(Shader& shader, const std::string& vertexShaderSource, const std::string& fragmentShaderSource,
+                const std::string& defines, std::function<void(Shader&)> onReady);
+    // Blocks until the program for 'shader' is finished (GL thread)
+    void Finish(Shader& shader);
+    // Drops the program being compiled for 'shader', if any (GL thread)
+    void Cancel(Shader& shader);
+    // Finishes every program that is done compiling (GL thread).
+    // Returns how many were finished.
+    unsigned int Update();
+
+    // Program to draw with while an object's own one is not ready
+    GLuint GetFallbackProgram() const;
+    // Number of programs still compiling
+    unsigned int GetPendingCount() const;
+    ShaderCompileMode GetMode() const;
+    static const char* GetModeName(ShaderCompileMode mode);
+
+private:
+    // Singleton, so the constructor is private
+    ShaderCompiler();
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+    // One program being compiled
+    struct Request{
+        Shader* shader{nullptr};
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::function<void(Shader&)> onReady;
+        GLuint program{0};
+        GLuint vertexShader{0};
+        GLuint fragmentShader{0};
+        // Set by the compile thread once the program linked
+        std::atomic<bool> compiled{false};
+        // ProgramBinaryCache key, and whether the program came from it
+        uint64_t cacheKey{0};
+        bool fromCache{false};
+    };
+    typedef std::shared_ptr<Request> RequestHandle;
+
+    // Puts 'defines' after the #version line of 'source'
+    static std::string ApplyDefines(const std::string& source, const std::string& defines);
+    // Issues the compile and link calls, no status queries
+    void Start(Request& request);
+    // True once the program can be queried without blocking
+    bool IsDone(Request& request) const;
+    // Checks the result and hands the program to its shader (GL thread)
+    void Complete(Request& request);
+    // Waits for the compile thread to be done with 'request'
+    void WaitForCompileThread(Request& request);
+    // Body of the compile thread
+    void CompileThreadMain();
+    // Compiles and links the fallback program
+    void CreateFallbackProgram();
+
+    ShaderCompileMode m_mode{ShaderCompileMode::Deferred};
+    bool m_initialized{false};
+    // Submitted and not yet handed to their shader (GL thread only)
+    std::vector<RequestHandle> m_pending;
+    std::shared_ptr<Shader> m_fallback;
+    ProgramBinaryCache m_binaryCache;
+
+    // Compile thread and its shared context
+    SDL_Window* m_window{nullptr};
+    SDL_GLContext m_compileContext{nullptr};
+    std::thread m_compileThread;
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueChanged;
+    std::deque<RequestHandle> m_queue;
+    bool m_quit{false};
+};
+
+#endif
@@ -0,0 +1,57 @@
+/** @file StartupTimeline.hpp
+ *  @brief Records how long each phase of startup takes, and on which thread.
+ *
+ *  Phases may overlap and may be recorded from any thread. Once the first
+ *  frame is on screen the timeline is printed, ending with the
+ *  time-to-first-frame.
+ */
+#ifndef STARTUPTIMELINE_HPP
+#define STARTUPTIMELINE_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class StartupTimeline{
+public:
+    // Singleton, the clock starts when this is first called
+    static StartupTimeline& Instance();
+    // Starts a phase, returns the id to end it with
+    unsigned int Begin(const std::string& name);
+    // Ends a phase started with Begin
+    void End(unsigned int id);
+    // Call after the first frame was presented, prints the timeline once
+    void MarkFirstFrame();
+    // Milliseconds since the clock started
+    double GetMilliseconds() const;
+    // Writes every phase recorded so far to the log
+    void Report();
+
+    // Times everything from construction to the end of the scope
+    class Scope{
+    public:
+        Scope(const std::string& name);
+        ~Scope();
+    private:
+        unsigned int m_id;
+    };
+
+private:
+    // Singleton, so the constructor is private
+    StartupTimeline();
+
+    struct Phase{
+        std::string name;
+        std::thread::id thread;
+        double start{0.0};
+        double end{-1.0};
+    };
+    std::chrono::steady_clock::time_point m_start;
+    std::mutex m_mutex;
+    std::vector<Phase> m_phases;
+    double m_firstFrame{-1.0};
+};
+
+#endif
@@ -0,0 +1,103 @@
+/** @file StreamBuffer.hpp
+ *  @brief A fence-synchronized ring buffer for data we upload every frame.
+ *
+ *  The buffer is split into several regions (three by default). Each frame
+ *  the CPU writes into one region while the GPU may still be reading the
+ *  others. A fence is placed after the draws that use a region, and that
+ *  fence is checked before we write into the region again.
+ */
+#ifndef STREAMBUFFER_HPP
+#define STREAMBUFFER_HPP
+
+// The glad library helps setup OpenGL extensions.
+#include <glad/glad.h>
+
+#include "GLHandle.hpp"
+
+#include <vector>
+
+// A piece of the stream buffer handed out to a writer.
+// cpuPtr is where the CPU writes, offset is what we
+// pass to OpenGL (e.g. glBindBufferRange) when drawing.
+struct StreamAllocation{
+    GLuint bufferID{0};
+    void* cpuPtr{nullptr};
+    GLintptr offset{0};
+    GLsizeiptr size{0};
+};
+
+class StreamBuffer{
+public:
+    // Constructor
+    StreamBuffer();
+    // Destructor releases the buffer and any fences
+    ~StreamBuffer();
+    // Creates the buffer on the GPU.
+    // target: e.g. GL_UNIFORM_BUFFER or GL_ARRAY_BUFFER
+    // regionSize: bytes available for writing each frame
+    // regionCount: how many frames may be in flight at once
+    void Create(GLenum target, GLsizeiptr regionSize, unsigned int regionCount=3);
+    // Releases the buffer on the GPU
+    void Destroy();
+    // Selects the next region and makes it writable. Never waits on
+    // the GPU: if the persistent path finds the region still in use it
+    // returns false and stays where it was, try again later.
+    bool BeginFrame();
+    // Returns 'size' bytes of the current region with the start
+    // aligned to 'alignment'. cpuPtr is nullptr if the region is full.
+    // An alignment of 0 uses the smallest alignment the target allows.
+    StreamAllocation Allocate(GLsizeiptr size, GLsizeiptr alignment=0);
+    // Makes everything written since BeginFrame visible to the GPU.
+    // Must be called before any draw call reads from the buffer.
+    void Flush();
+    // Places a fence after the draws that used this region.
+    // Call once all draw calls for the frame have been issued.
+    void EndFrame();
+    // Return the buffer id
+    GLuint GetID() const;
+    // Smallest alignment allocations get (e.g. the uniform buffer offset alignment)
+    GLsizeiptr GetAlignment() const;
+    // True when ARB_buffer_storage gave us a persistent mapping
+    bool IsPersistent() const;
+    // Number of times BeginFrame found its region still in use
+    unsigned int GetStallCount() const;
+
+private:
+    // Returns true if the GPU is done with 'region'
+    bool IsRegionFree(unsigned int region);
+    // Deletes the fence guarding a region (if any)
+    void ReleaseFence(unsigned int region);
+
+    // The buffer object
+    GLBufferHandle m_buffer;
+    // Where we bind the buffer (GL_UNIFORM_BUFFER, etc.)
+    GLenum m_target{GL_UNIFORM_BUFFER};
+    // Size of one region in bytes
+    GLsizeiptr m_regionSize{0};
+    // Alignment used when Allocate is not given one
+    GLsizeiptr m_minAlignment{4};
+    // Number of regions
+    unsigned int m_regionCount{0};
+    // Region currently being written
+    unsigned int m_currentRegion{0};
+    // Bytes used in the current region
+    GLsizeiptr m_head{0};
+    // Bytes already flushed in the current region
+    GLsizeiptr m_flushed{0};
+    // Where the current mapping starts, relative to the region
+    GLsizeiptr m_mapOffset{0};
+    // One fence per region, empty if the region was never used
+    std::vector<GLSyncHandle> m_fences;
+    // Start of the whole buffer when persistently mapped
+    char* m_persistentPtr{nullptr};
+    // Start of the current region
+    char* m_regionPtr{nullptr};
+    // True if the buffer is persistently mapped
+    bool m_persistent{false};
+    // True between BeginFrame and Flush in the mapped path
+    bool m_mapped{false};
+    // Counts BeginFrame calls that found their region busy
+    unsigned int m_stallCount{0};
+};
+
+#endif
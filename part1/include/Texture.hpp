@@ -6,8 +6,12 @@
 #define TEXTURE_HPP
 
 #include "Image.hpp"
+#include "GLHandle.hpp"
 
 #include <glad/glad.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
 #include <string>
 
 class Texture{
@@ -16,21 +20,68 @@ public:
     Texture();
     // Destructor
     ~Texture();
+    // Textures can be moved (e.g. into a std::vector) but not copied,
+    // since only one of them may delete the texture on the GPU.
+    Texture(Texture&& other) noexcept;
+    Texture& operator=(Texture&& other) noexcept;
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
 	// Loads and sets up an actual texture
     void LoadTexture(const std::string filepath);
+    // The two halves of LoadTexture, so decoding can run on a worker:
+    // Reads and decodes the image (no OpenGL calls, any thread)
+    void Decode(const std::string filepath);
+    // Creates the OpenGL texture from the decoded image (GL thread).
+    // The decoded image is freed afterwards, and the texture is handed
+    // to the TextureResidency, which may shrink it later.
+    void Upload();
+    // Replaces what is on the GPU with 'image', the full image shrunk by
+    // 'dropped' levels (see Image::Downsample). The texture keeps its
+    // name, so draw packets holding it stay valid. (GL thread)
+    // Returns false, changing nothing, if 'image' failed to load.
+    bool Reupload(Image& image, unsigned int dropped);
+
+    // Size of the full image, mip level 0
+    int GetWidth() const;
+    int GetHeight() const;
+    // Mip levels of the full image
+    unsigned int GetLevelCount() const;
+    // Top mip levels that are not on the GPU right now
+    unsigned int GetDroppedLevels() const;
+    // Bytes on the GPU without the top 'dropped' levels
+    size_t GetBytes(unsigned int dropped) const;
+    // Where to read the image from again
+    const std::string& GetFilepath() const;
+    // Notes that an object 'pixels' high on screen uses us this frame
+    // (any thread, see Object::UpdateEntity)
+    void MarkUsed(float pixels) const;
+    // Returns the largest height marked since the last call, 0 if we
+    // were not used, and starts over
+    float TakeFootprint() const;
+
 	// slot tells us which slot we want to bind to.
     // We can have multiple slots. By default, we
     // will set our slot to 0 if it is not specified.
     void Bind(unsigned int slot=0) const;
     // Be done with our texture
     void Unbind();
+    // Return the texture id
+    GLuint GetID() const;
 private:
-    // Store a unique ID for the texture
-    GLuint m_textureID;
+    // The texture on the GPU
+    GLTextureHandle m_texture;
 	// Filepath to the image loaded
     std::string m_filepath;
     // Store whatever image data inside of our texture class.
-    Image* m_image;
+    std::unique_ptr<Image> m_image;
+    // Size and mip levels of the full image, and how many of the
+    // top levels were dropped to save memory
+    int m_width{0};
+    int m_height{0};
+    unsigned int m_levelCount{0};
+    unsigned int m_droppedLevels{0};
+    // Written while frames are built, read by the TextureResidency
+    mutable std::atomic<float> m_footprint{0.0f};
 };
 
 
@@ -0,0 +1,116 @@
+/** @file TextureResidency.hpp
+ *  @brief Keeps the textures on the GPU within a memory budget.
+ *
+ *  Every uploaded Texture registers here with its size per mip level.
+ *  While frames are built, each visible object marks its textures as
+ *  used along with its height on screen (Object::UpdateEntity). Once
+ *  per frame the render thread calls Update(), which
+ *
+ *    - shrinks textures while the total is over the budget, by dropping
+ *      their top mip level: least recently used first, then those whose
+ *      top level is finer than their objects show on screen, then the
+ *      smallest on screen;
+ *    - grows textures that are in view again back to the detail their
+ *      footprint asks for, largest on screen first, as far as the
+ *      budget allows.
+ *
+ *  Both directions reload the image from its file on a worker (shrunk
+ *  with Image::Downsample) and re-specify the texture on the GL thread,
+ *  so no CPU copies are kept around. A texture keeps its OpenGL name
+ *  throughout, only its size changes.
+ *
+ *  A budget of 0 (the default) means no limit: nothing is shrunk.
+ */
+#ifndef TEXTURERESIDENCY_HPP
+#define TEXTURERESIDENCY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class Image;
+class Texture;
+
+// Textures are not shrunk below this many texels on their longer edge
+const unsigned int RESIDENCY_MIN_TEXTURE_SIZE = 32;
+// Reloads started per Update(), spreads the file reads over frames
+const unsigned int RESIDENCY_MAX_RELOADS = 2;
+// Update() calls a texture whose reload failed (e.g. its file is gone)
+// is left alone for, before it is tried again
+const unsigned int RESIDENCY_RETRY_UPDATES = 600;
+
+class TextureResidency{
+public:
+    // Singleton pattern for having one budget for all textures
+    static TextureResidency& Instance();
+    // Destructor
+    ~TextureResidency();
+
+    // Bytes all textures together may use on the GPU, 0 for no limit
+    void SetBudget(size_t bytes);
+    size_t GetBudget() const;
+    // Bytes of all textures as they are on the GPU now
+    size_t GetResidentBytes();
+    // Bytes they would take with every mip level
+    size_t GetFullBytes();
+    // Goes up whenever a texture changed size, so the picture does too
+    unsigned int GetVersion() const;
+
+    // Called by Texture once it is uploaded, when it is gone, and when
+    // it moved (any thread)
+    void Register(Texture* texture);
+    void Unregister(Texture* texture);
+    void Retarget(Texture& from, Texture& to);
+
+    // Reads the usage marked since the last call and starts shrinking
+    // or growing textures (GL thread, once per frame). Returns how many
+    // textures changed size since the last call.
+    unsigned int Update();
+
+private:
+    // Singleton, so the constructor is private
+    TextureResidency();
+    TextureResidency(const TextureResidency&) = delete;
+    TextureResidency& operator=(const TextureResidency&) = delete;
+
+    struct Record{
+        Texture* texture;
+        // Tells a texture apart from a later one at the same address
+        uint64_t serial;
+        // Update() that last saw it used, and the largest height on
+        // screen it was used at back then
+        uint64_t lastUsed;
+        float footprint;
+        // Dropped levels once the pending reload (if any) is done
+        unsigned int target;
+        bool pending;
+        // Not shrunk or grown before this Update() (see RESIDENCY_RETRY_UPDATES)
+        uint64_t retryAfter;
+    };
+
+    // Top levels 'record' can lose without going below the minimum size
+    static unsigned int GetMaxDrop(const Record& record);
+    // Top levels its footprint on screen does not need
+    static unsigned int GetWantedDrop(const Record& record);
+    // Starts reading 'record' from its file without its top 'dropped'
+    // levels (with m_mutex held)
+    void Reload(Record& record, unsigned int dropped);
+    // Reload finished on the GL thread: puts 'image' on the GPU
+    // if the texture is still around
+    void FinishReload(uint64_t serial, Image& image, unsigned int dropped);
+
+    // Guards m_records, textures come and go on any thread
+    std::mutex m_mutex;
+    std::vector<Record> m_records;
+    uint64_t m_nextSerial{1};
+    // Number of Update() calls so far
+    uint64_t m_updates{0};
+    // Textures that changed size since the last Update()
+    unsigned int m_finished{0};
+    std::atomic<size_t> m_budget{0};
+    std::atomic<unsigned int> m_version{0};
+};
+
+#endif
@@ -36,6 +36,9 @@ public:
     void ApplyTransform(Transform t);
     // Returns the transformation matrix
     glm::mat4 GetInternalMatrix() const;
+    // Returns a counter that changes every time the matrix is modified.
+    // Useful for caching anything derived from the matrix.
+    unsigned int GetVersion() const;
 
     // Transform multiplicaiton
 	Transform& operator*=(const Transform& t);
@@ -51,6 +54,8 @@ public:
 private:
     // Stores the actual transformation matrix
     glm::mat4 m_modelTransformMatrix;
+    // Incremented whenever m_modelTransformMatrix changes
+    unsigned int m_version{0};
 };
 
 
@@ -0,0 +1,45 @@
+/** @file UniformBlocks.hpp
+ *  @brief CPU side mirrors of the uniform blocks declared in our shaders.
+ *
+ *  These must match the std140 layout of the blocks in
+ *  shaders/vert.glsl and shaders/frag.glsl exactly.
+ */
+#ifndef UNIFORMBLOCKS_HPP
+#define UNIFORMBLOCKS_HPP
+
+#include <glad/glad.h>
+#include "glm/glm.hpp"
+
+// Binding points shared by every shader
+const GLuint FRAME_CONSTANTS_BINDING = 0;
+const GLuint OBJECT_CONSTANTS_BINDING = 1;
+
+// Written once per frame.
+// std140: mat4 is 64 bytes, vec3 takes the space of a vec4.
+struct FrameConstants{
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::vec3 lightPos;
+    float pad0;
+    glm::vec3 viewPos;
+    float pad1;
+};
+
+// Written once per object per frame.
+// std140: bools are stored as 4 byte integers.
+struct ObjectConstants{
+    glm::mat4 modelTransformMatrix;
+    GLint useNormalMap;
+    GLint useParallaxMapping;
+    GLint useSelfShadowing;
+    float depthScale;
+    // Turns stored vertex positions into object space (see
+    // VertexFormat.hpp), w is unused
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+};
+
+static_assert(sizeof(FrameConstants) == 160, "FrameConstants does not match std140 layout");
+static_assert(sizeof(ObjectConstants) == 112, "ObjectConstants does not match std140 layout");
+
+#endif
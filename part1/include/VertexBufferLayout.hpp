@@ -7,6 +7,16 @@
 // The glad library helps setup OpenGL extensions.
 #include <glad/glad.h>
 
+#include "GLHandle.hpp"
+#include "VertexFormat.hpp"
+
+#include <cstddef>
+
+// Contents of one vertex stream
+struct VertexStreamData{
+    const void* data{nullptr};
+    size_t bytes{0};
+};
 
 class VertexBufferLayout{ 
 public:
@@ -14,28 +24,57 @@ public:
     VertexBufferLayout();
     // Destroys all of our buffers.
     ~VertexBufferLayout();
+    // Layouts can be moved but not copied, since only
+    // one of them may delete the buffers.
+    VertexBufferLayout(VertexBufferLayout&& other) noexcept;
+    VertexBufferLayout& operator=(VertexBufferLayout&& other) noexcept;
+    VertexBufferLayout(const VertexBufferLayout&) = delete;
+    VertexBufferLayout& operator=(const VertexBufferLayout&) = delete;
     // Selects the buffer to bind
     // We only need to bind to a buffer
     // again if we are updating the data.
     void Bind();
     // Unbind our buffers
     void Unbind();
+    // Return the vertex array id.
+    // Binding it alone is enough to draw, the index buffer
+    // is part of the vertex array state.
+    GLuint GetVertexArrayID() const;
+
+    // Creates the vertex array for 'layout' (see VertexLayout.hpp):
+    // one vertex buffer per stream, filled from streams[i], which must
+    // be in the layout already (see VertexLayout::Pack), and an index
+    // buffer with 'icount' indices. Streams read per instance can be
+    // changed later with UpdateStream.
+    void Create(const VertexLayout& layout, const VertexStreamData* streams, unsigned int icount, const unsigned int* idata);
+    // Create in two steps, so the vertices can be written straight into
+    // the buffers instead of being built in memory and copied:
+    // BeginCreate makes one buffer of streamBytes[i] bytes per stream
+    // and maps it for writing, mapped[i] gets its address (or nullptr
+    // if it could not be mapped). Any thread may fill the mapped
+    // memory, then FinishCreate unmaps it and sets up the attributes and
+    // the index buffer. FinishCreate returns false if the contents were
+    // lost while mapped (or never mapped), they then need to go in with
+    // Create. Both run on the GL thread.
+    void BeginCreate(const VertexLayout& layout, const size_t* streamBytes, void** mapped);
+    bool FinishCreate(const VertexLayout& layout, unsigned int icount, const unsigned int* idata);
+    // Replaces the contents of one stream, e.g. the per-instance data
+    void UpdateStream(unsigned int stream, const void* data, size_t bytes);
 
     // Creates a vertex and index buffer object
-    // Format is: x,y,z
-    // vcount: the number of vertices
+    // Format is: x,y,z (POSITION_LAYOUT)
+    // vcount: the number of floats
     // icount: the number of indices
     // vdata: A pointer to an array of data for vertices
     // idata: A pointer to an array of data for indices
-    // NOTE: Works only for floats--could support other formats.
-    //       
     void CreatePositionBufferLayout(unsigned int vcount,unsigned int icount, float* vdata, unsigned int* idata );
 
     // Creates a vertex and index buffer object
-    // Format is: x,y,z, s,t
+    // Format is: x,y,z, s,t (TEXTURED_LAYOUT)
     void CreateTextureBufferLayout(unsigned int vcount,unsigned int icount, float* vdata, unsigned int* idata );
 
     // A normal map layout needs the following attributes
+    // (NORMAL_MAP_LAYOUT)
     //
     // positions: x,y,z
     // normals:  x,y,z
@@ -45,14 +84,15 @@ public:
     void CreateNormalBufferLayout(unsigned int vcount,unsigned int icount, float* vdata, unsigned int* idata );
 
 private:
+    // Points the layout at our buffers and fills the index buffer
+    void SetupArray(const VertexLayout& layout, unsigned int icount, const unsigned int* idata);
+
     // Vertex Array Object
-    GLuint m_VAOId;
-    // Vertex Buffer
-    GLuint m_vertexPositionBuffer;
+    GLVertexArrayHandle m_vertexArray;
+    // Vertex Buffers, one per stream of the layout
+    GLBufferHandle m_vertexBuffers[MAX_VERTEX_STREAMS];
     // Index Buffer Object
-    GLuint m_indexBufferObject;
-    // Stride of data (how do I get to the next vertex)
-    unsigned int m_stride{0};
+    GLBufferHandle m_indexBufferObject;
 };
 
 
@@ -0,0 +1,135 @@
+/** @file VertexFormat.hpp
+ *  @brief Compact encodings of the normal mapping vertex layout.
+ *
+ *  Geometry::Gen interleaves 14 floats per vertex (56 bytes): position,
+ *  normal, texture coordinate, tangent and bitangent. The compact
+ *  formats store the same vertex in 20 bytes:
+ *
+ *    position   4 x 16 bit  half floats, or unsigned normalized values
+ *                           relative to the mesh bounds (the 4th is padding)
+ *    qtangent   4 x snorm16 the tangent frame as a quaternion, the sign
+ *                           of w is the handedness of the bitangent
+ *    texCoord   2 x 16 bit  half floats, or unsigned normalized if every
+ *                           coordinate is within [0,1]
+ *
+ *  OpenGL converts the 16 bit values to floats while fetching, so
+ *  vert.glsl only rebuilds the tangent frame from the quaternion
+ *  (compiled with GetVertexFormatDefines) and scales quantized
+ *  positions back (u_PositionScale and u_PositionOffset, which are an
+ *  identity for the other formats).
+ */
+#ifndef VERTEXFORMAT_HPP
+#define VERTEXFORMAT_HPP
+
+#include <glad/glad.h>
+
+#include "Bounds.hpp"
+#include "VertexLayout.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Geometry;
+
+// How a mesh's vertices are stored on the GPU
+enum class VertexFormat : uint8_t{
+    Float = 0,  // 56 bytes, what Geometry::Gen builds
+    Half,       // 20 bytes: half positions, QTangent, half texture coordinates
+    Quantized   // 20 bytes: positions quantized to the bounds, QTangent,
+                //           unorm16 texture coordinates where they fit
+};
+
+// Floats per vertex of the interleaved Geometry::Gen layout
+const unsigned int FLOAT_VERTEX_COMPONENTS = 14;
+
+// Attribute locations, shared with the shaders. The compact formats
+// keep position and texture coordinates where they always were, so the
+// fallback program draws them too, and put the quaternion where no
+// float attribute goes.
+const GLuint POSITION_ATTRIBUTE = 0;
+const GLuint NORMAL_ATTRIBUTE = 1;
+const GLuint TEXCOORD_ATTRIBUTE = 2;
+const GLuint TANGENT_ATTRIBUTE = 3;
+const GLuint BITANGENT_ATTRIBUTE = 4;
+const GLuint QTANGENT_ATTRIBUTE = 5;
+
+// The layouts. Attribute order matters to AttributeSource arrays.
+
+// x,y,z
+inline constexpr VertexLayout POSITION_LAYOUT{
+    { POSITION_ATTRIBUTE, AttributeType::Float, 3 },
+};
+
+// x,y,z, s,t (texture coordinates at location 1 in this layout)
+inline constexpr VertexLayout TEXTURED_LAYOUT{
+    { POSITION_ATTRIBUTE, AttributeType::Float, 3 },
+    { 1, AttributeType::Float, 2 },
+};
+
+// What Geometry::Gen builds: position, normal, texture coordinate,
+// tangent and bitangent, all floats
+inline constexpr VertexLayout NORMAL_MAP_LAYOUT{
+    { POSITION_ATTRIBUTE, AttributeType::Float, 3 },
+    { NORMAL_ATTRIBUTE, AttributeType::Float, 3 },
+    { TEXCOORD_ATTRIBUTE, AttributeType::Float, 2 },
+    { TANGENT_ATTRIBUTE, AttributeType::Float, 3 },
+    { BITANGENT_ATTRIBUTE, AttributeType::Float, 3 },
+};
+
+// VertexFormat::Half
+inline constexpr VertexLayout COMPACT_HALF_LAYOUT{
+    { POSITION_ATTRIBUTE, AttributeType::HalfFloat, 3 },
+    { QTANGENT_ATTRIBUTE, AttributeType::Short, 4, true },
+    { TEXCOORD_ATTRIBUTE, AttributeType::HalfFloat, 2 },
+};
+
+// VertexFormat::Quantized, and the same with texture coordinates
+// outside [0,1]
+inline constexpr VertexLayout COMPACT_QUANTIZED_LAYOUT{
+    { POSITION_ATTRIBUTE, AttributeType::UnsignedShort, 3, true },
+    { QTANGENT_ATTRIBUTE, AttributeType::Short, 4, true },
+    { TEXCOORD_ATTRIBUTE, AttributeType::UnsignedShort, 2, true },
+};
+inline constexpr VertexLayout COMPACT_QUANTIZED_HALF_UV_LAYOUT{
+    { POSITION_ATTRIBUTE, AttributeType::UnsignedShort, 3, true },
+    { QTANGENT_ATTRIBUTE, AttributeType::Short, 4, true },
+    { TEXCOORD_ATTRIBUTE, AttributeType::HalfFloat, 2 },
+};
+
+static_assert(NORMAL_MAP_LAYOUT.GetStride(0) == FLOAT_VERTEX_COMPONENTS*sizeof(float), "NORMAL_MAP_LAYOUT does not match Geometry::Gen");
+static_assert(COMPACT_HALF_LAYOUT.GetStride(0) == 20, "Compact vertices should take 20 bytes");
+static_assert(COMPACT_QUANTIZED_LAYOUT.GetStride(0) == 20, "Compact vertices should take 20 bytes");
+
+// Vertices encoded in a compact format, ready for VertexBufferLayout::Create
+struct CompactVertices{
+    std::vector<unsigned char> data;
+    // One of the COMPACT_ layouts
+    const VertexLayout* layout{&COMPACT_HALF_LAYOUT};
+    // position = stored * positionScale + positionOffset
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+};
+
+// Encodes a tangent frame as a unit quaternion whose w is never zero,
+// so its sign can carry the handedness (negative: the bitangent is
+// flipped relative to cross(normal, tangent)).
+glm::quat EncodeQTangent(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent);
+// The inverse, as vert.glsl does it
+void DecodeQTangent(const glm::quat& qtangent, glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent);
+
+// Encodes the vertices of 'geometry' in 'format', which must not be
+// Float. Reads the separate attributes (Geometry::Interleave), so Gen
+// is not needed, GenerateTangentFrames is.
+void PackCompactVertices(const Geometry& geometry, VertexFormat format, CompactVertices& packed);
+
+// Bytes per vertex on the GPU
+unsigned int GetVertexFormatStride(VertexFormat format);
+// Shader defines that make vert.glsl read 'format'
+std::string GetVertexFormatDefines(VertexFormat format);
+const char* GetVertexFormatName(VertexFormat format);
+
+#endif
@@ -0,0 +1,141 @@
+/** @file VertexLayout.hpp
+ *  @brief Compile-time descriptions of how vertices are laid out in buffers.
+ *
+ *  A VertexLayout is a list of attributes: the shader location, the
+ *  component type and count, whether integers are normalized, and the
+ *  stream (vertex buffer) the attribute is stored in. Everything else is
+ *  derived from that list in a constexpr constructor: the offset of each
+ *  attribute, the stride of each stream, and how many streams there are.
+ *
+ *      constexpr VertexLayout TEXTURED_LAYOUT{
+ *          { POSITION_ATTRIBUTE, AttributeType::Float, 3 },
+ *          { TEXCOORD_ATTRIBUTE, AttributeType::Float, 2 },
+ *      };
+ *
+ *  Attributes that share a stream are interleaved in declaration order.
+ *  Spreading them over streams gives split-stream layouts (e.g. positions
+ *  on their own for depth-only passes), and a stream with a divisor is
+ *  read once per instance instead of once per vertex.
+ *
+ *  VertexBufferLayout::Create turns a layout into a vertex array, and
+ *  Pack converts float data into a stream of the layout, so a new format
+ *  is one declaration rather than new upload and packing code.
+ */
+#ifndef VERTEXLAYOUT_HPP
+#define VERTEXLAYOUT_HPP
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <initializer_list>
+
+// Enough for every layout we declare. Going over either fails to
+// compile when the layout is constexpr.
+const unsigned int MAX_VERTEX_ATTRIBUTES = 8;
+const unsigned int MAX_VERTEX_STREAMS = 4;
+
+// Type of the components of an attribute as they are stored
+enum class AttributeType : unsigned char{
+    Float,
+    HalfFloat,
+    Byte,
+    UnsignedByte,
+    Short,
+    UnsignedShort
+};
+
+constexpr unsigned int GetAttributeTypeSize(AttributeType type){
+    return type == AttributeType::Float ? 4 :
+           (type == AttributeType::Byte || type == AttributeType::UnsignedByte) ? 1 : 2;
+}
+
+constexpr GLenum GetAttributeTypeGL(AttributeType type){
+    return type == AttributeType::Float ? GL_FLOAT :
+           type == AttributeType::HalfFloat ? GL_HALF_FLOAT :
+           type == AttributeType::Byte ? GL_BYTE :
+           type == AttributeType::UnsignedByte ? GL_UNSIGNED_BYTE :
+           type == AttributeType::Short ? GL_SHORT : GL_UNSIGNED_SHORT;
+}
+
+struct VertexAttribute{
+    // Location in the shader
+    GLuint location{0};
+    AttributeType type{AttributeType::Float};
+    // 1 to 4
+    unsigned int components{0};
+    // Integer types are read as [0,1] (unsigned) or [-1,1] (signed)
+    // instead of as their value
+    bool normalized{false};
+    // Which buffer it lives in
+    unsigned int stream{0};
+    // Bytes from the start of a vertex in its stream, filled in by
+    // VertexLayout
+    unsigned int offset{0};
+};
+
+// Float values to pack into one attribute, 'stride' floats apart
+struct AttributeSource{
+    const float* data{nullptr};
+    unsigned int stride{0};
+};
+
+class VertexLayout{
+public:
+    // 'divisors' holds one entry per stream: 0 (or no entry) advances
+    // the stream every vertex, n every n instances
+    constexpr VertexLayout(std::initializer_list<VertexAttribute> attributes,
+                           std::initializer_list<unsigned int> divisors = {})
+        : m_attributes(), m_strides(), m_divisors(){
+        for(const VertexAttribute& attribute : attributes){
+            VertexAttribute& added = m_attributes[m_attributeCount++];
+            added = attribute;
+            // Every attribute starts on a 4 byte boundary, which all
+            // hardware fetches at full speed
+            added.offset = m_strides[attribute.stream];
+            m_strides[attribute.stream] = AlignTo4(added.offset + GetAttributeTypeSize(attribute.type)*attribute.components);
+            if(attribute.stream+1 > m_streamCount){
+                m_streamCount = attribute.stream+1;
+            }
+        }
+        unsigned int stream = 0;
+        for(unsigned int divisor : divisors){
+            m_divisors[stream++] = divisor;
+        }
+    }
+
+    constexpr unsigned int GetAttributeCount() const{ return m_attributeCount; }
+    constexpr const VertexAttribute& GetAttribute(unsigned int index) const{ return m_attributes[index]; }
+    constexpr unsigned int GetStreamCount() const{ return m_streamCount; }
+    // Bytes from one vertex (or instance) of 'stream' to the next
+    constexpr unsigned int GetStride(unsigned int stream) const{ return m_strides[stream]; }
+    constexpr unsigned int GetDivisor(unsigned int stream) const{ return m_divisors[stream]; }
+    // Index of the attribute at shader 'location', or GetAttributeCount()
+    constexpr unsigned int FindAttribute(GLuint location) const{
+        for(unsigned int i=0; i < m_attributeCount; ++i){
+            if(m_attributes[i].location == location){
+                return i;
+            }
+        }
+        return m_attributeCount;
+    }
+
+    // Fills 'destination' (count*GetStride(stream) bytes) with 'count'
+    // vertices of 'stream', converting from floats. sources[i] feeds
+    // attribute i; attributes of other streams are skipped, ones without
+    // data and the padding between attributes are zero.
+    void Pack(unsigned int stream, const AttributeSource* sources, unsigned int count, void* destination) const;
+    // Points the attributes of the vertex array bound right now at
+    // 'buffers' (one per stream)
+    void Apply(const GLuint* buffers) const;
+
+private:
+    static constexpr unsigned int AlignTo4(unsigned int bytes){ return (bytes + 3u) & ~3u; }
+
+    VertexAttribute m_attributes[MAX_VERTEX_ATTRIBUTES];
+    unsigned int m_attributeCount{0};
+    unsigned int m_streamCount{0};
+    unsigned int m_strides[MAX_VERTEX_STREAMS];
+    unsigned int m_divisors[MAX_VERTEX_STREAMS];
+};
+
+#endif
@@ -0,0 +1,15 @@
+// ==================================================================
+#version 330 core
+// Cheap stand-in for frag.glsl: just the diffuse texture.
+
+out vec4 FragColor;
+
+in vec2 v_texCoord;
+
+uniform sampler2D u_DiffuseMap; 
+
+void main()
+{
+    FragColor = texture(u_DiffuseMap, v_texCoord);
+}
+// ==================================================================
@@ -0,0 +1,37 @@
+// ==================================================================
+#version 330 core
+// Cheap stand-in for vert.glsl, drawn until an object's real
+// program has finished compiling (see ShaderCompiler.hpp).
+// Uses the same attribute locations and uniform blocks.
+layout(location=0)in vec3 position; 
+layout(location=2)in vec2 texCoord;
+
+out vec2 v_texCoord;
+
+// Written once per frame (must match vert.glsl)
+layout(std140) uniform FrameConstants{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 lightPos;
+    vec3 viewPos;
+};
+
+// Written once per object (must match vert.glsl)
+layout(std140) uniform ObjectConstants{
+    mat4 modelTransformMatrix;
+    bool u_UseNormalMap;
+    bool u_UseParallaxMapping;
+    bool u_UseSelfShadowing;
+    float u_DepthScale;
+    vec4 u_PositionScale;
+    vec4 u_PositionOffset;
+};
+
+void main()
+{
+	// Quantized positions are scaled back to the mesh bounds
+	vec3 objectPosition = position * u_PositionScale.xyz + u_PositionOffset.xyz;
+	gl_Position = projectionMatrix * viewMatrix * modelTransformMatrix * vec4(objectPosition, 1.0);
+  	v_texCoord = texCoord;
+}
+// ==================================================================
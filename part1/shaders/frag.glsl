@@ -17,13 +17,16 @@ uniform sampler2D u_DiffuseMap;
 uniform sampler2D u_NormalMap; 
 uniform sampler2D u_DepthMap; 
 
-// Control toggles
-uniform bool u_UseNormalMap; // toggle normal mapping
-uniform bool u_UseParallaxMapping; // toggle parallax mapping
-uniform bool u_UseSelfShadowing; // toggle shadow
-
-// Depth scaling factor
-uniform float u_DepthScale;
+// Written once per object (must match the block in vert.glsl)
+layout(std140) uniform ObjectConstants{
+    mat4 modelTransformMatrix;
+    bool u_UseNormalMap; // toggle normal mapping
+    bool u_UseParallaxMapping; // toggle parallax mapping
+    bool u_UseSelfShadowing; // toggle shadow
+    float u_DepthScale; // Depth scaling factor
+    vec4 u_PositionScale; // Decodes stored vertex positions
+    vec4 u_PositionOffset;
+};
 
 // Function for parallax mapping
 vec2 ParallaxOcclusionMapping(vec2 texCoords, vec3 viewDir)
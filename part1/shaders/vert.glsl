@@ -4,10 +4,16 @@
 // We explicitly state which is the vertex information
 // (The first 3 floats are positional data, we are putting in our vector)
 layout(location=0)in vec3 position; 
-layout(location=1)in vec3 normals; // Our second attribute - normals.
 layout(location=2)in vec2 texCoord; // Our third attribute - texture coordinates.
+#ifdef QTANGENT_VERTICES
+// Compact vertices (see VertexFormat.hpp) store the whole tangent
+// frame as a quaternion, the sign of w is the bitangent's handedness
+layout(location=5)in vec4 qtangent;
+#else
+layout(location=1)in vec3 normals; // Our second attribute - normals.
 layout(location=3)in vec3 tangents; // Our third attribute - texture coordinates.
 layout(location=4)in vec3 bitangents; // Our third attribute - texture coordinates.
+#endif
 
 // If we have texture coordinates we can now use this as well
 out vec3 FragPos;
@@ -18,19 +24,53 @@ out vec3 TangentFragPos;
 
 // If we are applying our camera, then we need to add some uniforms.
 // Note that the syntax nicely matches glm's mat4!
+// These live in uniform buffers that are streamed every frame,
+// see UniformBlocks.hpp for the matching C++ structs.
+
+// Written once per frame
+layout(std140) uniform FrameConstants{
+    mat4 viewMatrix;           // World space to view (camera) space
+    mat4 projectionMatrix;
+    vec3 lightPos; // Our light source position from where light is hitting this object
+    vec3 viewPos;  // Where our camera is
+};
 
-uniform mat4 modelTransformMatrix; // Object space
-uniform mat4 viewMatrix;           // World space to view (camera) space
-uniform mat4 projectionMatrix;
-uniform vec3 lightPos; // Our light source position from where light is hitting this object
-uniform vec3 viewPos;  // Where our camera is
+// Written once per object
+layout(std140) uniform ObjectConstants{
+    mat4 modelTransformMatrix; // Object space
+    bool u_UseNormalMap;
+    bool u_UseParallaxMapping;
+    bool u_UseSelfShadowing;
+    float u_DepthScale;
+    vec4 u_PositionScale;  // Decodes stored vertex positions,
+    vec4 u_PositionOffset; // an identity unless they are quantized
+};
+
+#ifdef QTANGENT_VERTICES
+// The columns of the quaternion's rotation matrix
+void DecodeQTangent(vec4 q, out vec3 normal, out vec3 tangent, out vec3 bitangent){
+    q = normalize(q);
+    tangent = vec3(1.0 - 2.0*(q.y*q.y + q.z*q.z), 2.0*(q.x*q.y + q.w*q.z), 2.0*(q.x*q.z - q.w*q.y));
+    bitangent = vec3(2.0*(q.x*q.y - q.w*q.z), 1.0 - 2.0*(q.x*q.x + q.z*q.z), 2.0*(q.y*q.z + q.w*q.x));
+    normal = vec3(2.0*(q.x*q.z + q.w*q.y), 2.0*(q.y*q.z - q.w*q.x), 1.0 - 2.0*(q.x*q.x + q.y*q.y));
+    bitangent *= (q.w < 0.0) ? -1.0 : 1.0;
+}
+#endif
 
 void main()
 {
 	// Transform vertex position into world space and store in FragPos
-    vec4 FragPosWorld = modelTransformMatrix * vec4(position, 1.0);
+    vec3 objectPosition = position * u_PositionScale.xyz + u_PositionOffset.xyz;
+    vec4 FragPosWorld = modelTransformMatrix * vec4(objectPosition, 1.0);
     TangentFragPos = FragPosWorld.xyz;
 
+#ifdef QTANGENT_VERTICES
+    vec3 normals;
+    vec3 tangents;
+    vec3 bitangents;
+    DecodeQTangent(qtangent, normals, tangents, bitangents);
+#endif
+
 	// Calculate TBN matrix to transform to tangent space
     vec3 T = normalize(mat3(modelTransformMatrix) * tangents);
     vec3 B = normalize(mat3(modelTransformMatrix) * bitangents);
@@ -0,0 +1,307 @@
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include "AllocationTracker.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(LINUX) || defined(MAC)
+    #include <dlfcn.h>
+#endif
+#if defined(MINGW)
+    #include <malloc.h>
+#endif
+
+// Everything below is zero-initialized before any constructor runs,
+// so allocations made during static initialization are counted too.
+
+struct AtomicCounts{
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+};
+static AtomicCounts s_frameCounts[ALLOCATION_SUBSYSTEM_COUNT];
+static AtomicCounts s_totalCounts[ALLOCATION_SUBSYSTEM_COUNT];
+
+// Where allocations of the current frame came from, an open addressing
+// hash table keyed by return address. Slots are claimed with a CAS, so
+// recording never takes a lock.
+struct CallSite{
+    std::atomic<void*> address;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+};
+static CallSite s_callSites[ALLOCATION_CALL_SITES];
+// Allocations that found the table full
+static std::atomic<uint64_t> s_droppedCallSites;
+
+static thread_local AllocationSubsystem s_subsystem = AllocationSubsystem::Other;
+
+AllocationCounts AllocationStats::Total() const{
+    AllocationCounts total;
+    for(unsigned int i=0; i < ALLOCATION_SUBSYSTEM_COUNT; ++i){
+        total.allocations += subsystems[i].allocations;
+        total.bytes += subsystems[i].bytes;
+    }
+    return total;
+}
+
+bool AllocationTracker::IsEnabled(){
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Other threads may allocate while we clear, so the first few
+// allocations of a frame can land in the previous one. That is
+// fine for finding out where allocations come from.
+void AllocationTracker::BeginFrame(){
+    for(unsigned int i=0; i < ALLOCATION_SUBSYSTEM_COUNT; ++i){
+        s_frameCounts[i].allocations.store(0, std::memory_order_relaxed);
+        s_frameCounts[i].bytes.store(0, std::memory_order_relaxed);
+    }
+    for(unsigned int i=0; i < ALLOCATION_CALL_SITES; ++i){
+        s_callSites[i].allocations.store(0, std::memory_order_relaxed);
+        s_callSites[i].bytes.store(0, std::memory_order_relaxed);
+        s_callSites[i].address.store(nullptr, std::memory_order_relaxed);
+    }
+    s_droppedCallSites.store(0, std::memory_order_relaxed);
+}
+
+static AllocationStats LoadStats(const AtomicCounts* counts){
+    AllocationStats stats;
+    for(unsigned int i=0; i < ALLOCATION_SUBSYSTEM_COUNT; ++i){
+        stats.subsystems[i].allocations = counts[i].allocations.load(std::memory_order_relaxed);
+        stats.subsystems[i].bytes = counts[i].bytes.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+AllocationStats AllocationTracker::GetFrameStats(){
+    return LoadStats(s_frameCounts);
+}
+
+AllocationStats AllocationTracker::GetTotalStats(){
+    return LoadStats(s_totalCounts);
+}
+
+// Prints a call site as module+offset, which addr2line -f -C -e <module>
+// turns into a function and line (symbol names need -rdynamic)
+static void LogCallSite(void* address, uint64_t allocations, uint64_t bytes){
+#if defined(LINUX) || defined(MAC)
+    Dl_info info;
+    if(dladdr(address, &info) != 0 && info.dli_fname != nullptr){
+        SDL_Log("  %8llu allocs %10llu bytes  %s+0x%lx %s",
+                (unsigned long long)allocations, (unsigned long long)bytes,
+                info.dli_fname, (unsigned long)((char*)address - (char*)info.dli_fbase),
+                info.dli_sname != nullptr ? info.dli_sname : "");
+        return;
+    }
+#endif
+    SDL_Log("  %8llu allocs %10llu bytes  %p",
+            (unsigned long long)allocations, (unsigned long long)bytes, address);
+}
+
+void AllocationTracker::Log(const char* title, const AllocationStats& stats, unsigned int maxCallSites){
+    AllocationCounts total = stats.Total();
+    SDL_Log("[Allocations] %s: %llu allocations, %llu bytes", title,
+            (unsigned long long)total.allocations, (unsigned long long)total.bytes);
+    for(unsigned int i=0; i < ALLOCATION_SUBSYSTEM_COUNT; ++i){
+        if(stats.subsystems[i].allocations == 0){
+            continue;
+        }
+        SDL_Log("  %-12s %8llu allocs %10llu bytes", GetSubsystemName((AllocationSubsystem)i),
+                (unsigned long long)stats.subsystems[i].allocations,
+                (unsigned long long)stats.subsystems[i].bytes);
+    }
+
+    // Busiest call sites first. A copy on the stack, since allocating
+    // here would show up in the very numbers we print.
+    struct Site{ void* address; uint64_t allocations; uint64_t bytes; };
+    Site sites[ALLOCATION_CALL_SITES];
+    unsigned int siteCount = 0;
+    for(unsigned int i=0; i < ALLOCATION_CALL_SITES; ++i){
+        void* address = s_callSites[i].address.load(std::memory_order_relaxed);
+        if(address != nullptr){
+            sites[siteCount++] = { address, s_callSites[i].allocations.load(std::memory_order_relaxed),
+                                   s_callSites[i].bytes.load(std::memory_order_relaxed) };
+        }
+    }
+    for(unsigned int i=0; i < siteCount && i < maxCallSites; ++i){
+        unsigned int busiest = i;
+        for(unsigned int j=i+1; j < siteCount; ++j){
+            if(sites[j].allocations > sites[busiest].allocations){
+                busiest = j;
+            }
+        }
+        Site site = sites[busiest];
+        sites[busiest] = sites[i];
+        sites[i] = site;
+        LogCallSite(site.address, site.allocations, site.bytes);
+    }
+    uint64_t dropped = s_droppedCallSites.load(std::memory_order_relaxed);
+    if(dropped > 0){
+        SDL_Log("  %8llu allocs from call sites that did not fit the table", (unsigned long long)dropped);
+    }
+}
+
+const char* AllocationTracker::GetSubsystemName(AllocationSubsystem subsystem){
+    switch(subsystem){
+        case AllocationSubsystem::Other: return "Other";
+        case AllocationSubsystem::Image: return "Image";
+        case AllocationSubsystem::Geometry: return "Geometry";
+        case AllocationSubsystem::Shader: return "Shader";
+        case AllocationSubsystem::RenderLoop: return "RenderLoop";
+        default: return "Unknown";
+    }
+}
+
+AllocationSubsystem AllocationTracker::GetSubsystem(){
+    return s_subsystem;
+}
+
+AllocationSubsystem AllocationTracker::SetSubsystem(AllocationSubsystem subsystem){
+    AllocationSubsystem previous = s_subsystem;
+    s_subsystem = subsystem;
+    return previous;
+}
+
+void AllocationTracker::Record(size_t bytes, void* callSite){
+    unsigned int subsystem = (unsigned int)s_subsystem;
+    s_frameCounts[subsystem].allocations.fetch_add(1, std::memory_order_relaxed);
+    s_frameCounts[subsystem].bytes.fetch_add(bytes, std::memory_order_relaxed);
+    s_totalCounts[subsystem].allocations.fetch_add(1, std::memory_order_relaxed);
+    s_totalCounts[subsystem].bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if(callSite == nullptr){
+        return;
+    }
+
+    // Fibonacci hashing spreads the (aligned) return addresses
+    uint64_t hash = ((uint64_t)(uintptr_t)callSite * 11400714819323198485ull) >> 56;
+    for(unsigned int probe=0; probe < ALLOCATION_CALL_SITES; ++probe){
+        CallSite& site = s_callSites[(hash + probe) % ALLOCATION_CALL_SITES];
+        void* address = site.address.load(std::memory_order_relaxed);
+        if(address == nullptr){
+            // Claim the slot; if someone beat us to it, 'address' is theirs
+            if(site.address.compare_exchange_strong(address, callSite, std::memory_order_relaxed)){
+                address = callSite;
+            }
+        }
+        if(address == callSite){
+            site.allocations.fetch_add(1, std::memory_order_relaxed);
+            site.bytes.fetch_add(bytes, std::memory_order_relaxed);
+            return;
+        }
+    }
+    s_droppedCallSites.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+// Replacements for the global allocation functions. The return address
+// of operator new is the code that asked for memory (for containers,
+// the inlined container code at the call site).
+#if defined(__GNUC__)
+    #define ALLOCATION_CALL_SITE() __builtin_return_address(0)
+#else
+    #define ALLOCATION_CALL_SITE() nullptr
+#endif
+
+static void* TrackedAllocate(size_t size, void* callSite){
+    AllocationTracker::Record(size, callSite);
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    return pointer;
+}
+
+static void* TrackedAllocateAligned(size_t size, size_t alignment, void* callSite){
+    AllocationTracker::Record(size, callSite);
+    if(size == 0){
+        size = 1;
+    }
+#if defined(MINGW)
+    return _aligned_malloc(size, alignment);
+#else
+    void* pointer = nullptr;
+    if(posix_memalign(&pointer, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) != 0){
+        return nullptr;
+    }
+    return pointer;
+#endif
+}
+
+static void TrackedFreeAligned(void* pointer){
+#if defined(MINGW)
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void* operator new(size_t size){
+    void* pointer = TrackedAllocate(size, ALLOCATION_CALL_SITE());
+    if(pointer == nullptr){
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size){
+    void* pointer = TrackedAllocate(size, ALLOCATION_CALL_SITE());
+    if(pointer == nullptr){
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    return TrackedAllocate(size, ALLOCATION_CALL_SITE());
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    return TrackedAllocate(size, ALLOCATION_CALL_SITE());
+}
+
+void* operator new(size_t size, std::align_val_t alignment){
+    void* pointer = TrackedAllocateAligned(size, (size_t)alignment, ALLOCATION_CALL_SITE());
+    if(pointer == nullptr){
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment){
+    void* pointer = TrackedAllocateAligned(size, (size_t)alignment, ALLOCATION_CALL_SITE());
+    if(pointer == nullptr){
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+    return TrackedAllocateAligned(size, (size_t)alignment, ALLOCATION_CALL_SITE());
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+    return TrackedAllocateAligned(size, (size_t)alignment, ALLOCATION_CALL_SITE());
+}
+
+void operator delete(void* pointer) noexcept{ std::free(pointer); }
+void operator delete[](void* pointer) noexcept{ std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept{ std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept{ std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept{ std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept{ std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept{ TrackedFreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept{ TrackedFreeAligned(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept{ TrackedFreeAligned(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept{ TrackedFreeAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept{ TrackedFreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept{ TrackedFreeAligned(pointer); }
+
+#endif
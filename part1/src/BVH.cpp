@@ -0,0 +1,145 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+
+// Leaves hold at most this many items
+const unsigned int MAX_LEAF_ITEMS = 4;
+// Rebuild once refitting has grown the tree's total surface area this much
+const float REBUILD_AREA_RATIO = 2.0f;
+
+// Constructor
+BVH::BVH(){
+
+}
+
+// Destructor
+BVH::~BVH(){
+
+}
+
+void BVH::Build(const std::vector<AABB>& bounds){
+    m_nodes.clear();
+    m_items.resize(bounds.size());
+    m_itemLeaf.assign(bounds.size(), -1);
+    for(unsigned int i=0; i < bounds.size(); ++i){
+        m_items[i] = i;
+    }
+    m_currentArea = 0.0f;
+    if(!bounds.empty()){
+        // A binary tree with n leaves has 2n-1 nodes
+        m_nodes.reserve(2*(bounds.size()/MAX_LEAF_ITEMS+1));
+        BuildNode(bounds, 0, (unsigned int)bounds.size(), -1);
+    }
+    m_builtArea = m_currentArea;
+}
+
+// Top down build: split on the longest axis of the item centers,
+// at the median, so the tree stays balanced.
+int BVH::BuildNode(const std::vector<AABB>& bounds, unsigned int first, unsigned int count, int parent){
+    int index = (int)m_nodes.size();
+    m_nodes.push_back(Node());
+    m_nodes[index].parent = parent;
+    m_nodes[index].first = first;
+    m_nodes[index].count = count;
+
+    if(count <= MAX_LEAF_ITEMS){
+        for(unsigned int i=first; i < first+count; ++i){
+            m_itemLeaf[m_items[i]] = index;
+        }
+    }else{
+        AABB centers;
+        for(unsigned int i=first; i < first+count; ++i){
+            centers.Expand(bounds[m_items[i]].GetCenter());
+        }
+        glm::vec3 size = centers.max - centers.min;
+        int axis = 0;
+        if(size.y > size.x){ axis = 1; }
+        if(size.z > size[axis]){ axis = 2; }
+
+        unsigned int half = count/2;
+        std::nth_element(m_items.begin()+first, m_items.begin()+first+half, m_items.begin()+first+count,
+                         [&bounds, axis](unsigned int a, unsigned int b){
+                             return bounds[a].GetCenter()[axis] < bounds[b].GetCenter()[axis];
+                         });
+        // Note: m_nodes may reallocate, so do not hold references across these calls
+        int left = BuildNode(bounds, first, half, index);
+        int right = BuildNode(bounds, first+half, count-half, index);
+        m_nodes[index].left = left;
+        m_nodes[index].right = right;
+    }
+    UpdateNodeBounds(index, bounds);
+    return index;
+}
+
+bool BVH::UpdateNodeBounds(int index, const std::vector<AABB>& bounds){
+    Node& node = m_nodes[index];
+    AABB box;
+    if(node.left < 0){
+        for(unsigned int i=node.first; i < node.first+node.count; ++i){
+            box.Expand(bounds[m_items[i]]);
+        }
+    }else{
+        box.Expand(m_nodes[node.left].bounds);
+        box.Expand(m_nodes[node.right].bounds);
+    }
+    if(box == node.bounds){
+        return false;
+    }
+    m_currentArea += box.GetSurfaceArea() - node.bounds.GetSurfaceArea();
+    node.bounds = box;
+    return true;
+}
+
+void BVH::Refit(const std::vector<AABB>& bounds, const std::vector<unsigned int>& movedItems){
+    for(unsigned int item : movedItems){
+        if(item >= m_itemLeaf.size()){
+            continue;
+        }
+        // Walk up until a node's box stops changing; everything
+        // above it is then unchanged as well.
+        int node = m_itemLeaf[item];
+        while(node >= 0 && UpdateNodeBounds(node, bounds)){
+            node = m_nodes[node].parent;
+        }
+    }
+}
+
+void BVH::Cull(const Frustum& frustum, const std::vector<AABB>& bounds, std::vector<unsigned int>& visibleItems) const{
+    if(m_nodes.empty()){
+        return;
+    }
+    // Explicit stack instead of recursion. A balanced tree over
+    // millions of items is still far shallower than this.
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0){
+        const Node& node = m_nodes[stack[--top]];
+        CullResult result = frustum.Test(node.bounds);
+        if(result == CullResult::Outside){
+            continue;
+        }
+        // Fully inside: every item below is visible without more tests
+        if(result == CullResult::Inside){
+            visibleItems.insert(visibleItems.end(), m_items.begin()+node.first, m_items.begin()+node.first+node.count);
+        }else if(node.left < 0){
+            // A leaf straddling a plane, test its items one by one
+            for(unsigned int i=node.first; i < node.first+node.count; ++i){
+                if(frustum.Test(bounds[m_items[i]]) != CullResult::Outside){
+                    visibleItems.push_back(m_items[i]);
+                }
+            }
+        }else{
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
+    }
+}
+
+unsigned int BVH::GetItemCount() const{
+    return (unsigned int)m_items.size();
+}
+
+bool BVH::NeedsRebuild() const{
+    return m_currentArea > m_builtArea * REBUILD_AREA_RATIO;
+}
@@ -0,0 +1,123 @@
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool AABB::IsEmpty() const{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+void AABB::Expand(const glm::vec3& point){
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void AABB::Expand(const AABB& other){
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+glm::vec3 AABB::GetCenter() const{
+    return (min + max) * 0.5f;
+}
+
+glm::vec3 AABB::GetExtents() const{
+    return (max - min) * 0.5f;
+}
+
+float AABB::GetSurfaceArea() const{
+    if(IsEmpty()){
+        return 0.0f;
+    }
+    glm::vec3 size = max - min;
+    return 2.0f*(size.x*size.y + size.y*size.z + size.z*size.x);
+}
+
+// Rather than transforming all 8 corners, start from the translation
+// and add the smallest/largest contribution of each matrix element.
+AABB AABB::Transformed(const glm::mat4& matrix) const{
+    AABB result;
+    if(IsEmpty()){
+        return result;
+    }
+    glm::vec3 translation(matrix[3]);
+    result.min = translation;
+    result.max = translation;
+    // glm is column major: matrix[column][row]
+    for(int column=0; column < 3; ++column){
+        for(int row=0; row < 3; ++row){
+            float a = matrix[column][row] * min[column];
+            float b = matrix[column][row] * max[column];
+            result.min[row] += std::fmin(a,b);
+            result.max[row] += std::fmax(a,b);
+        }
+    }
+    return result;
+}
+
+bool operator==(const AABB& lhs, const AABB& rhs){
+    return lhs.min == rhs.min && lhs.max == rhs.max;
+}
+
+bool operator!=(const AABB& lhs, const AABB& rhs){
+    return !(lhs == rhs);
+}
+
+bool ScreenRect::IsEmpty() const{
+    return width <= 0 || height <= 0;
+}
+
+void ScreenRect::Expand(const ScreenRect& other){
+    if(other.IsEmpty()){
+        return;
+    }
+    if(IsEmpty()){
+        *this = other;
+        return;
+    }
+    int right = std::max(x+width, other.x+other.width);
+    int top = std::max(y+height, other.y+other.height);
+    x = std::min(x, other.x);
+    y = std::min(y, other.y);
+    width = right - x;
+    height = top - y;
+}
+
+ScreenRect ProjectToScreen(const AABB& box, const glm::mat4& viewProjection, int width, int height){
+    ScreenRect rect;
+    if(box.IsEmpty()){
+        return rect;
+    }
+    ScreenRect fullScreen;
+    fullScreen.width = width;
+    fullScreen.height = height;
+
+    glm::vec2 lo( 1e30f,  1e30f);
+    glm::vec2 hi(-1e30f, -1e30f);
+    for(int corner=0; corner < 8; ++corner){
+        glm::vec4 p(corner & 1 ? box.max.x : box.min.x,
+                    corner & 2 ? box.max.y : box.min.y,
+                    corner & 4 ? box.max.z : box.min.z, 1.0f);
+        glm::vec4 clip = viewProjection * p;
+        // Projection flips behind the camera, play it safe
+        if(clip.w <= 1e-4f){
+            return fullScreen;
+        }
+        glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+    // To pixels, one extra on each side for rounding and filtering
+    int x0 = std::max(0,      (int)std::floor((lo.x*0.5f+0.5f) * width)  - 1);
+    int y0 = std::max(0,      (int)std::floor((lo.y*0.5f+0.5f) * height) - 1);
+    int x1 = std::min(width,  (int)std::ceil ((hi.x*0.5f+0.5f) * width)  + 1);
+    int y1 = std::min(height, (int)std::ceil ((hi.y*0.5f+0.5f) * height) + 1);
+    if(x1 <= x0 || y1 <= y0){
+        return rect;
+    }
+    rect.x = x0;
+    rect.y = y0;
+    rect.width = x1 - x0;
+    rect.height = y1 - y0;
+    return rect;
+}
@@ -20,18 +20,22 @@ void Camera::MouseLook(int mouseX, int mouseY){
     // Detect how much the mouse has moved since
     // the last time
     // TODO
-    glm::vec2 mouseDelta = m_oldMousePosition - newMousePosition; 
+    glm::vec2 mouseDelta = newMousePosition - m_oldMousePosition; 
+    Look(mouseDelta.x, mouseDelta.y);
 
+    // Update our old position after we have made changes 
+    m_oldMousePosition = newMousePosition;
+}
+
+// One degree per pixel, like MouseLook always did
+void Camera::Look(float deltaX, float deltaY){
     // Rotate about the upVector
-    // TODO
-    m_viewDirection = glm::rotate(m_viewDirection, glm::radians(mouseDelta.x), m_upVector);
+    m_viewDirection = glm::rotate(m_viewDirection, glm::radians(-deltaX), m_upVector);
 
     // Compute the rightVector
     glm::vec3 rightVector = glm::cross(m_viewDirection, m_upVector);
-    m_viewDirection = glm::rotate(m_viewDirection,glm::radians(mouseDelta.y),rightVector);
-
-    // Update our old position after we have made changes 
-    m_oldMousePosition = newMousePosition;
+    m_viewDirection = glm::rotate(m_viewDirection,glm::radians(-deltaY),rightVector);
+    ++m_version;
 }
 
 // OPTIONAL TODO: 
@@ -41,28 +45,34 @@ void Camera::MouseLook(int mouseX, int mouseY){
 
 void Camera::MoveForward(float speed){
     m_eyePosition += (m_viewDirection * speed);
+    ++m_version;
 }
 
 void Camera::MoveBackward(float speed){
     m_eyePosition -= (m_viewDirection * speed);
+    ++m_version;
 }
 
 void Camera::MoveLeft(float speed){
     glm::vec3 rightVector = glm::cross(m_viewDirection, m_upVector);
     m_eyePosition -= rightVector*speed;
+    ++m_version;
 }
 
 void Camera::MoveRight(float speed){
     glm::vec3 rightVector = glm::cross(m_viewDirection, m_upVector);
     m_eyePosition += rightVector*speed;
+    ++m_version;
 }
 
 void Camera::MoveUp(float speed){
     m_eyePosition.y += speed;
+    ++m_version;
 }
 
 void Camera::MoveDown(float speed){
     m_eyePosition.y -= speed;
+    ++m_version;
 }
 
 // Set the position for the camera
@@ -70,6 +80,7 @@ void Camera::SetCameraEyePosition(float x, float y, float z){
     m_eyePosition.x = x;
     m_eyePosition.y = y;
     m_eyePosition.z = z;
+    ++m_version;
 }
 
 float Camera::GetEyeXPosition(){
@@ -96,6 +107,10 @@ float Camera::GetViewZDirection(){
     return m_viewDirection.z;
 }
 
+unsigned int Camera::GetVersion() const{
+    return m_version;
+}
+
 
 Camera::Camera(){
     std::cout << "(Constructor) Created a Camera!\n";
@@ -109,9 +124,22 @@ Camera::Camera(){
 }
 
 glm::mat4 Camera::GetViewMatrix() const{
+    return GetViewMatrix(GetPose());
+}
+
+glm::mat4 Camera::GetViewMatrix(const CameraPose& pose){
     // Think about the second argument and why that is
     // setup as it is.
-    return glm::lookAt( m_eyePosition,
-                        m_eyePosition + m_viewDirection,
-                        m_upVector);
+    return glm::lookAt( pose.eyePosition,
+                        pose.eyePosition + pose.viewDirection,
+                        pose.upVector);
+}
+
+CameraPose Camera::GetPose() const{
+    CameraPose pose;
+    pose.eyePosition = m_eyePosition;
+    pose.viewDirection = m_viewDirection;
+    pose.upVector = m_upVector;
+    pose.version = m_version;
+    return pose;
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "FrameArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+// The block starts on a cache line, so do most allocations in it
+static const size_t FRAME_ARENA_BLOCK_ALIGNMENT = 64;
+
+// Rounds 'address' up to a multiple of 'alignment' (a power of two)
+static uintptr_t AlignUp(uintptr_t address, size_t alignment){
+    return (address + alignment-1) & ~(uintptr_t)(alignment-1);
+}
+
+// Constructor
+FrameArena::FrameArena(size_t capacity){
+    if(capacity > 0){
+        m_block = static_cast<char*>(::operator new(capacity, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT)));
+        m_capacity = capacity;
+    }
+}
+
+// Destructor
+FrameArena::~FrameArena(){
+    for(size_t i=0; i < m_overflow.size(); ++i){
+        ::operator delete(m_overflow[i]);
+    }
+    if(m_block != nullptr){
+        ::operator delete(m_block, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT));
+    }
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment){
+    uintptr_t base = (uintptr_t)m_block;
+    size_t head = m_head.load(std::memory_order_relaxed);
+    while(true){
+        size_t start = (size_t)(AlignUp(base + head, alignment) - base);
+        size_t end = start + size;
+        if(m_block == nullptr || end > m_capacity){
+            return AllocateOverflow(size, alignment);
+        }
+        // Another thread may have bumped the head meanwhile, then
+        // 'head' holds its new value and we try again from there
+        if(m_head.compare_exchange_weak(head, end, std::memory_order_relaxed)){
+            return m_block + start;
+        }
+    }
+}
+
+void* FrameArena::AllocateOverflow(size_t size, size_t alignment){
+    void* raw = ::operator new(size + alignment);
+    std::lock_guard<std::mutex> lock(m_overflowMutex);
+    m_overflow.push_back(raw);
+    m_overflowBytes += size + alignment;
+    ++m_overflowCount;
+    return (void*)AlignUp((uintptr_t)raw, alignment);
+}
+
+void FrameArena::Reset(){
+    size_t used = GetUsed();
+    m_peak = std::max(m_peak, used);
+    m_head.store(0, std::memory_order_relaxed);
+    if(m_overflow.empty()){
+        return;
+    }
+
+    // This frame did not fit. Free what spilled over and grow the
+    // block, with some room to spare, so the next one does.
+    for(size_t i=0; i < m_overflow.size(); ++i){
+        ::operator delete(m_overflow[i]);
+    }
+    m_overflow.clear();
+    m_overflowBytes = 0;
+
+    if(m_block != nullptr){
+        ::operator delete(m_block, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT));
+    }
+    m_capacity = used + used/2;
+    m_block = static_cast<char*>(::operator new(m_capacity, std::align_val_t(FRAME_ARENA_BLOCK_ALIGNMENT)));
+}
+
+size_t FrameArena::GetUsed() const{
+    return m_head.load(std::memory_order_relaxed) + m_overflowBytes;
+}
+
+size_t FrameArena::GetCapacity() const{
+    return m_capacity;
+}
+
+size_t FrameArena::GetPeak() const{
+    return std::max(m_peak, GetUsed());
+}
+
+unsigned int FrameArena::GetOverflowCount() const{
+    return m_overflowCount;
+}
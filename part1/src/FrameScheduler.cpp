@@ -0,0 +1,118 @@
+#include "FrameScheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Sleeping may overshoot by about a scheduler tick, so we wake
+// up this early and spin for the rest
+const double SPIN_SECONDS = 0.002;
+// Weight of the newest frame in the running average
+const double AVERAGE_WEIGHT = 0.05;
+
+// Constructor
+FrameScheduler::FrameScheduler(){
+    m_secondsPerTick = 1.0 / (double)SDL_GetPerformanceFrequency();
+    m_lastFrameEnd = Now();
+    m_nextDeadline = m_lastFrameEnd;
+}
+
+// Destructor
+FrameScheduler::~FrameScheduler(){
+
+}
+
+double FrameScheduler::Now() const{
+    return (double)SDL_GetPerformanceCounter() * m_secondsPerTick;
+}
+
+void FrameScheduler::SetPolicy(FramePacing policy, double targetFPS){
+    m_targetFPS = std::max(1.0, targetFPS);
+    m_requestedPolicy = policy;
+}
+
+FramePacing FrameScheduler::GetPolicy() const{
+    return m_requestedPolicy;
+}
+
+const char* FrameScheduler::GetPolicyName(FramePacing policy){
+    switch(policy){
+        case FramePacing::VSync:         return "vsync";
+        case FramePacing::AdaptiveVSync: return "adaptive vsync";
+        case FramePacing::TargetFPS:     return "target fps";
+        case FramePacing::Uncapped:      return "uncapped";
+    }
+    return "unknown";
+}
+
+void FrameScheduler::ApplyPolicy(FramePacing policy){
+    int interval = 0;
+    if(policy == FramePacing::VSync){
+        interval = 1;
+    }else if(policy == FramePacing::AdaptiveVSync){
+        interval = -1;
+    }
+    if(SDL_GL_SetSwapInterval(interval) != 0){
+        if(interval == -1 && SDL_GL_SetSwapInterval(1) == 0){
+            // Late swap tearing is not supported everywhere
+            SDL_Log("FrameScheduler: adaptive vsync not supported, using vsync");
+        }else{
+            SDL_Log("FrameScheduler: could not set swap interval %d: %s", interval, SDL_GetError());
+        }
+    }
+    m_appliedPolicy = policy;
+    m_applied = true;
+    // Do not try to catch up on frames from before the switch
+    m_nextDeadline = Now();
+}
+
+void FrameScheduler::BeginFrame(){
+    FramePacing policy = m_requestedPolicy;
+    if(!m_applied || policy != m_appliedPolicy){
+        ApplyPolicy(policy);
+    }
+}
+
+void FrameScheduler::EndFrame(){
+    double workEnd = Now();
+    m_workMilliseconds = (workEnd - m_lastFrameEnd) * 1000.0;
+
+    if(m_appliedPolicy == FramePacing::TargetFPS){
+        double period = 1.0 / m_targetFPS.load();
+        m_nextDeadline += period;
+        // If we fell far behind, start counting again from now
+        // instead of rushing out several frames back to back
+        if(m_nextDeadline < workEnd - period){
+            m_nextDeadline = workEnd;
+        }
+        double remaining = m_nextDeadline - Now();
+        if(remaining > SPIN_SECONDS){
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SPIN_SECONDS));
+        }
+        while(Now() < m_nextDeadline){
+            std::this_thread::yield();
+        }
+    }
+
+    double frameEnd = Now();
+    double frameMilliseconds = (frameEnd - m_lastFrameEnd) * 1000.0;
+    m_lastFrameEnd = frameEnd;
+    m_frameMilliseconds = frameMilliseconds;
+    double average = m_averageMilliseconds;
+    if(average == 0.0){
+        average = frameMilliseconds;
+    }
+    m_averageMilliseconds = average + (frameMilliseconds - average) * AVERAGE_WEIGHT;
+}
+
+double FrameScheduler::GetFrameMilliseconds() const{
+    return m_frameMilliseconds;
+}
+
+double FrameScheduler::GetWorkMilliseconds() const{
+    return m_workMilliseconds;
+}
+
+double FrameScheduler::GetAverageFrameMilliseconds() const{
+    return m_averageMilliseconds;
+}
@@ -0,0 +1,109 @@
+#include "Frustum.hpp"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define FRUSTUM_USE_SSE 1
+#endif
+
+// Constructor
+Frustum::Frustum(){
+    for(int i=0; i < 8; ++i){
+        m_nx[i] = 0.0f;
+        m_ny[i] = 0.0f;
+        m_nz[i] = 0.0f;
+        m_d[i] = 1.0f;
+    }
+}
+
+void Frustum::Extract(const glm::mat4& viewProjection){
+    // glm is column major, so row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+    glm::vec4 rows[4];
+    for(int r=0; r < 4; ++r){
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r],
+                            viewProjection[2][r], viewProjection[3][r]);
+    }
+    glm::vec4 planes[6] = {
+        rows[3] + rows[0], // left
+        rows[3] - rows[0], // right
+        rows[3] + rows[1], // bottom
+        rows[3] - rows[1], // top
+        rows[3] + rows[2], // near
+        rows[3] - rows[2]  // far
+    };
+    for(int i=0; i < 6; ++i){
+        // Normalize so plane distances are in world units
+        float length = glm::length(glm::vec3(planes[i]));
+        if(length > 0.0f){
+            planes[i] /= length;
+        }
+        m_nx[i] = planes[i].x;
+        m_ny[i] = planes[i].y;
+        m_nz[i] = planes[i].z;
+        m_d[i] = planes[i].w;
+    }
+    // Padding planes always pass
+    for(int i=6; i < 8; ++i){
+        m_nx[i] = 0.0f;
+        m_ny[i] = 0.0f;
+        m_nz[i] = 0.0f;
+        m_d[i] = 1.0f;
+    }
+}
+
+// For each plane we compare the distance of the box center against
+// the box 'radius' projected onto the plane normal.
+//   center + radius behind the plane -> the box is outside
+//   center - radius in front of every plane -> the box is inside
+CullResult Frustum::Test(const AABB& box) const{
+    glm::vec3 center = box.GetCenter();
+    glm::vec3 extents = box.GetExtents();
+
+#ifdef FRUSTUM_USE_SSE
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 cz = _mm_set1_ps(center.z);
+    const __m128 ex = _mm_set1_ps(extents.x);
+    const __m128 ey = _mm_set1_ps(extents.y);
+    const __m128 ez = _mm_set1_ps(extents.z);
+    // Clearing the sign bit gives us the absolute value
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 zero = _mm_setzero_ps();
+
+    int outsideMask = 0;
+    int intersectMask = 0;
+    for(int i=0; i < 8; i+=4){
+        __m128 nx = _mm_load_ps(m_nx+i);
+        __m128 ny = _mm_load_ps(m_ny+i);
+        __m128 nz = _mm_load_ps(m_nz+i);
+        __m128 d  = _mm_load_ps(m_d+i);
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx,cx), _mm_mul_ps(ny,cy)),
+                                     _mm_add_ps(_mm_mul_ps(nz,cz), d));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx,absMask),ex),
+                                              _mm_mul_ps(_mm_and_ps(ny,absMask),ey)),
+                                   _mm_mul_ps(_mm_and_ps(nz,absMask),ez));
+
+        outsideMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance,radius), zero));
+        intersectMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance,radius), zero));
+    }
+    if(outsideMask != 0){
+        return CullResult::Outside;
+    }
+    return intersectMask != 0 ? CullResult::Intersects : CullResult::Inside;
+#else
+    bool intersects = false;
+    for(int i=0; i < 6; ++i){
+        float distance = m_nx[i]*center.x + m_ny[i]*center.y + m_nz[i]*center.z + m_d[i];
+        float radius = std::fabs(m_nx[i])*extents.x + std::fabs(m_ny[i])*extents.y + std::fabs(m_nz[i])*extents.z;
+        if(distance + radius < 0.0f){
+            return CullResult::Outside;
+        }
+        if(distance - radius < 0.0f){
+            intersects = true;
+        }
+    }
+    return intersects ? CullResult::Intersects : CullResult::Inside;
+#endif
+}
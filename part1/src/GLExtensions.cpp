@@ -0,0 +1,79 @@
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include "GLExtensions.hpp"
+
+// Constructor is empty, nothing can be queried
+// until we have an OpenGL context.
+GLExtensions::GLExtensions(){
+
+}
+
+GLExtensions& GLExtensions::Instance(){
+    static GLExtensions* instance = new GLExtensions();
+    return *instance;
+}
+
+// Looks up every extension function we may use.
+// If an extension is not advertised we leave the pointer
+// as nullptr so the Has*() queries report it missing.
+void GLExtensions::Load(){
+    if(SDL_GL_ExtensionSupported("GL_ARB_buffer_storage")){
+        m_bufferStorage = (PFNGLBUFFERSTORAGEPROC_EXT)SDL_GL_GetProcAddress("glBufferStorage");
+    }
+    if(SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile")){
+        m_maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT)SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR");
+    }else if(SDL_GL_ExtensionSupported("GL_ARB_parallel_shader_compile")){
+        m_maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT)SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+    if(SDL_GL_ExtensionSupported("GL_ARB_get_program_binary")){
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if(formats > 0){
+            m_getProgramBinary = (PFNGLGETPROGRAMBINARYPROC_EXT)SDL_GL_GetProcAddress("glGetProgramBinary");
+            m_programBinary = (PFNGLPROGRAMBINARYPROC_EXT)SDL_GL_GetProcAddress("glProgramBinary");
+            m_programParameteri = (PFNGLPROGRAMPARAMETERIPROC_EXT)SDL_GL_GetProcAddress("glProgramParameteri");
+        }
+    }
+}
+
+void GLExtensions::PrintSupport() const{
+    SDL_Log("GL_ARB_buffer_storage: %s", HasBufferStorage() ? "yes" : "no");
+    SDL_Log("GL_KHR_parallel_shader_compile: %s", HasParallelShaderCompile() ? "yes" : "no");
+    SDL_Log("GL_ARB_get_program_binary: %s", HasProgramBinary() ? "yes" : "no");
+}
+
+bool GLExtensions::HasBufferStorage() const{
+    return m_bufferStorage != nullptr;
+}
+
+void GLExtensions::BufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags) const{
+    m_bufferStorage(target, size, data, flags);
+}
+
+bool GLExtensions::HasParallelShaderCompile() const{
+    return m_maxShaderCompilerThreads != nullptr;
+}
+
+void GLExtensions::MaxShaderCompilerThreads(GLuint count) const{
+    m_maxShaderCompilerThreads(count);
+}
+
+bool GLExtensions::HasProgramBinary() const{
+    return m_getProgramBinary != nullptr && m_programBinary != nullptr && m_programParameteri != nullptr;
+}
+
+void GLExtensions::GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary) const{
+    m_getProgramBinary(program, bufSize, length, binaryFormat, binary);
+}
+
+void GLExtensions::ProgramBinary(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length) const{
+    m_programBinary(program, binaryFormat, binary, length);
+}
+
+void GLExtensions::ProgramParameteri(GLuint program, GLenum pname, GLint value) const{
+    m_programParameteri(program, pname, value);
+}
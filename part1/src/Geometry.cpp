@@ -1,10 +1,21 @@
 #include "Geometry.hpp"
+#include "AllocationTracker.hpp"
+#include "JobSystem.hpp"
+#include "VertexFormat.hpp"
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include "glm/vec3.hpp"
 #include "glm/vec2.hpp"
 #include "glm/glm.hpp"
 
+// Vertices interleaved per task in Gen
+static const size_t INTERLEAVE_GRAIN_SIZE = 16384;
+// Triangles and vertices per task in GenerateTangentFrames
+static const size_t TANGENT_TRIANGLE_GRAIN_SIZE = 8192;
+static const size_t TANGENT_VERTEX_GRAIN_SIZE = 16384;
+
 // Constructor
 Geometry::Geometry(){
 
@@ -19,9 +30,11 @@ Geometry::~Geometry(){
 // Adds a vertex and associated texture coordinate.
 // Will also add a and a normal
 void Geometry::AddVertex(float x, float y, float z, float s, float t){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
 	m_vertexPositions.push_back(x);
 	m_vertexPositions.push_back(y);
 	m_vertexPositions.push_back(z);
+	m_localBounds.Expand(glm::vec3(x,y,z));
     // Add texture coordinates
 	m_textureCoords.push_back(s);
 	m_textureCoords.push_back(t);
@@ -37,6 +50,93 @@ void Geometry::AddVertex(float x, float y, float z, float s, float t){
 	m_biTangents.push_back(0.0f);
 	m_biTangents.push_back(0.0f);
 	m_biTangents.push_back(1.0f);
+	++m_vertexCount;
+	m_normalsGiven = false;
+}
+
+void Geometry::Reserve(unsigned int vertexCount, unsigned int indexCount){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
+	size_t vertices = m_vertexPositions.size()/3 + vertexCount;
+	m_vertexPositions.reserve(vertices*3);
+	m_textureCoords.reserve(vertices*2);
+	m_normals.reserve(vertices*3);
+	m_tangents.reserve(vertices*3);
+	m_biTangents.reserve(vertices*3);
+	m_indices.reserve(m_indices.size() + indexCount);
+}
+
+// Same defaults as AddVertex, written in bulk
+void Geometry::AddVertices(const float* positions, const float* texCoords, unsigned int count){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
+	// No Reserve here: reserving the exact size on every call would turn
+	// off the vectors' geometric growth for callers adding small batches
+	m_vertexPositions.insert(m_vertexPositions.end(), positions, positions + (size_t)count*3);
+	if(texCoords != nullptr){
+		m_textureCoords.insert(m_textureCoords.end(), texCoords, texCoords + (size_t)count*2);
+	}else{
+		m_textureCoords.resize(m_textureCoords.size() + (size_t)count*2, 0.0f);
+	}
+	size_t first = m_normals.size();
+	m_normals.resize(first + (size_t)count*3);
+	m_tangents.resize(first + (size_t)count*3);
+	m_biTangents.resize(first + (size_t)count*3);
+	for(size_t i=first; i < m_normals.size(); i+=3){
+		m_normals[i+0] = 0.0f;    m_normals[i+1] = 0.0f;    m_normals[i+2] = 1.0f;
+		m_tangents[i+0] = 0.0f;   m_tangents[i+1] = 0.0f;   m_tangents[i+2] = 1.0f;
+		m_biTangents[i+0] = 0.0f; m_biTangents[i+1] = 0.0f; m_biTangents[i+2] = 1.0f;
+	}
+	for(unsigned int i=0; i < count; ++i){
+		m_localBounds.Expand(glm::vec3(positions[i*3+0], positions[i*3+1], positions[i*3+2]));
+	}
+	m_vertexCount += count;
+	m_normalsGiven = false;
+}
+
+unsigned int Geometry::BeginAddVertices(unsigned int count, float** positions, float** texCoords, float** normals){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
+	size_t first = m_vertexPositions.size()/3;
+	m_vertexPositions.resize((first + count)*3, 0.0f);
+	m_textureCoords.resize((first + count)*2, 0.0f);
+	m_normals.resize((first + count)*3);
+	m_tangents.resize((first + count)*3);
+	m_biTangents.resize((first + count)*3);
+	for(size_t i=first*3; i < m_normals.size(); i+=3){
+		m_normals[i+0] = 0.0f;    m_normals[i+1] = 0.0f;    m_normals[i+2] = 1.0f;
+		m_tangents[i+0] = 0.0f;   m_tangents[i+1] = 0.0f;   m_tangents[i+2] = 1.0f;
+		m_biTangents[i+0] = 0.0f; m_biTangents[i+1] = 0.0f; m_biTangents[i+2] = 1.0f;
+	}
+	*positions = m_vertexPositions.data() + first*3;
+	*texCoords = m_textureCoords.data() + first*2;
+	*normals = m_normals.data() + first*3;
+	m_vertexCount += count;
+	return (unsigned int)first;
+}
+
+void Geometry::FinishAddVertices(unsigned int first, unsigned int count, bool normalsGiven){
+	const float* positions = m_vertexPositions.data() + (size_t)first*3;
+	for(unsigned int i=0; i < count; ++i){
+		m_localBounds.Expand(glm::vec3(positions[i*3+0], positions[i*3+1], positions[i*3+2]));
+	}
+	// Only if every vertex has one
+	m_normalsGiven = normalsGiven && (first == 0 || m_normalsGiven);
+}
+
+unsigned int* Geometry::BeginAddTriangles(unsigned int count){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
+	count -= count % 3;
+	size_t first = m_indices.size();
+	m_indices.resize(first + count);
+	m_indexCount += count;
+	m_framesDirty = true;
+	return m_indices.data() + first;
+}
+
+void Geometry::AddTriangles(const unsigned int* indices, unsigned int count){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
+	count -= count % 3;
+	m_indices.insert(m_indices.end(), indices, indices + count);
+	m_indexCount += count;
+	m_framesDirty = true;
 }
 
 // Retrieves a pointer to our data.
@@ -60,104 +160,249 @@ unsigned int Geometry::GetBufferSizeInBytes(){
 // This makes it relatively easy to then fill in a buffer
 // with the corresponding vertices
 void Geometry::Gen(){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
 	assert((m_vertexPositions.size()/3) == (m_textureCoords.size()/2));
+	GenerateTangentFrames();
 
-	int coordsPos =0;
-	for(int i =0; i < m_vertexPositions.size()/3; ++i){
-	// First vertex
+	// Sized once, then every vertex is written exactly once
+	m_bufferData.resize((m_vertexPositions.size()/3)*FLOAT_VERTEX_COMPONENTS);
+	InterleaveAll(m_bufferData.data());
+}
+
+void Geometry::InterleaveAll(float* destination) const{
+	JobSystem::Instance().ParallelFor(0, m_vertexPositions.size()/3, INTERLEAVE_GRAIN_SIZE,
+	                                  [this, destination](size_t first, size_t last){
+		Interleave(destination + first*FLOAT_VERTEX_COMPONENTS, (unsigned int)first, (unsigned int)(last-first));
+	});
+}
+
+void Geometry::Interleave(float* destination, unsigned int first, unsigned int count) const{
+	const float* positions = m_vertexPositions.data() + (size_t)first*3;
+	const float* normals = m_normals.data() + (size_t)first*3;
+	const float* texCoords = m_textureCoords.data() + (size_t)first*2;
+	const float* tangents = m_tangents.data() + (size_t)first*3;
+	const float* biTangents = m_biTangents.data() + (size_t)first*3;
+	for(unsigned int i=0; i < count; ++i){
+		float* v = destination + (size_t)i*FLOAT_VERTEX_COMPONENTS;
 		// vertices
-		m_bufferData.push_back(m_vertexPositions[i*3+ 0]);
-		m_bufferData.push_back(m_vertexPositions[i*3+ 1]);
-		m_bufferData.push_back(m_vertexPositions[i*3+ 2]);
+		v[0] = positions[i*3+0];   v[1] = positions[i*3+1];   v[2] = positions[i*3+2];
 		// m_normals
-		m_bufferData.push_back(m_normals[i*3+0]);
-		m_bufferData.push_back(m_normals[i*3+1]);
-		m_bufferData.push_back(m_normals[i*3+2]);
-    	// texture information
-		m_bufferData.push_back(m_textureCoords[coordsPos*2+0]); 
-		m_bufferData.push_back(m_textureCoords[coordsPos*2+1]); 
-		++coordsPos;
+		v[3] = normals[i*3+0];     v[4] = normals[i*3+1];     v[5] = normals[i*3+2];
+		// texture information
+		v[6] = texCoords[i*2+0];   v[7] = texCoords[i*2+1];
 		// tangents
-		m_bufferData.push_back(m_tangents[i*3+0]);
-		m_bufferData.push_back(m_tangents[i*3+1]);
-		m_bufferData.push_back(m_tangents[i*3+2]);
+		v[8] = tangents[i*3+0];    v[9] = tangents[i*3+1];    v[10] = tangents[i*3+2];
 		// bi-tangents
-		m_bufferData.push_back(m_biTangents[i*3+0]);
-		m_bufferData.push_back(m_biTangents[i*3+1]);
-		m_bufferData.push_back(m_biTangents[i*3+2]);
+		v[11] = biTangents[i*3+0]; v[12] = biTangents[i*3+1]; v[13] = biTangents[i*3+2];
 	}
 }
 
-// The big trick here, is that when we make a triangle
-// We also need to update our m_normals, tangents, and bi-tangents.
+// The tangent frames are left to GenerateTangentFrames, since every
+// triangle around a vertex has a say in them.
 void Geometry::MakeTriangle(unsigned int vert0, unsigned int vert1, unsigned int vert2){
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
 	m_indices.push_back(vert0);	
 	m_indices.push_back(vert1);	
 	m_indices.push_back(vert2);	
+	m_indexCount += 3;
+	m_framesDirty = true;
+}
 
-	// Look up the actual vertex positions
-	glm::vec3 pos0(m_vertexPositions[vert0*3 +0], m_vertexPositions[vert0*3 + 1], m_vertexPositions[vert0*3 + 2]); 
-	glm::vec3 pos1(m_vertexPositions[vert1*3 +0], m_vertexPositions[vert1*3 + 1], m_vertexPositions[vert1*3 + 2]); 
-	glm::vec3 pos2(m_vertexPositions[vert2*3 +0], m_vertexPositions[vert2*3 + 1], m_vertexPositions[vert2*3 + 2]); 
-
-	// Look up the texture coordinates
-	glm::vec2 tex0(m_textureCoords[vert0*2 +0], m_textureCoords[vert0*2 + 1]); 
-	glm::vec2 tex1(m_textureCoords[vert1*2 +0], m_textureCoords[vert1*2 + 1]); 
-	glm::vec2 tex2(m_textureCoords[vert2*2 +0], m_textureCoords[vert2*2 + 1]); 
-
-	// Now create an edge
-	// With two edges
-	// This section is inspired by: https://learnopengl.com/Advanced-Lighting/Normal-Mapping
-	glm::vec3 edge0 = pos1 - pos0;
-	glm::vec3 edge1 = pos2 - pos0;
-	// Question to ask yourself is what is going on here?
-    // The difference of y's and x's? Hmm.
-	glm::vec2 deltaUV0 = tex1-tex0;
-	glm::vec2 deltaUV1 = tex2-tex0;
-
-	float f = 1.0f / (deltaUV0.x * deltaUV1.y - deltaUV1.x * deltaUV0.y);
-
-	glm::vec3 tangent;
-	glm::vec3 bitangent;
-
-	tangent.x = f * (deltaUV1.y * edge0.x - deltaUV0.y* edge1.x);
-	tangent.y = f * (deltaUV1.y * edge0.y - deltaUV0.y* edge1.y);
-	tangent.z = f * (deltaUV1.y * edge0.z - deltaUV0.y* edge1.z);
-	tangent = glm::normalize(tangent);
-
-	bitangent.x = f * (-deltaUV1.x * edge0.x + deltaUV0.x* edge1.x);
-	bitangent.y = f * (-deltaUV1.x * edge0.y + deltaUV0.x* edge1.y);
-	bitangent.z = f * (-deltaUV1.x * edge0.z + deltaUV0.x* edge1.z);
-	bitangent = glm::normalize(bitangent);
-	
-	// Compute a normal
-	// For now we sort of 'cheat' since this is a quad the 'z' axis points straight out
-    glm::vec3 normal1{m_normals[vert0*3+0] ,m_normals[vert0*3+1], m_normals[vert0*3+2]};
-    glm::vec3 normal2{m_normals[vert1*3+0] ,m_normals[vert1*3+1], m_normals[vert1*3+2]};
-    glm::vec3 normal3{m_normals[vert2*3+0] ,m_normals[vert2*3+1], m_normals[vert2*3+2]};
-
-
-	m_normals[vert0*3+0] = 0.0f;	m_normals[vert0*3+1] = 0.0f;	m_normals[vert0*3+2] = 1.0f;	
-	m_normals[vert1*3+0] = 0.0f;	m_normals[vert1*3+1] = 0.0f;	m_normals[vert1*3+2] = 1.0f;	
-	m_normals[vert2*3+0] = 0.0f;	m_normals[vert2*3+1] = 0.0f;	m_normals[vert2*3+2] = 1.0f;	
-		
-	// Compute a tangent
-	m_tangents[vert0*3+0] = tangent.x; m_tangents[vert0*3+1] = tangent.y; m_tangents[vert0*3+2] = tangent.z;	
-	m_tangents[vert1*3+0] = tangent.x; m_tangents[vert1*3+1] = tangent.y; m_tangents[vert1*3+2] = tangent.z;	
-	m_tangents[vert2*3+0] = tangent.x; m_tangents[vert2*3+1] = tangent.y; m_tangents[vert2*3+2] = tangent.z;	
-
-	// Compute a bi-tangent
-	m_biTangents[vert0*3+0] = bitangent.x; m_biTangents[vert0*3+1] = bitangent.y; m_biTangents[vert0*3+2] = bitangent.z;	
-	m_biTangents[vert1*3+0] = bitangent.x; m_biTangents[vert1*3+1] = bitangent.y; m_biTangents[vert1*3+2] = bitangent.z;	
-	m_biTangents[vert2*3+0] = bitangent.x; m_biTangents[vert2*3+1] = bitangent.y; m_biTangents[vert2*3+2] = bitangent.z;	
+// Any unit vector perpendicular to 'normal'
+static glm::vec3 AnyPerpendicular(const glm::vec3& normal){
+	glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f,0.0f,0.0f) : glm::vec3(0.0f,1.0f,0.0f);
+	return glm::normalize(glm::cross(axis, normal));
+}
+
+// Two passes, so no two tasks ever add to the same vertex:
+//  1. per triangle (in chunks), the face normal, tangent and bitangent,
+//     each weighted by the area of the face, so large faces count more
+//     than small ones and slivers (e.g. at the poles of a sphere, where
+//     the direction of the face is mostly rounding error) hardly at all.
+//  2. per vertex (in chunks), the sum over the corners that use it,
+//     found through a vertex -> corners table, then made orthonormal.
+void Geometry::GenerateTangentFrames(){
+	if(!m_framesDirty){
+		return;
+	}
+	m_framesDirty = false;
+	AllocationScope allocationScope(AllocationSubsystem::Geometry);
+	const size_t vertexCount = m_vertexPositions.size()/3;
+	const size_t cornerCount = m_indices.size() - m_indices.size()%3;
+	JobSystem& jobs = JobSystem::Instance();
+
+	// 1. Face contributions, one per triangle
+	const size_t triangleCount = cornerCount/3;
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<glm::vec3> faceTangents(triangleCount);
+	std::vector<glm::vec3> faceBitangents(triangleCount);
+	jobs.ParallelFor(0, triangleCount, TANGENT_TRIANGLE_GRAIN_SIZE, [&](size_t firstTriangle, size_t lastTriangle){
+		for(size_t triangle=firstTriangle; triangle < lastTriangle; ++triangle){
+			const unsigned int* corner = &m_indices[triangle*3];
+			glm::vec3 pos[3];
+			glm::vec2 tex[3];
+			bool valid = true;
+			for(int c=0; c < 3; ++c){
+				unsigned int v = corner[c];
+				if(v >= vertexCount){
+					valid = false;
+					break;
+				}
+				pos[c] = glm::vec3(m_vertexPositions[v*3+0], m_vertexPositions[v*3+1], m_vertexPositions[v*3+2]);
+				tex[c] = glm::vec2(m_textureCoords[v*2+0], m_textureCoords[v*2+1]);
+			}
+			glm::vec3 edge0 = pos[1] - pos[0];
+			glm::vec3 edge1 = pos[2] - pos[0];
+			// Twice the area long
+			glm::vec3 faceNormal = glm::cross(edge0, edge1);
+			float area = glm::length(faceNormal);
+			faceNormals[triangle] = glm::vec3(0.0f);
+			faceTangents[triangle] = glm::vec3(0.0f);
+			faceBitangents[triangle] = glm::vec3(0.0f);
+			if(!valid || area <= 0.0f){
+				// Degenerate, contributes nothing
+				continue;
+			}
+			faceNormals[triangle] = faceNormal;
+
+			// Solve edge = deltaU * tangent + deltaV * bitangent
+			// This section is inspired by: https://learnopengl.com/Advanced-Lighting/Normal-Mapping
+			glm::vec2 deltaUV0 = tex[1] - tex[0];
+			glm::vec2 deltaUV1 = tex[2] - tex[0];
+			float determinant = deltaUV0.x * deltaUV1.y - deltaUV1.x * deltaUV0.y;
+			if(std::fabs(determinant) > 1e-20f){
+				// Only the directions are kept, weighted like the normal.
+				// Faces without a usable mapping add none.
+				glm::vec3 tangent = (edge0 * deltaUV1.y - edge1 * deltaUV0.y) / determinant;
+				glm::vec3 bitangent = (edge1 * deltaUV0.x - edge0 * deltaUV1.x) / determinant;
+				float tangentLength = glm::length(tangent);
+				float bitangentLength = glm::length(bitangent);
+				if(tangentLength > 0.0f){
+					faceTangents[triangle] = tangent * (area / tangentLength);
+				}
+				if(bitangentLength > 0.0f){
+					faceBitangents[triangle] = bitangent * (area / bitangentLength);
+				}
+			}
+		}
+	});
+
+	// Which corners each vertex is used by, as one array grouped by
+	// vertex (a counting sort of the corners), so the sums below always
+	// add in the same order and the result does not depend on timing
+	std::vector<unsigned int> firstCorner(vertexCount+1, 0);
+	for(size_t i=0; i < cornerCount; ++i){
+		if(m_indices[i] < vertexCount){
+			++firstCorner[m_indices[i]+1];
+		}
+	}
+	for(size_t v=0; v < vertexCount; ++v){
+		firstCorner[v+1] += firstCorner[v];
+	}
+	std::vector<unsigned int> vertexCorners(firstCorner[vertexCount]);
+	{
+		std::vector<unsigned int> next(firstCorner.begin(), firstCorner.end()-1);
+		for(size_t i=0; i < cornerCount; ++i){
+			if(m_indices[i] < vertexCount){
+				vertexCorners[next[m_indices[i]]++] = (unsigned int)i;
+			}
+		}
+	}
+
+	// 2. Sum and orthonormalize, every vertex written by one task only
+	jobs.ParallelFor(0, vertexCount, TANGENT_VERTEX_GRAIN_SIZE, [&](size_t firstVertex, size_t lastVertex){
+		for(size_t v=firstVertex; v < lastVertex; ++v){
+			if(firstCorner[v] == firstCorner[v+1]){
+				// In no triangle, keeps the frame AddVertex gave it
+				continue;
+			}
+			glm::vec3 normal(0.0f);
+			glm::vec3 tangent(0.0f);
+			glm::vec3 bitangent(0.0f);
+			for(unsigned int i=firstCorner[v]; i < firstCorner[v+1]; ++i){
+				unsigned int triangle = vertexCorners[i]/3;
+				normal += faceNormals[triangle];
+				tangent += faceTangents[triangle];
+				bitangent += faceBitangents[triangle];
+			}
+			if(m_normalsGiven){
+				// The faces only fill in for normals that are missing
+				glm::vec3 given(m_normals[v*3+0], m_normals[v*3+1], m_normals[v*3+2]);
+				if(glm::dot(given, given) > 0.0f){
+					normal = given;
+				}
+			}
+			float normalLength = glm::length(normal);
+			normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f,0.0f,1.0f);
+
+			// Gram-Schmidt: the part of the tangent along the normal goes
+			tangent -= normal * glm::dot(normal, tangent);
+			float tangentLength = glm::length(tangent);
+			tangent = tangentLength > 1e-6f ? tangent / tangentLength : AnyPerpendicular(normal);
+
+			// The bitangent only keeps its handedness: mirrored texture
+			// coordinates flip it relative to cross(normal, tangent)
+			float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+			bitangent = glm::cross(normal, tangent) * handedness;
+
+			m_normals[v*3+0] = normal.x;       m_normals[v*3+1] = normal.y;       m_normals[v*3+2] = normal.z;
+			m_tangents[v*3+0] = tangent.x;     m_tangents[v*3+1] = tangent.y;     m_tangents[v*3+2] = tangent.z;
+			m_biTangents[v*3+0] = bitangent.x; m_biTangents[v*3+1] = bitangent.y; m_biTangents[v*3+2] = bitangent.z;
+		}
+	});
 }
 
 // Retrieves the number of indices that we have.
-unsigned int Geometry::GetIndicesSize(){
-	return m_indices.size();
+unsigned int Geometry::GetIndicesSize() const{
+	return m_indexCount;
 }
 
 // Retrieves a pointer to the indices that we have
 unsigned int* Geometry::GetIndicesDataPtr(){
 	return m_indices.data();
 }
+
+const unsigned int* Geometry::GetIndicesDataPtr() const{
+	return m_indices.data();
+}
+
+// Retrieves the object space bounds of our vertices
+const AABB& Geometry::GetLocalBounds() const{
+	return m_localBounds;
+}
+
+// Retrieves the number of vertices
+unsigned int Geometry::GetVertexCount() const{
+	return m_vertexCount;
+}
+
+// Retrieves just the texture coordinates
+const float* Geometry::GetTextureCoordsPtr() const{
+	return m_textureCoords.data();
+}
+
+// Frees what only the upload needed
+void Geometry::ReleaseUploadData(){
+	// Swapping with an empty vector frees the memory, clear() would not
+	std::vector<float>().swap(m_bufferData);
+	std::vector<float>().swap(m_textureCoords);
+	std::vector<float>().swap(m_normals);
+	std::vector<float>().swap(m_tangents);
+	std::vector<float>().swap(m_biTangents);
+}
+
+// Frees everything, for meshes nothing reads on the CPU
+void Geometry::ReleaseCPUData(){
+	ReleaseUploadData();
+	std::vector<float>().swap(m_vertexPositions);
+	std::vector<unsigned int>().swap(m_indices);
+}
+
+bool Geometry::HasCPUData() const{
+	return !m_vertexPositions.empty();
+}
+
+// Retrieves just the positions, e.g. for CPU side occlusion culling
+const float* Geometry::GetVertexPositionsPtr() const{
+	return m_vertexPositions.data();
+}
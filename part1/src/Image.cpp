@@ -1,9 +1,13 @@
 #include "Image.hpp"
+#include "AllocationTracker.hpp"
 #include <fstream>
 #include <iostream>
 #include <string.h>
 #include <stdio.h>
 #include <memory>
+#include <vector>
+#include <iterator>
+#include <algorithm>
 
 // Constructor
 Image::Image(std::string filepath) : m_filepath(filepath){
@@ -20,80 +24,127 @@ Image::~Image (){
     }
 }
 
+// Skips whitespace and '#' comments, then reads an unsigned number.
+// Returns false at the end of the data.
+static bool NextNumber(const char*& cursor, const char* end, unsigned int& value){
+    while(cursor < end){
+        if(*cursor == '#'){
+            while(cursor < end && *cursor != '\n'){
+                ++cursor;
+            }
+        }else if(*cursor < '0' || *cursor > '9'){
+            ++cursor;
+        }else{
+            break;
+        }
+    }
+    if(cursor == end){
+        return false;
+    }
+    value = 0;
+    while(cursor < end && *cursor >= '0' && *cursor <= '9'){
+        value = value*10 + (unsigned int)(*cursor - '0');
+        ++cursor;
+    }
+    return true;
+}
+
 // Little function for loading the pixel data
 // from a PPM image.
-// TODO: Expects a very specific version of PPM!
+// Reads the whole file in one go and parses it in memory, which is
+// much faster than a getline and atoi per value. Handles ASCII (P3)
+// and binary (P6) files with 8 bit channels.
 //
 // flip - Will flip the pixels upside down in the data
 //        If you use this be consistent.
 void Image::LoadPPM(bool flip){
-
+  AllocationScope allocationScope(AllocationSubsystem::Image);
   // Open an input file stream for reading a file
-  std::ifstream ppmFile(m_filepath.c_str());
-  // If our file successfully opens, begin to process it.
-  if (ppmFile.is_open()){
-      // line will store one line of input
-      std::string line;
-      // Our loop invariant is to continue reading input until
-      // we reach the end of the file and it reads in a NULL character
-      std::cout << "Reading in ppm file: " << m_filepath << std::endl;
-      unsigned int iteration = 0;
-      unsigned int pos = 0;
-      while ( getline (ppmFile,line) ){
-          // Ignore comments in the file
-         if (line[0]=='#'){
-            continue;
-         }
-         if(line[0]=='P'){
-            magicNumber = line;
-         }else if(iteration==1){
-            // Returns first token 
-            char *token = strtok((char*)line.c_str(), " "); 
-            m_width = atoi(token);
-            token = strtok(NULL, " ");
-            m_height = atoi(token);
-            std::cout << "PPM width,height=" << m_width << "," << m_height << "\n";	
-            if(m_width > 0 && m_height > 0){
-                m_pixelData = new uint8_t[m_width*m_height*3];
-                if(m_pixelData==NULL){
-                    std::cout << "Unable to allocate memory for ppm" << std::endl;
-                    exit(1);
-                 }
-             }else{
-                std::cout << "PPM not parsed correctly, width and/or height dimensions are 0" << std::endl;
-                exit(1);
-             }
-         }else if(iteration==2){
-            // max color range is stored here
-            // TODO: Can be stored optionally
-         }else{
-            m_pixelData[pos] = (uint8_t)atoi(line.c_str());
-            ++pos;
-         }
-          iteration++;
-    }             
-    ppmFile.close();
-  }
-  else{
+  std::ifstream ppmFile(m_filepath.c_str(), std::ios::binary);
+  if (!ppmFile.is_open()){
       std::cout << "Unable to open ppm file:" << m_filepath << std::endl;
-  } 
+      return;
+  }
+  std::cout << "Reading in ppm file: " << m_filepath << std::endl;
+  std::vector<char> contents((std::istreambuf_iterator<char>(ppmFile)), std::istreambuf_iterator<char>());
+  ppmFile.close();
 
-    // Flip all of the pixels
+  const char* cursor = contents.data();
+  const char* end = cursor + contents.size();
+  if(contents.size() < 2 || cursor[0] != 'P' || (cursor[1] != '3' && cursor[1] != '6')){
+      std::cout << "PPM not parsed correctly, expected a P3 or P6 file" << std::endl;
+      return;
+  }
+  magicNumber = std::string(cursor, 2);
+  cursor += 2;
+
+  unsigned int width = 0, height = 0, maxValue = 0;
+  if(!NextNumber(cursor, end, width) || !NextNumber(cursor, end, height) || !NextNumber(cursor, end, maxValue) ||
+     width == 0 || height == 0){
+      std::cout << "PPM not parsed correctly, width and/or height dimensions are 0" << std::endl;
+      exit(1);
+  }
+  m_width = (int)width;
+  m_height = (int)height;
+  std::cout << "PPM width,height=" << m_width << "," << m_height << "\n";
+  const unsigned int count = width*height*3;
+  m_pixelData = new uint8_t[count];
+
+  if(magicNumber == "P6"){
+      // One whitespace character, then raw bytes
+      ++cursor;
+      unsigned int available = (unsigned int)std::max<long>(0, end - cursor);
+      memcpy(m_pixelData, cursor, std::min(count, available));
+      if(available < count){
+          memset(m_pixelData + available, 0, count - available);
+      }
+  }else{
+      unsigned int value = 0;
+      for(unsigned int pos=0; pos < count; ++pos){
+          m_pixelData[pos] = NextNumber(cursor, end, value) ? (uint8_t)value : 0;
+      }
+  }
+
+    // Flip all of the pixels.
+    // Reversing the order of the pixels in place, as this always did.
     if(flip){
-        // Copy all of the data to a temporary stack-allocated array
-        uint8_t* copyData = new uint8_t[m_width*m_height*3];
-        for(int i =0; i < m_width*m_height*3; ++i){
-            copyData[i]=m_pixelData[i];
+        uint8_t* front = m_pixelData;
+        uint8_t* back = m_pixelData + count - 3;
+        while(front < back){
+            for(int c=0; c < 3; ++c){
+                std::swap(front[c], back[c]);
+            }
+            front += 3;
+            back -= 3;
         }
-        //memcpy(copyData,m_pixelData,(m_width*m_height*3)*sizeof(uint8_t));
-        unsigned int pos = (m_width*m_height*3)-1;
-        for(int i =0; i < m_width*m_height*3; i+=3){
-            m_pixelData[pos]=copyData[i+2];
-            m_pixelData[pos-1]=copyData[i+1];
-            m_pixelData[pos-2]=copyData[i];
-            pos-=3;
+    }
+}
+
+// Each output pixel averages a 2x2 block. An odd last row or column
+// is averaged with itself, and sizes round down, as OpenGL's do.
+void Image::Downsample(unsigned int levels){
+    AllocationScope allocationScope(AllocationSubsystem::Image);
+    for(unsigned int level=0; level < levels && m_pixelData != nullptr && (m_width > 1 || m_height > 1); ++level){
+        int width = std::max(1, m_width/2);
+        int height = std::max(1, m_height/2);
+        uint8_t* pixels = new uint8_t[width*height*3];
+        for(int y=0; y < height; ++y){
+            int y0 = std::min(2*y, m_height-1);
+            int y1 = std::min(2*y+1, m_height-1);
+            for(int x=0; x < width; ++x){
+                int x0 = std::min(2*x, m_width-1);
+                int x1 = std::min(2*x+1, m_width-1);
+                for(int c=0; c < 3; ++c){
+                    unsigned int sum = m_pixelData[(y0*m_width+x0)*3+c] + m_pixelData[(y0*m_width+x1)*3+c] +
+                                       m_pixelData[(y1*m_width+x0)*3+c] + m_pixelData[(y1*m_width+x1)*3+c];
+                    pixels[(y*width+x)*3+c] = (uint8_t)((sum+2)/4);
+                }
+            }
         }
-        delete[] copyData;
+        delete[] m_pixelData;
+        m_pixelData = pixels;
+        m_width = width;
+        m_height = height;
     }
 }
 
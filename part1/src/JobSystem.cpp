@@ -0,0 +1,389 @@
+#include "JobSystem.hpp"
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+
+struct Job{
+    std::function<void()> work;
+    // Subsystem of the thread that scheduled the job, which
+    // the job's allocations are charged to
+    AllocationSubsystem subsystem{AllocationSubsystem::Other};
+    // Pinned to the GL thread
+    bool glThread{false};
+    // Dependencies that have not finished, plus one while the job
+    // is still being set up so it cannot be queued too early
+    std::atomic<int> pendingDependencies{1};
+    // Guards 'finished' and 'continuations' so a dependency that is
+    // added while this job completes is never lost
+    std::mutex mutex;
+    bool finished{false};
+    // Mirrors 'finished' so waiting threads can poll without the lock
+    std::atomic<bool> done{false};
+    // Jobs that depend on this one
+    std::vector<JobHandle> continuations;
+};
+
+// Which worker the calling thread is, -1 for threads outside the pool
+static thread_local int s_workerIndex = -1;
+
+// Constructor
+JobSystem::JobSystem(){
+
+}
+
+// Destructor
+JobSystem::~JobSystem(){
+    Shutdown();
+}
+
+JobSystem& JobSystem::Instance(){
+    static JobSystem* instance = new JobSystem();
+    return *instance;
+}
+
+void JobSystem::Initialize(unsigned int workerCount){
+    if(!m_workers.empty()){
+        return;
+    }
+    if(workerCount == 0){
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = std::max(1u, cores > 1 ? cores-1 : 1u);
+    }
+    m_quit = false;
+    for(unsigned int i=0; i < workerCount; ++i){
+        m_queues.emplace_back(new WorkQueue());
+    }
+    for(unsigned int i=0; i < workerCount; ++i){
+        m_workers.emplace_back(&JobSystem::WorkerMain, this, i);
+    }
+}
+
+void JobSystem::Shutdown(){
+    if(m_workers.empty()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_quit = true;
+    }
+    m_wakeUp.notify_all();
+    for(unsigned int i=0; i < m_workers.size(); ++i){
+        m_workers[i].join();
+    }
+    m_workers.clear();
+    m_queues.clear();
+}
+
+JobHandle JobSystem::Schedule(std::function<void()> work, const std::vector<JobHandle>& dependencies){
+    return Create(std::move(work), false, dependencies);
+}
+
+JobHandle JobSystem::ScheduleOnGLThread(std::function<void()> work, const std::vector<JobHandle>& dependencies){
+    return Create(std::move(work), true, dependencies);
+}
+
+JobHandle JobSystem::Create(std::function<void()> work, bool glThread, const std::vector<JobHandle>& dependencies){
+    JobHandle job = std::make_shared<Job>();
+    job->work = std::move(work);
+    job->subsystem = AllocationTracker::GetSubsystem();
+    job->glThread = glThread;
+
+    for(unsigned int i=0; i < dependencies.size(); ++i){
+        Job* dependency = dependencies[i].get();
+        if(dependency == nullptr){
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if(!dependency->finished){
+            job->pendingDependencies.fetch_add(1);
+            dependency->continuations.push_back(job);
+        }
+    }
+    // Drop the set up reference, queue it if nothing is left to wait on
+    if(job->pendingDependencies.fetch_sub(1) == 1){
+        Enqueue(job);
+    }
+    return job;
+}
+
+void JobSystem::Enqueue(const JobHandle& job){
+    if(job->glThread){
+        std::lock_guard<std::mutex> lock(m_glQueue.mutex);
+        m_glQueue.jobs.push_back(job);
+        return;
+    }
+
+    // Workers keep their own jobs, everyone else goes through the injection queue
+    WorkQueue* queue = &m_injectionQueue;
+    if(s_workerIndex >= 0 && (size_t)s_workerIndex < m_queues.size()){
+        queue = m_queues[s_workerIndex].get();
+    }
+    // Count first, so the count is never lower than what is queued
+    m_queuedJobs.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(job);
+    }
+    {
+        // Taking the lock makes sure a worker that is about to
+        // sleep sees the new count before it waits
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeUp.notify_one();
+}
+
+void JobSystem::Execute(const JobHandle& job){
+    {
+        AllocationScope allocationScope(job->subsystem);
+        job->work();
+    }
+    // Let go of whatever the work captured
+    job->work = nullptr;
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        continuations.swap(job->continuations);
+    }
+    job->done.store(true, std::memory_order_release);
+
+    for(unsigned int i=0; i < continuations.size(); ++i){
+        if(continuations[i]->pendingDependencies.fetch_sub(1) == 1){
+            Enqueue(continuations[i]);
+        }
+    }
+}
+
+JobHandle JobSystem::TryGetJob(){
+    JobHandle job;
+
+    // GL jobs can only run on the GL thread
+    if(IsGLThread()){
+        std::lock_guard<std::mutex> lock(m_glQueue.mutex);
+        if(!m_glQueue.jobs.empty()){
+            job = m_glQueue.jobs.front();
+            m_glQueue.jobs.pop_front();
+            return job;
+        }
+    }
+
+    // Our own newest job first
+    int self = s_workerIndex;
+    if(self >= 0 && (size_t)self < m_queues.size()){
+        WorkQueue& queue = *m_queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(!queue.jobs.empty()){
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+    }
+    // Then work handed in from outside the pool
+    if(!job){
+        std::lock_guard<std::mutex> lock(m_injectionQueue.mutex);
+        if(!m_injectionQueue.jobs.empty()){
+            job = m_injectionQueue.jobs.front();
+            m_injectionQueue.jobs.pop_front();
+        }
+    }
+    // Then the oldest job of another worker
+    if(!job){
+        size_t count = m_queues.size();
+        size_t start = self >= 0 ? (size_t)self+1 : 0;
+        for(size_t i=0; i < count && !job; ++i){
+            size_t victim = (start+i) % count;
+            if((int)victim == self){
+                continue;
+            }
+            WorkQueue& queue = *m_queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(!queue.jobs.empty()){
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    if(job){
+        m_queuedJobs.fetch_sub(1);
+    }
+    return job;
+}
+
+void JobSystem::WorkerMain(unsigned int index){
+    s_workerIndex = (int)index;
+    while(true){
+        if(RunLoopChunk()){
+            continue;
+        }
+        JobHandle job = TryGetJob();
+        if(job){
+            Execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        if(m_quit && m_queuedJobs.load() == 0){
+            break;
+        }
+        m_wakeUp.wait(lock, [this](){ return m_quit || m_queuedJobs.load() > 0 || m_openLoops.load() > 0; });
+    }
+    s_workerIndex = -1;
+}
+
+void JobSystem::Wait(const JobHandle& job){
+    while(!IsFinished(job)){
+        // Make ourselves useful instead of blocking
+        if(RunLoopChunk()){
+            continue;
+        }
+        JobHandle other = TryGetJob();
+        if(other){
+            Execute(other);
+        }else{
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool JobSystem::IsFinished(const JobHandle& job) const{
+    return !job || job->done.load(std::memory_order_acquire);
+}
+
+void JobSystem::RunParallelFor(ParallelForLoop& loop, size_t begin, size_t end, size_t grainSize){
+    if(end <= begin){
+        return;
+    }
+    grainSize = std::max<size_t>(1, grainSize);
+    size_t chunks = (end - begin + grainSize - 1) / grainSize;
+    if(chunks == 1 || m_workers.empty()){
+        loop.run(loop.context, begin, end);
+        return;
+    }
+
+    loop.begin = begin;
+    loop.end = end;
+    loop.grainSize = grainSize;
+    loop.chunkCount = chunks;
+    loop.nextChunk = 0;
+    loop.unfinished.store(chunks, std::memory_order_relaxed);
+    loop.subsystem = AllocationTracker::GetSubsystem();
+    {
+        // Newest first, like a worker's own jobs, so nested loops
+        // finish before the loops waiting on them
+        std::lock_guard<std::mutex> lock(m_loopMutex);
+        loop.next = m_loops;
+        m_loops = &loop;
+        m_openLoops.fetch_add(1);
+    }
+    {
+        // Same handshake as Enqueue
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeUp.notify_all();
+
+    // Take chunks like everyone else until none are left
+    while(true){
+        size_t chunk;
+        {
+            std::lock_guard<std::mutex> lock(m_loopMutex);
+            if(!ClaimChunk(loop, chunk)){
+                break;
+            }
+        }
+        RunChunk(loop, chunk);
+    }
+    // Then help out until the chunks others took are done
+    while(loop.unfinished.load(std::memory_order_acquire) != 0){
+        if(RunLoopChunk()){
+            continue;
+        }
+        JobHandle other = TryGetJob();
+        if(other){
+            Execute(other);
+        }else{
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool JobSystem::RunLoopChunk(){
+    if(m_openLoops.load(std::memory_order_relaxed) == 0){
+        return false;
+    }
+    ParallelForLoop* loop;
+    size_t chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_loopMutex);
+        loop = m_loops;
+        if(loop == nullptr || !ClaimChunk(*loop, chunk)){
+            return false;
+        }
+    }
+    // Our unfinished chunk keeps the loop alive until RunChunk is done
+    RunChunk(*loop, chunk);
+    return true;
+}
+
+bool JobSystem::ClaimChunk(ParallelForLoop& loop, size_t& chunk){
+    if(loop.nextChunk >= loop.chunkCount){
+        return false;
+    }
+    chunk = loop.nextChunk++;
+    if(loop.nextChunk == loop.chunkCount){
+        // Nothing left to hand out, nobody needs to find it any more
+        ParallelForLoop** link = &m_loops;
+        while(*link != &loop){
+            link = &(*link)->next;
+        }
+        *link = loop.next;
+        loop.next = nullptr;
+        m_openLoops.fetch_sub(1);
+    }
+    return true;
+}
+
+void JobSystem::RunChunk(ParallelForLoop& loop, size_t chunk){
+    size_t chunkBegin = loop.begin + chunk*loop.grainSize;
+    size_t chunkEnd = std::min(loop.end, chunkBegin + loop.grainSize);
+    {
+        AllocationScope allocationScope(loop.subsystem);
+        loop.run(loop.context, chunkBegin, chunkEnd);
+    }
+    // The last time we touch the loop, its owner may return right after
+    loop.unfinished.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::SetGLThread(){
+    m_glThread.store(std::this_thread::get_id());
+}
+
+bool JobSystem::IsGLThread() const{
+    return m_glThread.load() == std::this_thread::get_id();
+}
+
+void JobSystem::RunGLJobs(){
+    if(!IsGLThread()){
+        return;
+    }
+    while(true){
+        JobHandle job;
+        {
+            std::lock_guard<std::mutex> lock(m_glQueue.mutex);
+            if(m_glQueue.jobs.empty()){
+                break;
+            }
+            job = m_glQueue.jobs.front();
+            m_glQueue.jobs.pop_front();
+        }
+        Execute(job);
+    }
+}
+
+unsigned int JobSystem::GetWorkerCount() const{
+    return (unsigned int)m_workers.size();
+}
+
+unsigned int JobSystem::GetStealCount() const{
+    return m_steals.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,608 @@
+#include "ObjLoader.hpp"
+#include "Geometry.hpp"
+#include "JobSystem.hpp"
+#include "AllocationTracker.hpp"
+
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#if defined(LINUX) || defined(MAC)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Bytes of the file each parsing task gets (chunks end at a line break)
+static const size_t OBJ_CHUNK_SIZE = 4*1024*1024;
+// Corners each deduplicating task gets
+static const size_t OBJ_CORNER_BLOCK_SIZE = 65536;
+// A corner without a texture coordinate or normal
+static const uint32_t OBJ_NONE = 0xFFFFFFFFu;
+
+// The contents of a file, memory mapped where we can
+class FileView{
+public:
+    // Constructor
+    FileView(){}
+    // Destructor
+    ~FileView(){ Close(); }
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    bool Open(const std::string& filepath){
+#if defined(LINUX) || defined(MAC)
+        int file = open(filepath.c_str(), O_RDONLY);
+        if(file < 0){
+            return false;
+        }
+        struct stat status;
+        if(fstat(file, &status) != 0){
+            close(file);
+            return false;
+        }
+        m_size = (size_t)status.st_size;
+        if(m_size != 0){
+            void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if(mapping == MAP_FAILED){
+                close(file);
+                return false;
+            }
+            // Every part is read once, by whichever task parses it
+            madvise(mapping, m_size, MADV_WILLNEED);
+            m_mapping = mapping;
+            m_data = static_cast<const char*>(mapping);
+        }
+        // The mapping keeps the file open
+        close(file);
+        return true;
+#else
+        FILE* file = std::fopen(filepath.c_str(), "rb");
+        if(file == nullptr){
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if(size < 0){
+            std::fclose(file);
+            return false;
+        }
+        m_buffer.resize((size_t)size);
+        m_size = std::fread(m_buffer.data(), 1, m_buffer.size(), file);
+        std::fclose(file);
+        m_data = m_buffer.data();
+        return m_size == m_buffer.size();
+#endif
+    }
+
+    const char* GetData() const{ return m_data; }
+    size_t GetSize() const{ return m_size; }
+
+private:
+    void Close(){
+#if defined(LINUX) || defined(MAC)
+        if(m_mapping != nullptr){
+            munmap(m_mapping, m_size);
+            m_mapping = nullptr;
+        }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* m_data{nullptr};
+    size_t m_size{0};
+#if defined(LINUX) || defined(MAC)
+    void* m_mapping{nullptr};
+#else
+    std::vector<char> m_buffer;
+#endif
+};
+
+// One corner of a face as written in the file. Positive indices count
+// from 1 at the start of the file, 0 is 'not given'. Negative ones count
+// back from the line they are on; the parser turns those into indices
+// from the start of its chunk and sets their bit in 'relative'.
+struct ObjCorner{
+    int32_t position{0};
+    int32_t texCoord{0};
+    int32_t normal{0};
+    uint8_t relative{0};
+};
+
+enum ObjElement{
+    OBJ_POSITION = 0,
+    OBJ_TEXCOORD = 1,
+    OBJ_NORMAL = 2,
+    OBJ_ELEMENT_COUNT = 3
+};
+
+// What one task parsed
+struct ObjChunk{
+    // Floats per element: 3, 2 and 3
+    std::vector<float> elements[OBJ_ELEMENT_COUNT];
+    // 3 per triangle
+    std::vector<ObjCorner> corners;
+    // Where parsing stopped, if it failed
+    const char* error{nullptr};
+};
+
+// A corner with every index from the start of the file (0 based)
+struct ResolvedCorner{
+    uint32_t element[OBJ_ELEMENT_COUNT];
+};
+
+static const unsigned int OBJ_ELEMENT_SIZE[OBJ_ELEMENT_COUNT] = { 3, 2, 3 };
+
+static inline bool IsSpace(char c){
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit(char c){
+    return c >= '0' && c <= '9';
+}
+
+// Exactly representable powers of ten
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses [sign] digits [. digits] [e [sign] digits], which is every
+// number OBJ exporters write, much faster than strtof (no locale, no
+// hex, no null terminator needed). Returns where the number ended, or
+// nullptr if there was none.
+static const char* ParseFloat(const char* p, const char* end, float& value){
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')){
+        negative = (*p == '-');
+        ++p;
+    }
+    // Up to 19 significant digits fit in 64 bits, the rest can only
+    // move the exponent
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    for(; p < end && IsDigit(*p); ++p){
+        anyDigits = true;
+        if(significant < 19){
+            mantissa = mantissa*10 + (uint64_t)(*p - '0');
+            significant += (mantissa != 0);
+        }else{
+            ++exponent;
+        }
+    }
+    if(p < end && *p == '.'){
+        for(++p; p < end && IsDigit(*p); ++p){
+            anyDigits = true;
+            if(significant < 19){
+                mantissa = mantissa*10 + (uint64_t)(*p - '0');
+                significant += (mantissa != 0);
+                --exponent;
+            }
+        }
+    }
+    if(!anyDigits){
+        return nullptr;
+    }
+    if(p < end && (*p == 'e' || *p == 'E')){
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if(e < end && (*e == '-' || *e == '+')){
+            negativeExponent = (*e == '-');
+            ++e;
+        }
+        if(e < end && IsDigit(*e)){
+            int written = 0;
+            for(; e < end && IsDigit(*e); ++e){
+                if(written < 10000){
+                    written = written*10 + (*e - '0');
+                }
+            }
+            exponent += negativeExponent ? -written : written;
+            p = e;
+        }
+    }
+    double result = (double)mantissa;
+    // Out of float range long before running out of double range
+    while(exponent > 22 && result != 0.0 && result < 1e300){
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while(exponent < -22 && result != 0.0 && result > 1e-300){
+        result /= 1e22;
+        exponent += 22;
+    }
+    if(exponent > 22){
+        result = (result == 0.0) ? 0.0 : 1e300;
+    }else if(exponent < -22){
+        result = 0.0;
+    }else if(exponent > 0){
+        result *= POWERS_OF_TEN[exponent];
+    }else if(exponent < 0){
+        result /= POWERS_OF_TEN[-exponent];
+    }
+    value = (float)(negative ? -result : result);
+    return p;
+}
+
+// [sign] digits, returns where it ended or nullptr
+static const char* ParseInt(const char* p, const char* end, int32_t& value){
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')){
+        negative = (*p == '-');
+        ++p;
+    }
+    if(p >= end || !IsDigit(*p)){
+        return nullptr;
+    }
+    int64_t result = 0;
+    for(; p < end && IsDigit(*p); ++p){
+        if(result <= INT32_MAX){
+            result = result*10 + (*p - '0');
+        }
+    }
+    if(result > INT32_MAX){
+        return nullptr;
+    }
+    value = (int32_t)(negative ? -result : result);
+    return p;
+}
+
+static const char* SkipSpaces(const char* p, const char* end){
+    while(p < end && IsSpace(*p)){
+        ++p;
+    }
+    return p;
+}
+
+// Reads up to 'count' floats into 'values', missing ones are 0
+static const char* ParseFloats(const char* p, const char* end, float* values, unsigned int count, unsigned int required){
+    for(unsigned int i=0; i < count; ++i){
+        values[i] = 0.0f;
+    }
+    for(unsigned int i=0; i < count; ++i){
+        p = SkipSpaces(p, end);
+        const char* next = ParseFloat(p, end, values[i]);
+        if(next == nullptr){
+            return i >= required ? p : nullptr;
+        }
+        p = next;
+    }
+    return p;
+}
+
+// Turns one index of a corner into what ObjCorner stores. 'parsed' is
+// how many of the element this chunk read before the line.
+static bool StoreIndex(int32_t index, size_t parsed, int32_t& stored, uint8_t& relative, ObjElement element){
+    if(index == 0){
+        return false;
+    }
+    if(index > 0){
+        stored = index;
+        return true;
+    }
+    // May point before the chunk, which is fine until resolving
+    stored = (int32_t)((int64_t)parsed + index);
+    relative |= (uint8_t)(1u << element);
+    return true;
+}
+
+// Parses [first, last), which starts at the beginning of a line
+static void ParseChunk(const char* first, const char* last, ObjChunk& chunk){
+    std::vector<ObjCorner> polygon;
+    const char* p = first;
+    while(p < last){
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', (size_t)(last - p)));
+        if(lineEnd == nullptr){
+            lineEnd = last;
+        }
+        p = SkipSpaces(p, lineEnd);
+        if(lineEnd - p >= 2 && p[0] == 'v'){
+            ObjElement element = OBJ_ELEMENT_COUNT;
+            const char* values = nullptr;
+            if(IsSpace(p[1])){
+                element = OBJ_POSITION;
+                values = p + 1;
+            }else if(lineEnd - p >= 3 && p[1] == 't' && IsSpace(p[2])){
+                element = OBJ_TEXCOORD;
+                values = p + 2;
+            }else if(lineEnd - p >= 3 && p[1] == 'n' && IsSpace(p[2])){
+                element = OBJ_NORMAL;
+                values = p + 2;
+            }
+            if(element != OBJ_ELEMENT_COUNT){
+                // Anything after (w, vertex colors) is ignored
+                float parsed[3];
+                unsigned int size = OBJ_ELEMENT_SIZE[element];
+                if(ParseFloats(values, lineEnd, parsed, size, element == OBJ_TEXCOORD ? 1 : size) == nullptr){
+                    chunk.error = p;
+                    return;
+                }
+                chunk.elements[element].insert(chunk.elements[element].end(), parsed, parsed + size);
+            }
+        }else if(lineEnd - p >= 2 && p[0] == 'f' && IsSpace(p[1])){
+            // v, v/vt, v//vn or v/vt/vn per corner
+            polygon.clear();
+            const char* q = SkipSpaces(p + 1, lineEnd);
+            while(q < lineEnd){
+                ObjCorner corner;
+                int32_t index = 0;
+                q = ParseInt(q, lineEnd, index);
+                if(q == nullptr || !StoreIndex(index, chunk.elements[OBJ_POSITION].size()/3, corner.position, corner.relative, OBJ_POSITION)){
+                    chunk.error = p;
+                    return;
+                }
+                if(q < lineEnd && *q == '/'){
+                    ++q;
+                    if(q < lineEnd && *q != '/'){
+                        q = ParseInt(q, lineEnd, index);
+                        if(q == nullptr || !StoreIndex(index, chunk.elements[OBJ_TEXCOORD].size()/2, corner.texCoord, corner.relative, OBJ_TEXCOORD)){
+                            chunk.error = p;
+                            return;
+                        }
+                    }
+                    if(q < lineEnd && *q == '/'){
+                        q = ParseInt(q + 1, lineEnd, index);
+                        if(q == nullptr || !StoreIndex(index, chunk.elements[OBJ_NORMAL].size()/3, corner.normal, corner.relative, OBJ_NORMAL)){
+                            chunk.error = p;
+                            return;
+                        }
+                    }
+                }
+                polygon.push_back(corner);
+                q = SkipSpaces(q, lineEnd);
+            }
+            // A fan around the first corner
+            for(size_t i=2; i < polygon.size(); ++i){
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[i-1]);
+                chunk.corners.push_back(polygon[i]);
+            }
+        }
+        // Anything else (comments, groups, materials) is skipped
+        p = lineEnd + 1;
+    }
+}
+
+static uint32_t HashCorner(const ResolvedCorner& corner){
+    uint64_t hash = corner.element[OBJ_POSITION] * 0x9E3779B97F4A7C15ull;
+    hash ^= corner.element[OBJ_TEXCOORD] * 0xC2B2AE3D27D4EB4Full;
+    hash ^= corner.element[OBJ_NORMAL] * 0x165667B19E3779F9ull;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 32;
+    return (uint32_t)hash;
+}
+
+static bool SameCorner(const ResolvedCorner& a, const ResolvedCorner& b){
+    return a.element[0] == b.element[0] && a.element[1] == b.element[1] && a.element[2] == b.element[2];
+}
+
+bool LoadOBJ(const std::string& filepath, Geometry& geometry){
+    AllocationScope allocationScope(AllocationSubsystem::Geometry);
+    JobSystem& jobs = JobSystem::Instance();
+    FileView file;
+    if(!file.Open(filepath)){
+        SDL_Log("LoadOBJ - unable to open %s", filepath.c_str());
+        return false;
+    }
+    const char* data = file.GetData();
+    const size_t size = file.GetSize();
+
+    // 1. Chunks that start at the beginning of a line
+    std::vector<const char*> bounds;
+    bounds.push_back(data);
+    for(size_t offset=OBJ_CHUNK_SIZE; offset < size; offset+=OBJ_CHUNK_SIZE){
+        const char* start = bounds.back() > data + offset ? bounds.back() : data + offset;
+        const char* lineEnd = static_cast<const char*>(std::memchr(start, '\n', (size_t)(data + size - start)));
+        if(lineEnd == nullptr){
+            break;
+        }
+        if(lineEnd + 1 > bounds.back()){
+            bounds.push_back(lineEnd + 1);
+        }
+    }
+    bounds.push_back(data + size);
+    const size_t chunkCount = bounds.size() - 1;
+
+    // 2. Parse them
+    std::vector<ObjChunk> chunks(chunkCount);
+    jobs.ParallelFor(0, chunkCount, 1, [&](size_t first, size_t last){
+        AllocationScope allocationScope(AllocationSubsystem::Geometry);
+        for(size_t i=first; i < last; ++i){
+            ParseChunk(bounds[i], bounds[i+1], chunks[i]);
+        }
+    });
+    for(const ObjChunk& chunk : chunks){
+        if(chunk.error != nullptr){
+            SDL_Log("LoadOBJ - %s is malformed at byte %zu", filepath.c_str(), (size_t)(chunk.error - data));
+            return false;
+        }
+    }
+
+    // 3. Where each chunk's elements and corners start in the whole file,
+    // then every element and corner in one array
+    std::vector<size_t> offsets[OBJ_ELEMENT_COUNT + 1];
+    for(std::vector<size_t>& offset : offsets){
+        offset.assign(chunkCount + 1, 0);
+    }
+    for(size_t i=0; i < chunkCount; ++i){
+        for(unsigned int e=0; e < OBJ_ELEMENT_COUNT; ++e){
+            offsets[e][i+1] = offsets[e][i] + chunks[i].elements[e].size()/OBJ_ELEMENT_SIZE[e];
+        }
+        offsets[OBJ_ELEMENT_COUNT][i+1] = offsets[OBJ_ELEMENT_COUNT][i] + chunks[i].corners.size();
+    }
+    const size_t cornerCount = offsets[OBJ_ELEMENT_COUNT][chunkCount];
+    if(cornerCount == 0){
+        SDL_Log("LoadOBJ - no faces in %s", filepath.c_str());
+        return false;
+    }
+    // Corner numbers + 1 go in the hash table, and there are more slots
+    if(cornerCount >= 0x7FFFFFFFu){
+        SDL_Log("LoadOBJ - %s has too many faces", filepath.c_str());
+        return false;
+    }
+    size_t elementCounts[OBJ_ELEMENT_COUNT];
+    for(unsigned int e=0; e < OBJ_ELEMENT_COUNT; ++e){
+        elementCounts[e] = offsets[e][chunkCount];
+    }
+
+    std::vector<float> elements[OBJ_ELEMENT_COUNT];
+    for(unsigned int e=0; e < OBJ_ELEMENT_COUNT; ++e){
+        elements[e].resize(elementCounts[e]*OBJ_ELEMENT_SIZE[e]);
+    }
+    std::vector<ResolvedCorner> corners(cornerCount);
+    std::atomic<bool> outOfRange{false};
+    std::atomic<bool> missingNormals{false};
+    jobs.ParallelFor(0, chunkCount, 1, [&](size_t first, size_t last){
+        for(size_t i=first; i < last; ++i){
+            ObjChunk& chunk = chunks[i];
+            for(unsigned int e=0; e < OBJ_ELEMENT_COUNT; ++e){
+                if(!chunk.elements[e].empty()){
+                    std::memcpy(elements[e].data() + offsets[e][i]*OBJ_ELEMENT_SIZE[e], chunk.elements[e].data(),
+                                chunk.elements[e].size()*sizeof(float));
+                }
+                std::vector<float>().swap(chunk.elements[e]);
+            }
+            ResolvedCorner* resolved = corners.data() + offsets[OBJ_ELEMENT_COUNT][i];
+            for(size_t c=0; c < chunk.corners.size(); ++c){
+                const ObjCorner& corner = chunk.corners[c];
+                const int32_t indices[OBJ_ELEMENT_COUNT] = { corner.position, corner.texCoord, corner.normal };
+                for(unsigned int e=0; e < OBJ_ELEMENT_COUNT; ++e){
+                    int64_t index;
+                    if(corner.relative & (1u << e)){
+                        index = (int64_t)offsets[e][i] + indices[e];
+                    }else if(indices[e] == 0){
+                        resolved[c].element[e] = OBJ_NONE;
+                        continue;
+                    }else{
+                        index = (int64_t)indices[e] - 1;
+                    }
+                    if(index < 0 || index >= (int64_t)elementCounts[e]){
+                        outOfRange.store(true, std::memory_order_relaxed);
+                        index = 0;
+                    }
+                    resolved[c].element[e] = (uint32_t)index;
+                }
+                if(resolved[c].element[OBJ_NORMAL] == OBJ_NONE){
+                    missingNormals.store(true, std::memory_order_relaxed);
+                }
+            }
+            std::vector<ObjCorner>().swap(chunk.corners);
+        }
+    });
+    chunks.clear();
+    if(outOfRange.load()){
+        SDL_Log("LoadOBJ - %s has faces that use vertices it does not have", filepath.c_str());
+        return false;
+    }
+
+    // 4. Deduplicate. Each slot of the table holds the lowest numbered
+    // corner (+1, 0 is empty) with a combination of indices; a slot's
+    // value only ever changes to a corner with the same combination, so
+    // comparing against whatever is in there is always safe.
+    size_t capacity = 1;
+    while(capacity < cornerCount + cornerCount/2){
+        capacity *= 2;
+    }
+    const size_t mask = capacity - 1;
+    // Zero initialized, i.e. empty
+    std::unique_ptr<std::atomic<uint32_t>[]> table(new std::atomic<uint32_t>[capacity]());
+    std::vector<uint32_t> slots(cornerCount);
+    jobs.ParallelFor(0, cornerCount, OBJ_CORNER_BLOCK_SIZE, [&](size_t first, size_t last){
+        for(size_t c=first; c < last; ++c){
+            const ResolvedCorner& corner = corners[c];
+            const uint32_t mine = (uint32_t)c + 1;
+            size_t slot = HashCorner(corner) & mask;
+            for(;;){
+                // Relaxed is enough, the value only names a corner and
+                // the corners do not change any more
+                uint32_t current = table[slot].load(std::memory_order_relaxed);
+                if(current == 0 && table[slot].compare_exchange_strong(current, mine, std::memory_order_relaxed)){
+                    break;
+                }
+                if(SameCorner(corners[current-1], corner)){
+                    // Keep the first one in the file
+                    while(mine < current && !table[slot].compare_exchange_weak(current, mine, std::memory_order_relaxed)){
+                    }
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+            slots[c] = (uint32_t)slot;
+        }
+    });
+
+    // Number the vertices in the order they first appear: count the
+    // first corners per block, then each block knows where it starts
+    const size_t blockCount = (cornerCount + OBJ_CORNER_BLOCK_SIZE - 1) / OBJ_CORNER_BLOCK_SIZE;
+    std::vector<uint32_t> blockStarts(blockCount + 1, 0);
+    jobs.ParallelFor(0, blockCount, 1, [&](size_t first, size_t last){
+        for(size_t block=first; block < last; ++block){
+            size_t end = std::min(cornerCount, (block+1)*OBJ_CORNER_BLOCK_SIZE);
+            uint32_t count = 0;
+            for(size_t c=block*OBJ_CORNER_BLOCK_SIZE; c < end; ++c){
+                count += (table[slots[c]].load(std::memory_order_relaxed) == c + 1);
+            }
+            blockStarts[block+1] = count;
+        }
+    });
+    for(size_t block=0; block < blockCount; ++block){
+        blockStarts[block+1] += blockStarts[block];
+    }
+    const uint32_t vertexCount = blockStarts[blockCount];
+
+    // 5. Straight into the geometry
+    const bool normalsGiven = !missingNormals.load();
+    float* positions = nullptr;
+    float* texCoords = nullptr;
+    float* normals = nullptr;
+    const unsigned int firstVertex = geometry.BeginAddVertices(vertexCount, &positions, &texCoords, &normals);
+    unsigned int* indices = geometry.BeginAddTriangles((unsigned int)cornerCount);
+    jobs.ParallelFor(0, blockCount, 1, [&](size_t first, size_t last){
+        for(size_t block=first; block < last; ++block){
+            size_t end = std::min(cornerCount, (block+1)*OBJ_CORNER_BLOCK_SIZE);
+            uint32_t vertex = blockStarts[block];
+            for(size_t c=block*OBJ_CORNER_BLOCK_SIZE; c < end; ++c){
+                if(table[slots[c]].load(std::memory_order_relaxed) != c + 1){
+                    continue;
+                }
+                const ResolvedCorner& corner = corners[c];
+                std::memcpy(positions + (size_t)vertex*3, elements[OBJ_POSITION].data() + (size_t)corner.element[OBJ_POSITION]*3, 3*sizeof(float));
+                if(corner.element[OBJ_TEXCOORD] != OBJ_NONE){
+                    std::memcpy(texCoords + (size_t)vertex*2, elements[OBJ_TEXCOORD].data() + (size_t)corner.element[OBJ_TEXCOORD]*2, 2*sizeof(float));
+                }
+                if(normalsGiven){
+                    std::memcpy(normals + (size_t)vertex*3, elements[OBJ_NORMAL].data() + (size_t)corner.element[OBJ_NORMAL]*3, 3*sizeof(float));
+                }
+                indices[c] = firstVertex + vertex;
+                ++vertex;
+            }
+        }
+    });
+    // Every first corner has its index now, the rest copy theirs
+    jobs.ParallelFor(0, cornerCount, OBJ_CORNER_BLOCK_SIZE, [&](size_t first, size_t last){
+        for(size_t c=first; c < last; ++c){
+            uint32_t owner = table[slots[c]].load(std::memory_order_relaxed) - 1;
+            if(owner != c){
+                indices[c] = indices[owner];
+            }
+        }
+    });
+    geometry.FinishAddVertices(firstVertex, vertexCount, normalsGiven);
+    return true;
+}
@@ -1,12 +1,30 @@
 #include "Object.hpp"
+#include "ObjectManager.hpp"
 #include "Error.hpp"
+#include "ShaderCompiler.hpp"
+#include "ObjLoader.hpp"
+
+#include <memory>
 
 
 Object::Object(){
+    m_entity = ObjectManager::Instance().GetSceneStorage().Allocate();
+    if(m_entity != INVALID_ENTITY){
+        m_chunk = ObjectManager::Instance().GetSceneStorage().GetChunk(m_entity / SCENE_CHUNK_SIZE);
+        m_lane = m_entity % SCENE_CHUNK_SIZE;
+    }else{
+        // Still works on its own, it just cannot be added to the ObjectManager
+        m_detached.reset(new SceneChunk());
+        m_chunk = m_detached.get();
+        m_lane = 0;
+        SceneStorage::ResetEntity(*m_chunk, m_lane);
+    }
 }
 
 Object::~Object(){
-    
+    if(m_entity != INVALID_ENTITY){
+        ObjectManager::Instance().GetSceneStorage().Free(m_entity);
+    }
 }
 
 
@@ -15,48 +33,78 @@ Object::~Object(){
 // This could be called in the constructor or
 // otherwise 'explicitly' called this
 // so we create our objects at the correct time
-void Object::MakeTexturedQuad(std::string fileName){
+void Object::MakeTexturedQuad(std::string fileName, VertexFormat format){
+        // The calling thread owns the context, so it runs
+        // the OpenGL jobs itself while it waits
+        JobSystem::Instance().Wait(MakeTexturedQuadAsync(fileName, format));
+}
 
+JobHandle Object::MakeTexturedQuadAsync(std::string fileName, VertexFormat format){
         // Setup geometry
         // We are using a new abstraction which allows us
-        // to create triangles shapes on the fly
-        // Position and Texture coordinate 
-        m_geometry.AddVertex(-1.0f,-1.0f, 0.0f, 0.0f, 0.0f);
-        m_geometry.AddVertex( 1.0f,-1.0f, 0.0f, 1.0f, 0.0f);
-    	m_geometry.AddVertex( 1.0f, 1.0f, 0.0f, 1.0f, 1.0f);
-        m_geometry.AddVertex(-1.0f, 1.0f, 0.0f, 0.0f, 1.0f);
-            
-        // Make our triangles and populate our
-        // indices data structure	
-        m_geometry.MakeTriangle(0,1,2);
-        m_geometry.MakeTriangle(2,3,0);
-
-        // This is a helper function to generate all of the geometry
-        m_geometry.Gen();
-
-        // Create a buffer and set the stride of information
-        // NOTE: How we are leveraging our data structure in order to very cleanly
-        //       get information into and out of our data structure.
-        m_vertexBufferLayout.CreateNormalBufferLayout(m_geometry.GetBufferDataSize(),
-                                        m_geometry.GetIndicesSize(),
-                                        m_geometry.GetBufferDataPtr(),
-                                        m_geometry.GetIndicesDataPtr());
+        // to create triangles shapes on the fly.
+        // Every quad is the same, so they all share one mesh.
+        return MakeTexturedAsync("quad", [](Geometry& geometry){
+            // Position and Texture coordinate 
+            const float positions[] = {-1.0f,-1.0f, 0.0f,
+                                        1.0f,-1.0f, 0.0f,
+                                        1.0f, 1.0f, 0.0f,
+                                       -1.0f, 1.0f, 0.0f};
+            const float texCoords[] = {0.0f, 0.0f,
+                                       1.0f, 0.0f,
+                                       1.0f, 1.0f,
+                                       0.0f, 1.0f};
+            // Make our triangles and populate our
+            // indices data structure	
+            const unsigned int indices[] = {0,1,2, 2,3,0};
+            geometry.Reserve(4, 6);
+            geometry.AddVertices(positions, texCoords, 4);
+            geometry.AddTriangles(indices, 6);
+
+            // No Gen(), the vertices are interleaved during the upload
+        }, fileName, format);
+}
+
+JobHandle Object::MakeTexturedMeshAsync(std::string objFile, std::string fileName, VertexFormat format){
+        // Parsed on the workers, objects using the same file share it
+        return MakeTexturedAsync(objFile, [objFile](Geometry& geometry){
+            LoadOBJ(objFile, geometry);
+        }, fileName, format);
+}
+
+JobHandle Object::MakeTexturedAsync(const std::string& meshName, std::function<void(Geometry&)> build,
+                                    const std::string& fileName, VertexFormat format){
+        ResourceManager& resources = ResourceManager::Instance();
+        std::vector<JobHandle> done(5);
+
+        m_mesh = resources.GetMesh(meshName, build, done[0], format);
 
         // Load our actual texture
-        // We are using the input parameter as our texture to load
-        m_textureDiffuse.LoadTexture(fileName.c_str());
-
-        // Load the normal map texture
-        m_normalMap.LoadTexture("bricks2_normal.ppm");
-        
-        // Load the depth map texture
-         m_depthMap.LoadTexture("bricks2_disp.ppm");
-        
+        // We are using the input parameter as our texture to load,
+        // then the normal map and the depth map.
+        // Each one decodes on a worker and uploads on the GL thread,
+        // unless another object already loaded the same file.
+        m_textureDiffuse = resources.GetTexture(fileName, done[1]);
+        m_normalMap = resources.GetTexture("bricks2_normal.ppm", done[2]);
+        m_depthMap = resources.GetTexture("bricks2_disp.ppm", done[3]);
+
         // Setup shaders
-        std::string vertexShader = m_shader.LoadShader("./shaders/vert.glsl");
-        std::string fragmentShader = m_shader.LoadShader("./shaders/frag.glsl");
-        // Actually create our shader
-        m_shader.CreateShader(vertexShader,fragmentShader);
+        // This only starts the compile, we draw with the
+        // fallback program until it is done.
+        // The vertex shader has to know how our mesh stores its vertices.
+        m_shader = resources.GetShader("./shaders/vert.glsl", "./shaders/frag.glsl", GetVertexFormatDefines(format), [](Shader& shader){
+            // Hook our uniform blocks up to the buffers we stream each frame
+            shader.SetUniformBlockBinding("FrameConstants", FRAME_CONSTANTS_BINDING);
+            shader.SetUniformBlockBinding("ObjectConstants", OBJECT_CONSTANTS_BINDING);
+            // Texture slots never change, so they only need to be set once
+            shader.Bind();
+            shader.SetUniform1i("u_DiffuseMap", 0);
+            shader.SetUniform1i("u_NormalMap", 1);
+            shader.SetUniform1i("u_DepthMap", 2);
+        }, done[4]);
+
+        // Finished once everything above is
+        return JobSystem::Instance().Schedule([](){}, done);
 }
 
 // TODO: In the future it may be good to 
@@ -64,107 +112,247 @@ void Object::MakeTexturedQuad(std::string fileName){
 // if the user forgets to do this action!
 void Object::LoadTexture(std::string fileName){
         // Load our actual textures
-        m_textureDiffuse.LoadTexture(fileName);
-}
-
-// Bind everything we need in our object
-// Generally this is called in update() and render()
-// before we do any actual work with our object
-void Object::Bind(){
-        // Make sure we are updating the correct 'buffers'
-        m_vertexBufferLayout.Bind();
-        // Diffuse map is 0 by default, but it is good to set it explicitly
-        m_textureDiffuse.Bind(0);
-        // We need to set the texture slot explicitly for the normal map  
-        m_normalMap.Bind(1);
-        // We need to set the texture slot explicitly for the displacement map
-        m_depthMap.Bind(2);
-        // Select our appropriate shader
-        m_shader.Bind();
-}
-
-void Object::Update(unsigned int screenWidth, unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix){
-        // Call our helper function to just bind everything
-        Bind();
-        // TODO: Read and understand
-        // For our object, we apply the texture in the following way
-        // Note that we set the value to 0, because we have bound
-        // our texture to slot 0.
-        // m_shader.SetUniform1i("u_DiffuseMap",0);
-        // If we want to load another texture, we assign it to another slot
-        // m_shader.SetUniform1i("u_NormalMap",1);  
-         // Here we apply the 'view' matrix which creates perspective.
-        // The first argument is 'field of view'
-        // Then perspective
-        // Then the near and far clipping plane.
-        // Note I cannot see anything closer than 0.1f units from the screen.
-        // TODO: In the future this type of operation would be abstracted away
-        //       in a camera class.
-        m_projectionMatrix = glm::perspective(glm::radians(45.0f),((float)screenWidth)/((float)screenHeight),0.1f,100.0f);
-        // Set shader uniforms
-        // m_shader.SetUniform1i("u_DiffuseMap", 0);  // Diffuse texture
-        // m_shader.SetUniform1i("u_NormalMap", 1);  // Normal map
-
-        // Set the uniforms in our current shader
-        m_shader.SetUniformMatrix4fv("viewMatrix", &viewMatrix[0][0]); // NEW: Pass view matrix
-        m_shader.SetUniformMatrix4fv("modelTransformMatrix",m_transform.GetTransformMatrix());
-        m_shader.SetUniformMatrix4fv("projectionMatrix", &m_projectionMatrix[0][0]);
-
-        m_shader.SetUniform1i("u_DiffuseMap", 0);
-        m_shader.SetUniform1i("u_NormalMap", 1);
-        m_shader.SetUniform1i("u_DepthMap", 2);
-        m_shader.SetUniform1i("u_UseNormalMap", m_useNormalMap ? 1 : 0);
-        m_shader.SetUniform1i("u_UseParallaxMapping", m_useParallaxMapping ? 1 : 0);
-        m_shader.SetUniform1i("u_UseSelfShadowing", m_useSelfShadowing ? 1 : 0);
-        m_shader.SetUniform1f("u_DepthScale", m_depthScale);
-        // m_shader.SetUniform3f("light_pos", lightPos.x, lightPos.y, lightPos.z);
-
-        // Create a first 'light'
-        // Set in a light source position
-        m_shader.SetUniform3f("lightPos",0.0f, -1.0f,-7.0f);	
-        // Set a view and a vector
-        m_shader.SetUniform3f("viewPos",0.0f, 0.0f, 0.0f);
-
-}
-
-// Render our geometry
-void Object::Render(){
-    // Call our helper function to just bind everything
-    Bind();
-	//Render data
-    glDrawElements(GL_TRIANGLES,
-                   m_geometry.GetIndicesSize(), // The number of indices, not triangles.
-                   GL_UNSIGNED_INT,             // Make sure the data type matches
-                        nullptr);               // Offset pointer to the data. 
-                                                // nullptr because we are currently bound
+        // The calling thread owns the context, so it runs
+        // the upload itself while it waits
+        JobHandle ready;
+        m_textureDiffuse = ResourceManager::Instance().GetTexture(fileName, ready);
+        JobSystem::Instance().Wait(ready);
+}
+
+// Below these heights in pixels, the next level of detail is used
+const float LOD_SELF_SHADOW_PIXELS = 160.0f;
+const float LOD_PARALLAX_PIXELS = 48.0f;
+
+void Object::Update(unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                    ObjectConstants& constants, uint32_t constantsIndex){
+        UpdateEntity(*m_chunk, m_lane, screenHeight, viewMatrix, projectionMatrix, constants, constantsIndex);
+}
+
+void Object::UpdateEntity(SceneChunk& chunk, unsigned int lane, unsigned int screenHeight,
+                          const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                          ObjectConstants& constants, uint32_t constantsIndex){
+        const glm::mat4& model = chunk.worldMatrices[lane];
+
+        // Distance in front of the camera of our origin, used to
+        // sort front-to-back (the camera looks down -z in view space).
+        glm::vec4 viewPosition = viewMatrix * model * glm::vec4(0.0f,0.0f,0.0f,1.0f);
+        chunk.viewDepths[lane] = -viewPosition.z;
+
+        // Estimate our height on screen from a sphere around our bounds.
+        // projectionMatrix[1][1] is 1/tan(fovy/2), so a sphere of radius r
+        // at distance d covers r*[1][1]/d of half the screen.
+        // With the camera inside the sphere we cover the whole screen.
+        unsigned int lodLevel = LOD_FULL;
+        const AABB& bounds = chunk.worldBounds[lane];
+        glm::vec3 center = bounds.GetCenter();
+        float radius = glm::length(bounds.GetExtents());
+        float distance = -(viewMatrix * glm::vec4(center, 1.0f)).z;
+        float pixels = (float)screenHeight;
+        if(distance > radius){
+            pixels = radius * projectionMatrix[1][1] / distance * (float)screenHeight;
+            if(pixels < LOD_PARALLAX_PIXELS){
+                lodLevel = LOD_NORMAL_MAP_ONLY;
+            }else if(pixels < LOD_SELF_SHADOW_PIXELS){
+                lodLevel = LOD_NO_SELF_SHADOW;
+            }
+        }
+        chunk.lodLevels[lane] = (uint8_t)lodLevel;
+
+        // Our textures are in view, at about this size
+        for(unsigned int slot=0; slot < DRAW_PACKET_TEXTURES; ++slot){
+            const Texture* texture = chunk.textureObjects[lane][slot];
+            if(texture != nullptr){
+                texture->MarkUsed(pixels);
+            }
+        }
+
+        // The view and projection matrices are per-frame constants
+        // (see SDLGraphicsProgram::Update), so here we only need to
+        // write out what is unique to this object.
+        uint8_t flags = chunk.flags[lane];
+        chunk.constantsIndices[lane] = constantsIndex;
+        constants.modelTransformMatrix = model;
+        constants.useNormalMap = (flags & ENTITY_NORMAL_MAP) ? 1 : 0;
+        constants.useParallaxMapping = ((flags & ENTITY_PARALLAX) && lodLevel < LOD_NORMAL_MAP_ONLY) ? 1 : 0;
+        constants.useSelfShadowing = ((flags & ENTITY_SELF_SHADOW) && lodLevel < LOD_NO_SELF_SHADOW) ? 1 : 0;
+        constants.depthScale = chunk.depthScales[lane];
+        constants.positionScale = glm::vec4(chunk.positionScales[lane], 0.0f);
+        constants.positionOffset = glm::vec4(chunk.positionOffsets[lane], 0.0f);
+}
+
+// Describe how to draw our geometry.
+// The RenderQueue decides when to actually draw it, and only binds
+// the program, vertex array and textures if they changed.
+void Object::Submit(RenderQueue& queue, float farPlane){
+    PublishDrawData();
+    SubmitEntity(*m_chunk, m_lane, queue, farPlane);
+}
+
+void Object::SubmitEntity(const SceneChunk& chunk, unsigned int lane, RenderQueue& queue, float farPlane){
+    DrawPacket packet;
+    // Our own program may still be compiling
+    const Shader* shader = chunk.shaders[lane];
+    packet.program = (shader != nullptr && shader->IsReady()) ? shader->GetID() : ShaderCompiler::Instance().GetFallbackProgram();
+    // Nothing to draw without a program or a mesh
+    if(packet.program == 0 || chunk.indexCounts[lane] == 0){
+        return;
+    }
+    packet.vertexArray = chunk.vertexArrays[lane];
+    // Diffuse is slot 0, normal map slot 1, displacement map slot 2
+    for(unsigned int slot=0; slot < DRAW_PACKET_TEXTURES; ++slot){
+        packet.textures[slot] = chunk.textures[lane][slot];
+    }
+    packet.indexCount = chunk.indexCounts[lane];
+    packet.constantsIndex = chunk.constantsIndices[lane];
+    // Our depth was worked out in Update
+    packet.key = RenderQueue::MakeKey(RenderPass::Opaque, packet.program, chunk.materialIds[lane],
+                                      packet.vertexArray, chunk.viewDepths[lane], farPlane);
+    queue.Submit(packet);
 }
 
 // Returns the actual transform stored in our object
 // which can then be modified
 Transform& Object::GetTransform(){
+    // The caller may change it, check at the next SyncTransform
+    m_chunk->flags[m_lane] |= ENTITY_TRANSFORM_DIRTY;
+    ObjectManager::Instance().MarkSceneChanged();
     return m_transform; 
 }
 
+bool Object::SyncTransform(){
+    m_chunk->flags[m_lane] &= ~ENTITY_TRANSFORM_DIRTY;
+    unsigned int version = m_transform.GetVersion();
+    if(version == m_chunk->transformVersions[m_lane]){
+        return false;
+    }
+    m_chunk->worldMatrices[m_lane] = m_transform.GetInternalMatrix();
+    m_chunk->transformVersions[m_lane] = version;
+    return true;
+}
+
+// Texture name, or 0 while there is no texture
+static GLuint GetTextureID(const std::shared_ptr<Texture>& texture){
+    return texture != nullptr ? texture->GetID() : 0;
+}
+
+void Object::PublishDrawData(){
+    const Geometry& geometry = GetGeometry();
+    m_chunk->shaders[m_lane] = m_shader.get();
+    m_chunk->vertexArrays[m_lane] = m_mesh != nullptr ? m_mesh->layout.GetVertexArrayID() : 0;
+    m_chunk->textures[m_lane][0] = GetTextureID(m_textureDiffuse);
+    m_chunk->textures[m_lane][1] = GetTextureID(m_normalMap);
+    m_chunk->textures[m_lane][2] = GetTextureID(m_depthMap);
+    m_chunk->textureObjects[m_lane][0] = m_textureDiffuse.get();
+    m_chunk->textureObjects[m_lane][1] = m_normalMap.get();
+    m_chunk->textureObjects[m_lane][2] = m_depthMap.get();
+    m_chunk->materialIds[m_lane] = RenderQueue::MakeMaterialId(m_chunk->textures[m_lane]);
+    m_chunk->indexCounts[m_lane] = geometry.GetIndicesSize();
+    m_chunk->positionScales[m_lane] = m_mesh != nullptr ? m_mesh->positionScale : glm::vec3(1.0f);
+    m_chunk->positionOffsets[m_lane] = m_mesh != nullptr ? m_mesh->positionOffset : glm::vec3(0.0f);
+    // New geometry means new bounds
+    AABB localBounds = geometry.GetLocalBounds();
+    if(localBounds != m_chunk->localBounds[m_lane]){
+        m_chunk->localBounds[m_lane] = localBounds;
+        m_chunk->flags[m_lane] &= ~ENTITY_BOUNDS_VALID;
+    }
+}
+
+// Object space bounds only change if the geometry does, so the
+// world bounds only need recomputing when the transform changed.
+bool Object::UpdateWorldBounds(){
+    if(m_chunk->flags[m_lane] & ENTITY_TRANSFORM_DIRTY){
+        SyncTransform();
+    }
+    return UpdateEntityBounds(*m_chunk, m_lane);
+}
+
+bool Object::UpdateEntityBounds(SceneChunk& chunk, unsigned int lane){
+    uint32_t version = chunk.transformVersions[lane];
+    if((chunk.flags[lane] & ENTITY_BOUNDS_VALID) && version == chunk.boundsVersions[lane]){
+        return false;
+    }
+    chunk.worldBounds[lane] = chunk.localBounds[lane].Transformed(chunk.worldMatrices[lane]);
+    chunk.boundsVersions[lane] = version;
+    chunk.flags[lane] |= ENTITY_BOUNDS_VALID;
+    return true;
+}
+
+const AABB& Object::GetWorldBounds() const{
+    return m_chunk->worldBounds[m_lane];
+}
+
+void Object::SetOccluder(bool occluder){
+    SetFlag(ENTITY_OCCLUDER, occluder);
+}
+
+bool Object::IsOccluder() const{
+    return (m_chunk->flags[m_lane] & ENTITY_OCCLUDER) != 0;
+}
+
+const Geometry& Object::GetGeometry() const{
+    static const Geometry empty;
+    return m_mesh != nullptr ? m_mesh->geometry : empty;
+}
+
+unsigned int Object::GetLodLevel() const{
+    return m_chunk->lodLevels[m_lane];
+}
+
+EntityID Object::GetEntity() const{
+    return m_entity;
+}
+
+unsigned int Object::GetVersion() const{
+    return GetEntityVersion(*m_chunk, m_lane);
+}
+
+// Only compared with this entity's own earlier values (see
+// ObjectManager::UpdateDirtyRegion). A transform that may have changed
+// counts as changed until it is synced.
+unsigned int Object::GetEntityVersion(const SceneChunk& chunk, unsigned int lane){
+    const Shader* shader = chunk.shaders[lane];
+    // Switching from the fallback to our own program changes the picture too
+    return chunk.stateVersions[lane] + chunk.transformVersions[lane] +
+           ((chunk.flags[lane] & ENTITY_TRANSFORM_DIRTY) ? 1 : 0) +
+           ((shader != nullptr && shader->IsReady()) ? 1 : 0);
+}
+
+void Object::SetFlag(uint8_t flag, bool value){
+    uint8_t flags = m_chunk->flags[m_lane];
+    uint8_t changed = value ? (flags | flag) : (flags & ~flag);
+    if(changed != flags){
+        m_chunk->flags[m_lane] = changed;
+        ++m_chunk->stateVersions[m_lane];
+        ObjectManager::Instance().MarkSceneChanged();
+    }
+}
+
 void Object::SetUseNormalMap(bool useNormalMap) {
-    m_useNormalMap = useNormalMap;
+    SetFlag(ENTITY_NORMAL_MAP, useNormalMap);
 }
 
 void Object::SetUseParallaxMapping(bool useParallaxMapping) {
-    m_useParallaxMapping = useParallaxMapping;
+    SetFlag(ENTITY_PARALLAX, useParallaxMapping);
 }
 
 void Object::SetDepthScale(float depthScale) {
-    m_depthScale = depthScale;
+    if(m_chunk->depthScales[m_lane] != depthScale){
+        m_chunk->depthScales[m_lane] = depthScale;
+        ++m_chunk->stateVersions[m_lane];
+        ObjectManager::Instance().MarkSceneChanged();
+    }
 }
 
 void Object::AdjustDepthScale(float delta) {
-    m_depthScale += delta; // Adjust the depth scale
-    if (m_depthScale < 0.0f) {
-        m_depthScale = 0.0f; // Clamp to non-negative values
+    float& depthScale = m_chunk->depthScales[m_lane];
+    depthScale += delta; // Adjust the depth scale
+    if (depthScale < 0.0f) {
+        depthScale = 0.0f; // Clamp to non-negative values
     }
-    std::cout << "Depth Scale updated to: " << m_depthScale << std::endl;
+    ++m_chunk->stateVersions[m_lane];
+    ObjectManager::Instance().MarkSceneChanged();
 }
 
 void Object::SetUseSelfShadowing(bool useSelfShadowing) {
-    m_useSelfShadowing = useSelfShadowing;
-}
\ No newline at end of file
+    SetFlag(ENTITY_SELF_SHADOW, useSelfShadowing);
+}
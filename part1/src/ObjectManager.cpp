@@ -1,7 +1,22 @@
 #include "ObjectManager.hpp"
+#include "JobSystem.hpp"
 
-// Constructor is empty
+#include <algorithm>
+#include <thread>
+
+// Objects handed to each job in the parallel phases. Large enough that
+// scheduling costs little next to the work, small enough to balance.
+const size_t UPDATE_GRAIN_SIZE = 64;
+
+// Constructor
 ObjectManager::ObjectManager(){
+    for(unsigned int i=0; i < MAX_EPOCH_PINS; ++i){
+        m_pins[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Destructor
+ObjectManager::~ObjectManager(){
 
 }
 
@@ -10,30 +25,355 @@ ObjectManager& ObjectManager::Instance(){
     return *instance;
 }
 
+ObjectHandle ObjectManager::AddObject(Object* o){
+    ObjectHandle handle;
+    EntityID id = o->GetEntity();
+    if(id == INVALID_ENTITY){
+        SDL_Log("ObjectManager::AddObject - the object has no entity, the scene is full");
+        return handle;
+    }
+    o->PublishDrawData();
+    SceneChunk* chunk = m_scene.GetChunk(id / SCENE_CHUNK_SIZE);
+    unsigned int lane = id % SCENE_CHUNK_SIZE;
+    handle.index = id;
+    handle.generation = chunk->generations[lane].load(std::memory_order_relaxed);
+    // Publishes the object and everything written to its entity so far,
+    // readers load it with acquire
+    chunk->objects[lane].store(o, std::memory_order_release);
+    m_objectCount.fetch_add(1, std::memory_order_relaxed);
+    m_sceneVersion.fetch_add(1, std::memory_order_release);
+    return handle;
+}
+
 // Retrieve a reference to an object
-Object& ObjectManager::GetObject(unsigned int index){
-    return *m_objects[index];
+Object* ObjectManager::GetObject(ObjectHandle handle){
+    SceneChunk* chunk = m_scene.GetChunk(handle.index / SCENE_CHUNK_SIZE);
+    unsigned int lane = handle.index % SCENE_CHUNK_SIZE;
+    if(chunk == nullptr || chunk->generations[lane].load(std::memory_order_acquire) != handle.generation){
+        return nullptr;
+    }
+    return chunk->objects[lane].load(std::memory_order_acquire);
 }
 
-void ObjectManager::AddObject(Object*& o){
-    m_objects.push_back(o);
+bool ObjectManager::RemoveObject(ObjectHandle handle){
+    SceneChunk* chunk = m_scene.GetChunk(handle.index / SCENE_CHUNK_SIZE);
+    unsigned int lane = handle.index % SCENE_CHUNK_SIZE;
+    if(chunk == nullptr){
+        return false;
+    }
+    // Only one remover can win, and old handles stop matching right away
+    uint32_t generation = handle.generation;
+    if(!chunk->generations[lane].compare_exchange_strong(generation, generation+1, std::memory_order_acq_rel)){
+        return false;
+    }
+    Object* object = chunk->objects[lane].exchange(nullptr, std::memory_order_acq_rel);
+    if(object == nullptr){
+        return false;
+    }
+    m_objectCount.fetch_sub(1, std::memory_order_relaxed);
+    m_sceneVersion.fetch_add(1, std::memory_order_release);
+
+    // Readers that pinned this epoch (or an older one) may still see it
+    RetiredObject retired;
+    retired.object = object;
+    retired.epoch = m_epoch.load();
+    std::lock_guard<std::mutex> lock(m_retiredMutex);
+    m_retired.push_back(retired);
+    return true;
 }
 
 void ObjectManager::RemoveAll(){
-    for(int i=0; i < m_objects.size(); i++){
-        delete m_objects[i];
+    uint32_t limit = m_scene.GetEntityLimit();
+    for(uint32_t id=0; id < limit; id++){
+        SceneChunk* chunk = m_scene.GetChunk(id / SCENE_CHUNK_SIZE);
+        unsigned int lane = id % SCENE_CHUNK_SIZE;
+        if(chunk != nullptr && chunk->objects[lane].load(std::memory_order_acquire) != nullptr){
+            ObjectHandle handle;
+            handle.index = id;
+            handle.generation = chunk->generations[lane].load(std::memory_order_acquire);
+            RemoveObject(handle);
+        }
+    }
+    // Nothing is pinned anymore, so this deletes them all
+    Reclaim();
+    m_objects.clear();
+    m_generations.clear();
+    m_visibleObjects.clear();
+}
+
+ObjectManager::EpochPin ObjectManager::Pin(){
+    uint64_t epoch = m_epoch.load();
+    while(true){
+        for(EpochPin i=0; i < MAX_EPOCH_PINS; ++i){
+            uint64_t expected = 0;
+            if(m_pins[i].compare_exchange_strong(expected, epoch)){
+                // Reclaim() may have moved on before our pin was visible.
+                // Follow it until the epoch we hold is the current one.
+                uint64_t now;
+                while((now = m_epoch.load()) != epoch){
+                    m_pins[i].store(now);
+                    epoch = now;
+                }
+                return i;
+            }
+        }
+        // Every pin is taken, wait for one to be released
+        std::this_thread::yield();
+    }
+}
+
+void ObjectManager::Unpin(EpochPin pin){
+    if(pin < MAX_EPOCH_PINS){
+        m_pins[pin].store(0);
+    }
+}
+
+ObjectManager::ReadScope::ReadScope(){
+    m_pin = ObjectManager::Instance().Pin();
+}
+
+ObjectManager::ReadScope::~ReadScope(){
+    ObjectManager::Instance().Unpin(m_pin);
+}
+
+unsigned int ObjectManager::Reclaim(){
+    // From here on, new pins cannot see anything retired so far
+    uint64_t epoch = m_epoch.fetch_add(1) + 1;
+    uint64_t oldest = epoch;
+    for(unsigned int i=0; i < MAX_EPOCH_PINS; ++i){
+        uint64_t pinned = m_pins[i].load();
+        if(pinned != 0 && pinned < oldest){
+            oldest = pinned;
+        }
+    }
+
+    std::vector<RetiredObject> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_retiredMutex);
+        size_t kept = 0;
+        for(size_t i=0; i < m_retired.size(); ++i){
+            if(m_retired[i].epoch < oldest){
+                ready.push_back(m_retired[i]);
+            }else{
+                m_retired[kept++] = m_retired[i];
+            }
+        }
+        m_retired.resize(kept);
+    }
+    for(size_t i=0; i < ready.size(); ++i){
+        // Also frees its entity, only now may it be reused
+        delete ready[i].object;
+    }
+    return (unsigned int)ready.size();
+}
+
+unsigned int ObjectManager::GetObjectCount() const{
+    return m_objectCount.load(std::memory_order_relaxed);
+}
+
+SceneStorage& ObjectManager::GetSceneStorage(){
+    return m_scene;
+}
+
+void ObjectManager::Snapshot(){
+    uint32_t limit = m_scene.GetEntityLimit();
+    m_objects.resize(limit);
+    m_generations.resize(limit);
+    for(uint32_t first=0; first < limit; first+=SCENE_CHUNK_SIZE){
+        SceneChunk* chunk = m_scene.GetChunk(first / SCENE_CHUNK_SIZE);
+        uint32_t count = std::min(SCENE_CHUNK_SIZE, limit-first);
+        for(uint32_t lane=0; lane < count; lane++){
+            if(chunk == nullptr){
+                // Claimed, but the chunk is still being allocated
+                m_objects[first+lane] = nullptr;
+                m_generations[first+lane] = 0;
+                continue;
+            }
+            m_generations[first+lane] = chunk->generations[lane].load(std::memory_order_acquire);
+            m_objects[first+lane] = chunk->objects[lane].load(std::memory_order_acquire);
+        }
+    }
+}
+
+void ObjectManager::UpdateBounds(){
+    m_worldBounds.resize(m_objects.size());
+    m_moved.assign(m_objects.size(), 0);
+    // Every entity only touches its own bounds, so this splits freely.
+    // Each job walks its range one chunk at a time.
+    JobSystem::Instance().ParallelFor(0, m_objects.size(), UPDATE_GRAIN_SIZE, [this](size_t first, size_t last){
+        size_t id = first;
+        while(id < last){
+            SceneChunk* chunk = m_scene.GetChunk((uint32_t)(id / SCENE_CHUNK_SIZE));
+            size_t chunkEnd = std::min(last, (id / SCENE_CHUNK_SIZE + 1) * SCENE_CHUNK_SIZE);
+            for(; id < chunkEnd; ++id){
+                unsigned int lane = id % SCENE_CHUNK_SIZE;
+                if(m_objects[id] == nullptr){
+                    // Removed: an empty box is never visible
+                    if(!m_worldBounds[id].IsEmpty()){
+                        m_worldBounds[id] = AABB();
+                        m_moved[id] = 1;
+                    }
+                    continue;
+                }
+                // Only objects whose Transform was handed out are looked at
+                if(chunk->flags[lane] & ENTITY_TRANSFORM_DIRTY){
+                    m_objects[id]->SyncTransform();
+                }
+                // A new object in a reused entity always counts as moved
+                if(Object::UpdateEntityBounds(*chunk, lane) || m_worldBounds[id] != chunk->worldBounds[lane]){
+                    m_worldBounds[id] = chunk->worldBounds[lane];
+                    m_moved[id] = 1;
+                }
+            }
+        }
+    });
+    m_movedObjects.clear();
+    for(unsigned int i=0; i < m_objects.size(); i++){
+        if(m_moved[i]){
+            m_movedObjects.push_back(i);
+        }
+    }
+    // Objects were added (or refits made the tree too loose): start over.
+    // Otherwise only the paths above the moved objects are touched.
+    if(m_bvh.GetItemCount() != m_objects.size() || m_bvh.NeedsRebuild()){
+        m_bvh.Build(m_worldBounds);
+    }else if(!m_movedObjects.empty()){
+        m_bvh.Refit(m_worldBounds, m_movedObjects);
     }
 }
 
+void ObjectManager::CullOccluded(const glm::mat4& viewProjection){
+    // Only occluders that are in view can hide anything
+    m_occlusionCuller.BeginFrame(viewProjection);
+    bool anyOccluders = false;
+    for(unsigned int i : m_visibleObjects){
+        const SceneChunk& chunk = *m_scene.GetChunk(i / SCENE_CHUNK_SIZE);
+        unsigned int lane = i % SCENE_CHUNK_SIZE;
+        if(chunk.flags[lane] & ENTITY_OCCLUDER){
+            // Only occluders need their Object, for the triangles
+            const Geometry& geometry = m_objects[i]->GetGeometry();
+            if(!geometry.HasCPUData()){
+                // Uploaded without keeping its positions
+                continue;
+            }
+            m_occlusionCuller.AddOccluder(geometry.GetVertexPositionsPtr(), geometry.GetVertexCount(),
+                                          geometry.GetIndicesDataPtr(), geometry.GetIndicesSize(),
+                                          chunk.worldMatrices[lane]);
+            anyOccluders = true;
+        }
+    }
+    if(!anyOccluders){
+        return;
+    }
+    m_occlusionCuller.RasterizeOccluders();
+
+    // Compact the visible list in place. Occluders are kept: they are
+    // in the depth buffer themselves, so they would hide behind their
+    // own front faces.
+    unsigned int kept = 0;
+    for(unsigned int i : m_visibleObjects){
+        bool occluder = (m_scene.GetChunk(i / SCENE_CHUNK_SIZE)->flags[i % SCENE_CHUNK_SIZE] & ENTITY_OCCLUDER) != 0;
+        if(occluder || m_occlusionCuller.IsVisible(m_worldBounds[i])){
+            m_visibleObjects[kept++] = i;
+        }
+    }
+    m_visibleObjects.resize(kept);
+}
 
-void ObjectManager::UpdateAll(unsigned int screenWidth, unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix){
-    for(int i=0; i < m_objects.size(); i++){
-        m_objects[i]->Update(screenWidth,screenHeight, viewMatrix, projectionMatrix);
+void ObjectManager::UpdateAll(unsigned int screenHeight, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, FrameVector<ObjectConstants>& frameConstants){
+    // Objects added or removed from here on show up next frame
+    Snapshot();
+    // Cull first, before any work is done on objects we cannot see
+    UpdateBounds();
+    m_frustum.Extract(projectionMatrix * viewMatrix);
+    m_visibleObjects.clear();
+    m_bvh.Cull(m_frustum, m_worldBounds, m_visibleObjects);
+    // Nodes fully in view list their empty entities too
+    unsigned int kept = 0;
+    for(unsigned int i : m_visibleObjects){
+        if(m_objects[i] != nullptr){
+            m_visibleObjects[kept++] = i;
+        }
     }
+    m_visibleObjects.resize(kept);
+    if(m_occlusionCulling){
+        CullOccluded(projectionMatrix * viewMatrix);
+    }
+
+    // CPU phase: each visible object gets its own slot in the frame's
+    // constants, so chunks of objects can be updated on any core.
+    // The render thread uploads the results (the GL phase).
+    frameConstants.resize(m_visibleObjects.size());
+    JobSystem::Instance().ParallelFor(0, m_visibleObjects.size(), UPDATE_GRAIN_SIZE, [&](size_t first, size_t last){
+        for(size_t k=first; k < last; ++k){
+            unsigned int id = m_visibleObjects[k];
+            Object::UpdateEntity(*m_scene.GetChunk(id / SCENE_CHUNK_SIZE), id % SCENE_CHUNK_SIZE,
+                                 screenHeight, viewMatrix, projectionMatrix,
+                                 frameConstants[k], (uint32_t)k);
+        }
+    });
 }
 
-void ObjectManager::RenderAll(){
-    for(int i=0; i < m_objects.size(); i++){
-        m_objects[i]->Render();
+void ObjectManager::SubmitAll(RenderQueue& queue, float farPlane){
+    queue.Reserve(m_visibleObjects.size());
+    for(unsigned int i : m_visibleObjects){
+        Object::SubmitEntity(*m_scene.GetChunk(i / SCENE_CHUNK_SIZE), i % SCENE_CHUNK_SIZE, queue, farPlane);
+    }
+}
+
+unsigned int ObjectManager::GetVisibleCount() const{
+    return (unsigned int)m_visibleObjects.size();
+}
+
+void ObjectManager::SetOcclusionCulling(bool enabled){
+    m_occlusionCulling = enabled;
+}
+
+OcclusionCuller& ObjectManager::GetOcclusionCuller(){
+    return m_occlusionCuller;
+}
+
+unsigned long long ObjectManager::GetSceneVersion() const{
+    return m_sceneVersion.load(std::memory_order_acquire);
+}
+
+void ObjectManager::MarkSceneChanged(){
+    m_sceneVersion.fetch_add(1, std::memory_order_release);
+}
+
+ScreenRect ObjectManager::UpdateDirtyRegion(const glm::mat4& viewProjection, int width, int height, bool cameraMoved){
+    // New objects have never been drawn
+    m_drawnVersions.resize(m_objects.size(), ~0u);
+    m_drawnGenerations.resize(m_objects.size(), 0);
+    m_drawnRects.resize(m_objects.size());
+
+    ScreenRect dirty;
+    for(unsigned int i=0; i < m_objects.size(); i++){
+        if(m_objects[i] == nullptr){
+            // Removed: uncover where it was drawn last
+            dirty.Expand(m_drawnRects[i]);
+            m_drawnRects[i] = ScreenRect();
+            m_drawnVersions[i] = ~0u;
+            continue;
+        }
+        unsigned int version = Object::GetEntityVersion(*m_scene.GetChunk(i / SCENE_CHUNK_SIZE), i % SCENE_CHUNK_SIZE);
+        // A different generation is a different object in the same entity
+        if(!cameraMoved && version == m_drawnVersions[i] && m_generations[i] == m_drawnGenerations[i]){
+            continue;
+        }
+        ScreenRect rect = ProjectToScreen(m_worldBounds[i], viewProjection, width, height);
+        // Uncover where it was, draw where it is
+        dirty.Expand(m_drawnRects[i]);
+        dirty.Expand(rect);
+        m_drawnRects[i] = rect;
+        m_drawnVersions[i] = version;
+        m_drawnGenerations[i] = m_generations[i];
+    }
+    if(cameraMoved){
+        dirty.x = 0;
+        dirty.y = 0;
+        dirty.width = width;
+        dirty.height = height;
     }
+    return dirty;
 }
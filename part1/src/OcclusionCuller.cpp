@@ -0,0 +1,384 @@
+#include "OcclusionCuller.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define OCCLUSION_USE_SSE 1
+#endif
+
+// Tiles are square, and a multiple of 4 wide so SSE rows never straddle tiles
+const unsigned int TILE_SIZE = 32;
+// Triangles are clipped where w reaches this value
+const float NEAR_W = 1e-4f;
+
+// Milliseconds since an arbitrary point, used for the time budget
+static double NowMilliseconds(){
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Constructor
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height){
+    // Keep rows a multiple of 4 pixels for SSE
+    m_width = (width+3) & ~3u;
+    m_height = height;
+    m_tilesX = (m_width + TILE_SIZE-1) / TILE_SIZE;
+    m_tilesY = (m_height + TILE_SIZE-1) / TILE_SIZE;
+    m_depth.assign(m_width*m_height, 1.0f);
+    m_tileMaxDepth.assign(m_tilesX*m_tilesY, 1.0f);
+    m_bins.resize(m_tilesX*m_tilesY);
+    m_viewProjection = glm::mat4(1.0f);
+}
+
+// Destructor
+OcclusionCuller::~OcclusionCuller(){
+
+}
+
+void OcclusionCuller::SetTimeBudget(double milliseconds){
+    m_budgetMilliseconds = milliseconds;
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection){
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+    std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+    std::fill(m_tileMaxDepth.begin(), m_tileMaxDepth.end(), 1.0f);
+}
+
+void OcclusionCuller::AddOccluder(const float* positions, unsigned int vertexCount,
+                                  const unsigned int* indices, unsigned int indexCount,
+                                  const glm::mat4& modelMatrix){
+    glm::mat4 toClip = m_viewProjection * modelMatrix;
+    for(unsigned int i=0; i+2 < indexCount; i+=3){
+        glm::vec4 clip[3];
+        bool valid = true;
+        for(int v=0; v < 3; ++v){
+            unsigned int index = indices[i+v];
+            if(index >= vertexCount){
+                valid = false;
+                break;
+            }
+            clip[v] = toClip * glm::vec4(positions[index*3+0], positions[index*3+1], positions[index*3+2], 1.0f);
+        }
+        if(valid){
+            AddClipSpaceTriangle(clip[0], clip[1], clip[2]);
+        }
+    }
+}
+
+// Only the near plane needs real clipping, the other planes are handled
+// by clamping to the buffer while rasterizing. Past the far plane depth
+// goes over 1, and the buffer starts at 1, so those pixels keep 'far'.
+void OcclusionCuller::AddClipSpaceTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c){
+    // Sutherland-Hodgman against z > -w (OpenGL's near plane)
+    const glm::vec4 input[3] = {a, b, c};
+    glm::vec4 polygon[4];
+    int count = 0;
+    for(int i=0; i < 3; ++i){
+        const glm::vec4& current = input[i];
+        const glm::vec4& next = input[(i+1)%3];
+        float dCurrent = current.z + current.w;
+        float dNext = next.z + next.w;
+        if(dCurrent >= 0.0f && current.w > NEAR_W){
+            polygon[count++] = current;
+        }
+        if((dCurrent >= 0.0f) != (dNext >= 0.0f)){
+            float t = dCurrent / (dCurrent - dNext);
+            glm::vec4 point = current + (next-current)*t;
+            if(point.w > NEAR_W && count < 4){
+                polygon[count++] = point;
+            }
+        }
+    }
+    if(count < 3){
+        return;
+    }
+
+    // Project to pixels, y up so row 0 is the bottom of the screen
+    glm::vec3 screen[4];
+    for(int i=0; i < count; ++i){
+        float invW = 1.0f / polygon[i].w;
+        screen[i].x = (polygon[i].x*invW*0.5f + 0.5f) * m_width;
+        screen[i].y = (polygon[i].y*invW*0.5f + 0.5f) * m_height;
+        // Not clamped: clamping the corners before interpolating would pull
+        // a triangle crossing the far plane closer than it is
+        screen[i].z = polygon[i].z*invW*0.5f + 0.5f;
+    }
+    // Fan triangulate the clipped polygon
+    for(int i=1; i+1 < count; ++i){
+        ScreenTriangle triangle;
+        const glm::vec3* v[3] = {&screen[0], &screen[i], &screen[i+1]};
+        for(int k=0; k < 3; ++k){
+            triangle.x[k] = v[k]->x;
+            triangle.y[k] = v[k]->y;
+            triangle.z[k] = v[k]->z;
+        }
+        float area = (triangle.x[1]-triangle.x[0])*(triangle.y[2]-triangle.y[0]) -
+                     (triangle.x[2]-triangle.x[0])*(triangle.y[1]-triangle.y[0]);
+        if(area == 0.0f){
+            continue;
+        }
+        // Make every triangle counter-clockwise so 'inside' is always >= 0
+        if(area < 0.0f){
+            std::swap(triangle.x[1], triangle.x[2]);
+            std::swap(triangle.y[1], triangle.y[2]);
+            std::swap(triangle.z[1], triangle.z[2]);
+            area = -area;
+        }
+        // Big and close triangles hide the most
+        float nearest = std::min(triangle.z[0], std::min(triangle.z[1], triangle.z[2]));
+        triangle.priority = area * (1.0f - std::min(nearest, 1.0f) + 1e-3f);
+        m_triangles.push_back(triangle);
+    }
+}
+
+void OcclusionCuller::RasterizeOccluders(){
+    double start = NowMilliseconds();
+    double deadline = start + m_budgetMilliseconds;
+
+    // Most useful triangles first, in case we run out of time
+    std::sort(m_triangles.begin(), m_triangles.end(),
+              [](const ScreenTriangle& lhs, const ScreenTriangle& rhs){
+                  return lhs.priority > rhs.priority;
+              });
+
+    // Bin triangles to every tile their bounding box touches
+    for(unsigned int i=0; i < m_bins.size(); ++i){
+        m_bins[i].clear();
+    }
+    for(unsigned int i=0; i < m_triangles.size(); ++i){
+        const ScreenTriangle& t = m_triangles[i];
+        float minX = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+        float maxX = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+        float minY = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+        float maxY = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+        if(maxX < 0.0f || maxY < 0.0f || minX >= (float)m_width || minY >= (float)m_height){
+            continue;
+        }
+        int tileMinX = std::max(0, (int)minX) / TILE_SIZE;
+        int tileMaxX = std::min((int)m_width-1, (int)maxX) / TILE_SIZE;
+        int tileMinY = std::max(0, (int)minY) / TILE_SIZE;
+        int tileMaxY = std::min((int)m_height-1, (int)maxY) / TILE_SIZE;
+        for(int ty=tileMinY; ty <= tileMaxY; ++ty){
+            for(int tx=tileMinX; tx <= tileMaxX; ++tx){
+                m_bins[ty*m_tilesX+tx].push_back(i);
+            }
+        }
+    }
+
+    // Tiles never share pixels, so they rasterize in parallel, a row
+    // of tiles per chunk (a fixed number of chunks, ParallelFor does
+    // not allocate for them). Tiles that start after the deadline just
+    // mark themselves skipped.
+    unsigned int tileCount = m_tilesX*m_tilesY;
+    m_tileSkipped.assign(tileCount, 0);
+    JobSystem::Instance().ParallelFor(0, tileCount, m_tilesX, [&](size_t first, size_t last){
+        for(size_t tile=first; tile < last; ++tile){
+            if(NowMilliseconds() > deadline){
+                m_tileSkipped[tile] = 1;
+                continue;
+            }
+            RasterizeTile((unsigned int)tile, deadline);
+        }
+    });
+
+    m_skippedTiles = 0;
+    for(unsigned int i=0; i < tileCount; ++i){
+        m_skippedTiles += m_tileSkipped[i];
+    }
+    m_rasterizeMilliseconds = NowMilliseconds() - start;
+}
+
+void OcclusionCuller::RasterizeTile(unsigned int tile, double deadline){
+    int tileX = (tile % m_tilesX) * TILE_SIZE;
+    int tileY = (tile / m_tilesX) * TILE_SIZE;
+    int tileMaxX = std::min(tileX + (int)TILE_SIZE, (int)m_width) - 1;
+    int tileMaxY = std::min(tileY + (int)TILE_SIZE, (int)m_height) - 1;
+
+    const std::vector<unsigned int>& bin = m_bins[tile];
+    for(unsigned int i=0; i < bin.size(); ++i){
+        // Checking the clock is not free, so only do it now and then.
+        // Stopping early leaves the rest of the tile at 'far', which
+        // never hides anything.
+        if((i & 15) == 15 && NowMilliseconds() > deadline){
+            break;
+        }
+        RasterizeTriangle(m_triangles[bin[i]], tileX, tileY, tileMaxX, tileMaxY);
+    }
+
+    // Remember the farthest depth so IsVisible can often skip per-pixel tests
+    float maxDepth = 0.0f;
+    for(int y=tileY; y <= tileMaxY; ++y){
+        for(int x=tileX; x <= tileMaxX; ++x){
+            maxDepth = std::max(maxDepth, m_depth[y*m_width+x]);
+        }
+    }
+    m_tileMaxDepth[tile] = maxDepth;
+}
+
+// Half-space rasterizer. For a counter-clockwise triangle each edge
+// function A*x + B*y + C is >= 0 on the inside. Depth is interpolated
+// as a plane z = z0 + dzdx*(x-x0) + dzdy*(y-y0).
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& t, int minX, int minY, int maxX, int maxY){
+    // Clamp the triangle's bounds to the tile
+    int x0 = std::max(minX, (int)std::floor(std::min(t.x[0], std::min(t.x[1], t.x[2]))));
+    int x1 = std::min(maxX, (int)std::ceil(std::max(t.x[0], std::max(t.x[1], t.x[2]))));
+    int y0 = std::max(minY, (int)std::floor(std::min(t.y[0], std::min(t.y[1], t.y[2]))));
+    int y1 = std::min(maxY, (int)std::ceil(std::max(t.y[0], std::max(t.y[1], t.y[2]))));
+    if(x0 > x1 || y0 > y1){
+        return;
+    }
+    // Start SSE rows on a multiple of 4 (tiles are also aligned to 4)
+    x0 &= ~3;
+
+    float A[3], B[3], C[3];
+    for(int e=0; e < 3; ++e){
+        int a = e;
+        int b = (e+1)%3;
+        A[e] = -(t.y[b] - t.y[a]);
+        B[e] = t.x[b] - t.x[a];
+        C[e] = -(A[e]*t.x[a] + B[e]*t.y[a]);
+    }
+    float area = (t.x[1]-t.x[0])*(t.y[2]-t.y[0]) - (t.x[2]-t.x[0])*(t.y[1]-t.y[0]);
+    float dzdx = ((t.z[1]-t.z[0])*(t.y[2]-t.y[0]) - (t.z[2]-t.z[0])*(t.y[1]-t.y[0])) / area;
+    float dzdy = ((t.z[2]-t.z[0])*(t.x[1]-t.x[0]) - (t.z[1]-t.z[0])*(t.x[2]-t.x[0])) / area;
+    float zc = t.z[0] - dzdx*t.x[0] - dzdy*t.y[0];
+
+#ifdef OCCLUSION_USE_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 pixelOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+    const __m128 vdzdx = _mm_set1_ps(dzdx);
+    const __m128i pastLastX = _mm_set1_epi32(x1+1);
+    const __m128i laneOffsets = _mm_set_epi32(3,2,1,0);
+    for(int y=y0; y <= y1; ++y){
+        float py = (float)y + 0.5f;
+        __m128 rowE0 = _mm_set1_ps(B[0]*py + C[0]);
+        __m128 rowE1 = _mm_set1_ps(B[1]*py + C[1]);
+        __m128 rowE2 = _mm_set1_ps(B[2]*py + C[2]);
+        __m128 rowZ = _mm_set1_ps(dzdy*py + zc);
+        float* row = &m_depth[y*m_width];
+        for(int x=x0; x <= x1; x+=4){
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0,px), rowE0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1,px), rowE1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2,px), rowE2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0,zero), _mm_cmpge_ps(e1,zero)),
+                                       _mm_cmpge_ps(e2,zero));
+            // Do not write past the triangle's (tile clamped) right edge
+            __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), laneOffsets);
+            inside = _mm_and_ps(inside, _mm_castsi128_ps(_mm_cmplt_epi32(lanes, pastLastX)));
+            if(_mm_movemask_ps(inside) == 0){
+                continue;
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(vdzdx,px), rowZ);
+            __m128 old = _mm_loadu_ps(row+x);
+            __m128 closer = _mm_min_ps(old, z);
+            _mm_storeu_ps(row+x, _mm_or_ps(_mm_and_ps(inside,closer), _mm_andnot_ps(inside,old)));
+        }
+    }
+#else
+    for(int y=y0; y <= y1; ++y){
+        float py = (float)y + 0.5f;
+        float* row = &m_depth[y*m_width];
+        for(int x=x0; x <= x1; ++x){
+            float px = (float)x + 0.5f;
+            if(A[0]*px + B[0]*py + C[0] >= 0.0f &&
+               A[1]*px + B[1]*py + C[1] >= 0.0f &&
+               A[2]*px + B[2]*py + C[2] >= 0.0f){
+                float z = dzdx*px + dzdy*py + zc;
+                row[x] = std::min(row[x], z);
+            }
+        }
+    }
+#endif
+}
+
+bool OcclusionCuller::IsVisible(const AABB& worldBounds) const{
+    if(worldBounds.IsEmpty()){
+        return true;
+    }
+    // Project the corners, tracking the screen rectangle and nearest depth.
+    // Depth is linear in view space z, so the nearest point of the box
+    // is always one of its corners.
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    float nearest = 1.0f;
+    for(int i=0; i < 8; ++i){
+        glm::vec4 corner((i&1) ? worldBounds.max.x : worldBounds.min.x,
+                         (i&2) ? worldBounds.max.y : worldBounds.min.y,
+                         (i&4) ? worldBounds.max.z : worldBounds.min.z, 1.0f);
+        glm::vec4 clip = m_viewProjection * corner;
+        // Crosses the near plane: it may be right in front of us
+        if(clip.w <= NEAR_W || clip.z < -clip.w){
+            return true;
+        }
+        float invW = 1.0f / clip.w;
+        float x = (clip.x*invW*0.5f + 0.5f) * m_width;
+        float y = (clip.y*invW*0.5f + 0.5f) * m_height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z*invW*0.5f + 0.5f);
+    }
+    // Off screen is the frustum culler's business, stay conservative
+    if(maxX < 0.0f || maxY < 0.0f || minX >= (float)m_width || minY >= (float)m_height){
+        return true;
+    }
+    int x0 = std::max(0, (int)std::floor(minX));
+    int x1 = std::min((int)m_width-1, (int)std::ceil(maxX));
+    int y0 = std::max(0, (int)std::floor(minY));
+    int y1 = std::min((int)m_height-1, (int)std::ceil(maxY));
+
+    // The box is visible if any pixel it covers is farther than its nearest point
+    for(int ty=y0/(int)TILE_SIZE; ty <= y1/(int)TILE_SIZE; ++ty){
+        for(int tx=x0/(int)TILE_SIZE; tx <= x1/(int)TILE_SIZE; ++tx){
+            // Nothing in this tile is farther than the box: hidden here
+            if(nearest > m_tileMaxDepth[ty*m_tilesX+tx]){
+                continue;
+            }
+            int px0 = std::max(x0, tx*(int)TILE_SIZE);
+            int px1 = std::min(x1, tx*(int)TILE_SIZE + (int)TILE_SIZE-1);
+            int py0 = std::max(y0, ty*(int)TILE_SIZE);
+            int py1 = std::min(y1, ty*(int)TILE_SIZE + (int)TILE_SIZE-1);
+            for(int y=py0; y <= py1; ++y){
+                const float* row = &m_depth[y*m_width];
+                for(int x=px0; x <= px1; ++x){
+                    if(row[x] >= nearest){
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+const float* OcclusionCuller::GetDepthBuffer() const{
+    return m_depth.data();
+}
+
+unsigned int OcclusionCuller::GetWidth() const{
+    return m_width;
+}
+
+unsigned int OcclusionCuller::GetHeight() const{
+    return m_height;
+}
+
+unsigned int OcclusionCuller::GetTriangleCount() const{
+    return (unsigned int)m_triangles.size();
+}
+
+unsigned int OcclusionCuller::GetSkippedTileCount() const{
+    return m_skippedTiles;
+}
+
+double OcclusionCuller::GetRasterizeMilliseconds() const{
+    return m_rasterizeMilliseconds;
+}
@@ -0,0 +1,185 @@
+#include "ProgramBinaryCache.hpp"
+#include "GLExtensions.hpp"
+#include "GLHandle.hpp"
+#include "JobSystem.hpp"
+
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+// Start of every cache file: magic, binary format, binary length
+const uint32_t PROGRAM_BINARY_MAGIC = 0x31434250; // "PBC1"
+struct ProgramBinaryHeader{
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+};
+
+// 64-bit FNV-1a, continuing from 'hash'
+static uint64_t HashBytes(uint64_t hash, const std::string& bytes){
+    for(size_t i=0; i < bytes.size(); ++i){
+        hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ull;
+    }
+    // Separator, so "ab"+"c" and "a"+"bc" differ
+    return (hash ^ 0xFF) * 1099511628211ull;
+}
+
+// Constructor
+ProgramBinaryCache::ProgramBinaryCache(){
+
+}
+
+// Destructor
+ProgramBinaryCache::~ProgramBinaryCache(){
+
+}
+
+bool ProgramBinaryCache::Initialize(const std::string& directory){
+    m_enabled = false;
+    if(!GLExtensions::Instance().HasProgramBinary()){
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if(error){
+        SDL_Log("ProgramBinaryCache: cannot create '%s' (%s)", directory.c_str(), error.message().c_str());
+        return false;
+    }
+    m_directory = directory;
+
+    const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    m_driverSignature.clear();
+    for(unsigned int i=0; i < 3; ++i){
+        const GLubyte* value = glGetString(names[i]);
+        if(value != nullptr){
+            m_driverSignature += (const char*)value;
+        }
+        m_driverSignature += '\n';
+    }
+    m_enabled = true;
+    return true;
+}
+
+bool ProgramBinaryCache::IsEnabled() const{
+    return m_enabled;
+}
+
+uint64_t ProgramBinaryCache::MakeKey(const std::string& vertexShaderSource, const std::string& fragmentShaderSource,
+                                     const std::string& defines) const{
+    uint64_t hash = 14695981039346656037ull;
+    hash = HashBytes(hash, vertexShaderSource);
+    hash = HashBytes(hash, fragmentShaderSource);
+    hash = HashBytes(hash, defines);
+    hash = HashBytes(hash, m_driverSignature);
+    return hash;
+}
+
+GLuint ProgramBinaryCache::Load(uint64_t key){
+    if(!m_enabled){
+        return 0;
+    }
+    std::string path = GetPath(key);
+    std::ifstream file(path.c_str(), std::ios::binary);
+    ProgramBinaryHeader header;
+    if(!file.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_BINARY_MAGIC){
+        ++m_misses;
+        return 0;
+    }
+    // The header comes from disk, so it must agree with the file's size
+    // before we trust it with an allocation (truncated or corrupt files)
+    std::error_code error;
+    uintmax_t fileSize = std::filesystem::file_size(path, error);
+    if(error || header.length == 0 || fileSize != sizeof(header) + (uintmax_t)header.length){
+        ++m_misses;
+        return 0;
+    }
+    std::vector<char> binary(header.length);
+    if(!file.read(binary.data(), binary.size())){
+        ++m_misses;
+        return 0;
+    }
+    file.close();
+
+    // Deleted on the way out unless we hand it over
+    GLProgramHandle program = GLProgramHandle::Create();
+    GLExtensions::Instance().ProgramBinary(program.Get(), header.format, binary.data(), (GLsizei)binary.size());
+    // Loading a binary counts as linking
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program.Get(), GL_LINK_STATUS, &linked);
+    if(linked == GL_FALSE){
+        // Stale (e.g. written by another driver build), compile instead
+        std::remove(path.c_str());
+        ++m_misses;
+        return 0;
+    }
+    ++m_hits;
+    return program.Release();
+}
+
+void ProgramBinaryCache::Save(uint64_t key, GLuint program){
+    if(!m_enabled){
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0){
+        return;
+    }
+    std::shared_ptr<std::vector<char>> file = std::make_shared<std::vector<char>>(sizeof(ProgramBinaryHeader) + length);
+    ProgramBinaryHeader header;
+    header.magic = PROGRAM_BINARY_MAGIC;
+    GLenum format = 0;
+    GLsizei written = 0;
+    GLExtensions::Instance().GetProgramBinary(program, length, &written, &format, file->data() + sizeof(header));
+    if(written <= 0){
+        return;
+    }
+    header.format = format;
+    header.length = (uint32_t)written;
+    file->resize(sizeof(header) + written);
+    std::copy((const char*)&header, (const char*)&header + sizeof(header), file->begin());
+
+    // Write to a temporary file and rename it into place, so another
+    // run never reads a half written binary
+    std::string path = GetPath(key);
+    JobSystem::Instance().Schedule([file, path](){
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if(!out.write(file->data(), file->size())){
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+    });
+}
+
+void ProgramBinaryCache::PrepareForLink(GLuint program) const{
+    if(m_enabled){
+        GLExtensions::Instance().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+unsigned int ProgramBinaryCache::GetHitCount() const{
+    return m_hits;
+}
+
+unsigned int ProgramBinaryCache::GetMissCount() const{
+    return m_misses;
+}
+
+std::string ProgramBinaryCache::GetPath(uint64_t key) const{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return m_directory + "/" + name;
+}
@@ -0,0 +1,182 @@
+#include "RenderQueue.hpp"
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+
+// Bits for each field of the key
+const unsigned int PASS_BITS = 2;
+const unsigned int PROGRAM_BITS = 10;
+const unsigned int MATERIAL_BITS = 16;
+const unsigned int VERTEX_ARRAY_BITS = 12;
+const unsigned int DEPTH_BITS = 24;
+
+static_assert(PASS_BITS+PROGRAM_BITS+MATERIAL_BITS+VERTEX_ARRAY_BITS+DEPTH_BITS == 64,
+              "Sort key fields must fill 64 bits");
+
+// Constructor
+RenderQueue::RenderQueue(){
+
+}
+
+// Destructor
+RenderQueue::~RenderQueue(){
+
+}
+
+uint32_t RenderQueue::MakeMaterialId(const GLuint textures[DRAW_PACKET_TEXTURES]){
+    // Fold the texture names into one material id
+    uint32_t material = 2166136261u;
+    for(unsigned int i=0; i < DRAW_PACKET_TEXTURES; ++i){
+        material = (material ^ textures[i]) * 16777619u;
+    }
+    return (material ^ (material >> 16)) & ((1u<<MATERIAL_BITS)-1);
+}
+
+uint64_t RenderQueue::MakeKey(RenderPass pass, GLuint program, const GLuint textures[DRAW_PACKET_TEXTURES],
+                              GLuint vertexArray, float viewDepth, float farPlane){
+    return MakeKey(pass, program, MakeMaterialId(textures), vertexArray, viewDepth, farPlane);
+}
+
+uint64_t RenderQueue::MakeKey(RenderPass pass, GLuint program, uint32_t materialId,
+                              GLuint vertexArray, float viewDepth, float farPlane){
+    // OpenGL names are small integers, so masking them keeps them unique
+    // in practice. Collisions only make sorting less effective, Execute()
+    // still compares the real names before skipping a bind.
+    uint64_t programBits = program & ((1u<<PROGRAM_BITS)-1);
+    uint64_t vertexArrayBits = vertexArray & ((1u<<VERTEX_ARRAY_BITS)-1);
+    uint64_t materialBits = materialId & ((1u<<MATERIAL_BITS)-1);
+
+    // Quantize depth into [0, 2^24)
+    float normalizedDepth = std::min(std::max(viewDepth / farPlane, 0.0f), 1.0f);
+    uint64_t depthBits = (uint64_t)(normalizedDepth * (float)((1u<<DEPTH_BITS)-1));
+    if(pass == RenderPass::Transparent){
+        // Blended geometry has to go back-to-front instead
+        depthBits = ((1u<<DEPTH_BITS)-1) - depthBits;
+    }
+
+    uint64_t key = (uint64_t)pass;
+    key = (key << PROGRAM_BITS) | programBits;
+    key = (key << MATERIAL_BITS) | materialBits;
+    key = (key << VERTEX_ARRAY_BITS) | vertexArrayBits;
+    key = (key << DEPTH_BITS) | depthBits;
+    return key;
+}
+
+void RenderQueue::SetArena(FrameArena* arena){
+    m_arena = arena;
+}
+
+void RenderQueue::Clear(){
+    if(m_arena == nullptr){
+        m_packets.clear();
+        m_keys.clear();
+        m_order.clear();
+        return;
+    }
+    // Let go of the old frame's memory, the arena takes it back at once
+    m_packets = FrameVector<DrawPacket>(ArenaAllocator<DrawPacket>(m_arena));
+    m_keys = FrameVector<uint64_t>(ArenaAllocator<uint64_t>(m_arena));
+    m_order = FrameVector<uint32_t>(ArenaAllocator<uint32_t>(m_arena));
+    m_tempKeys = FrameVector<uint64_t>(ArenaAllocator<uint64_t>(m_arena));
+    m_tempOrder = FrameVector<uint32_t>(ArenaAllocator<uint32_t>(m_arena));
+}
+
+void RenderQueue::Reserve(size_t count){
+    m_packets.reserve(count);
+    m_keys.reserve(count);
+    m_order.reserve(count);
+}
+
+void RenderQueue::Submit(const DrawPacket& packet){
+    m_order.push_back((uint32_t)m_packets.size());
+    m_keys.push_back(packet.key);
+    m_packets.push_back(packet);
+}
+
+// Least significant digit radix sort, one byte at a time.
+// Passes where every key has the same byte are skipped, which is
+// common (e.g. the pass and program bytes in a small scene).
+void RenderQueue::Sort(){
+    const size_t count = m_keys.size();
+    if(count < 2){
+        return;
+    }
+    m_tempKeys.resize(count);
+    m_tempOrder.resize(count);
+
+    for(unsigned int shift=0; shift < 64; shift+=8){
+        size_t histogram[256] = {0};
+        for(size_t i=0; i < count; ++i){
+            ++histogram[(m_keys[i] >> shift) & 0xFF];
+        }
+        // Nothing to do if all keys landed in one bucket
+        if(histogram[(m_keys[0] >> shift) & 0xFF] == count){
+            continue;
+        }
+        // Turn counts into starting offsets
+        size_t offset = 0;
+        for(unsigned int b=0; b < 256; ++b){
+            size_t c = histogram[b];
+            histogram[b] = offset;
+            offset += c;
+        }
+        // Stable scatter
+        for(size_t i=0; i < count; ++i){
+            size_t dst = histogram[(m_keys[i] >> shift) & 0xFF]++;
+            m_tempKeys[dst] = m_keys[i];
+            m_tempOrder[dst] = m_order[i];
+        }
+        m_keys.swap(m_tempKeys);
+        m_order.swap(m_tempOrder);
+    }
+}
+
+void RenderQueue::Execute(GLuint constantsBuffer, GLintptr constantsBase, GLsizeiptr constantsStride){
+    m_stateChanges = 0;
+
+    // What is currently bound. Zero means 'unknown' so the first
+    // packet always binds everything.
+    GLuint boundProgram = 0;
+    GLuint boundVertexArray = 0;
+    GLuint boundTextures[DRAW_PACKET_TEXTURES] = {0,0,0};
+
+    for(size_t i=0; i < m_order.size(); ++i){
+        const DrawPacket& packet = m_packets[m_order[i]];
+
+        if(packet.program != boundProgram){
+            glUseProgram(packet.program);
+            boundProgram = packet.program;
+            ++m_stateChanges;
+        }
+        if(packet.vertexArray != boundVertexArray){
+            // The index buffer is part of the vertex array state
+            glBindVertexArray(packet.vertexArray);
+            boundVertexArray = packet.vertexArray;
+            ++m_stateChanges;
+        }
+        for(unsigned int slot=0; slot < DRAW_PACKET_TEXTURES; ++slot){
+            if(packet.textures[slot] != boundTextures[slot]){
+                glActiveTexture(GL_TEXTURE0+slot);
+                glBindTexture(GL_TEXTURE_2D, packet.textures[slot]);
+                boundTextures[slot] = packet.textures[slot];
+                ++m_stateChanges;
+            }
+        }
+        // Per-object constants change with every draw
+        glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_CONSTANTS_BINDING, constantsBuffer,
+                          constantsBase + constantsStride*packet.constantsIndex, sizeof(ObjectConstants));
+
+        glDrawElements(GL_TRIANGLES,
+                       packet.indexCount,  // The number of indices, not triangles.
+                       GL_UNSIGNED_INT,    // Make sure the data type matches
+                       nullptr);           // Offset into the bound index buffer
+    }
+}
+
+unsigned int RenderQueue::GetPacketCount() const{
+    return (unsigned int)m_packets.size();
+}
+
+unsigned int RenderQueue::GetStateChangeCount() const{
+    return m_stateChanges;
+}
@@ -0,0 +1,209 @@
+#include "ResourceManager.hpp"
+#include "StartupTimeline.hpp"
+
+#include <filesystem>
+
+// Two spellings of the same file ("./a.ppm" and "a.ppm") share a key
+static std::string NormalizePath(const std::string& path){
+    return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+ResourceManager& ResourceManager::Instance(){
+    static ResourceManager* instance = new ResourceManager();
+    return *instance;
+}
+
+// Constructor
+ResourceManager::ResourceManager(){
+
+}
+
+// Destructor
+ResourceManager::~ResourceManager(){
+
+}
+
+template<typename T>
+bool ResourceManager::Find(Cache<T>& cache, const std::string& key, std::shared_ptr<T>& resource, JobHandle& ready){
+    typename Cache<T>::iterator entry = cache.find(key);
+    if(entry == cache.end()){
+        return false;
+    }
+    resource = entry->second.resource.lock();
+    if(resource == nullptr){
+        // Its last user let go, load it again
+        cache.erase(entry);
+        return false;
+    }
+    ready = entry->second.ready;
+    return true;
+}
+
+template<typename T>
+unsigned int ResourceManager::Prune(Cache<T>& cache){
+    for(typename Cache<T>::iterator entry = cache.begin(); entry != cache.end(); ){
+        if(entry->second.resource.expired()){
+            entry = cache.erase(entry);
+        }else{
+            ++entry;
+        }
+    }
+    return (unsigned int)cache.size();
+}
+
+std::shared_ptr<Texture> ResourceManager::GetTexture(const std::string& path, JobHandle& ready){
+    std::string key = NormalizePath(path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<Texture> texture;
+    if(Find(m_textures, key, texture, ready)){
+        return texture;
+    }
+
+    texture = std::shared_ptr<Texture>(new Texture(), GLThreadDeleter());
+    // Decode on a worker, upload on the GL thread.
+    // Upload() frees the decoded image once it is on the GPU.
+    JobSystem& jobs = JobSystem::Instance();
+    JobHandle decode = jobs.Schedule([texture, key](){
+        StartupTimeline::Scope timer("Decode " + key);
+        texture->Decode(key);
+    });
+    ready = jobs.ScheduleOnGLThread([texture, key](){
+        StartupTimeline::Scope timer("Upload " + key);
+        texture->Upload();
+    }, {decode});
+
+    m_textures[key] = { texture, ready };
+    return texture;
+}
+
+std::shared_ptr<Shader> ResourceManager::GetShader(const std::string& vertexPath, const std::string& fragmentPath,
+                                                   const std::string& defines, std::function<void(Shader&)> onReady,
+                                                   JobHandle& ready){
+    std::string vertexKey = NormalizePath(vertexPath);
+    std::string fragmentKey = NormalizePath(fragmentPath);
+    std::string key = vertexKey + "|" + fragmentKey + "|" + defines;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<Shader> shader;
+    if(Find(m_shaders, key, shader, ready)){
+        return shader;
+    }
+
+    shader = Shader::Create();
+    // Both files are read on workers, only compiling needs the context
+    JobSystem& jobs = JobSystem::Instance();
+    std::shared_ptr<std::string> vertexSource = std::make_shared<std::string>();
+    std::shared_ptr<std::string> fragmentSource = std::make_shared<std::string>();
+    JobHandle readVertex = jobs.Schedule([shader, vertexSource, vertexKey](){
+        StartupTimeline::Scope timer("Read " + vertexKey);
+        *vertexSource = shader->LoadShader(vertexKey);
+    });
+    JobHandle readFragment = jobs.Schedule([shader, fragmentSource, fragmentKey](){
+        StartupTimeline::Scope timer("Read " + fragmentKey);
+        *fragmentSource = shader->LoadShader(fragmentKey);
+    });
+    ready = jobs.ScheduleOnGLThread([shader, vertexSource, fragmentSource, defines, onReady](){
+        StartupTimeline::Scope timer("Submit shaders");
+        // This only starts the compile, see ShaderCompiler
+        shader->CreateShaderAsync(*vertexSource, *fragmentSource, onReady, defines);
+    }, {readVertex, readFragment});
+
+    m_shaders[key] = { shader, ready };
+    return shader;
+}
+
+std::shared_ptr<Mesh> ResourceManager::GetMesh(const std::string& name, std::function<void(Geometry&)> build,
+                                               JobHandle& ready, VertexFormat format, bool keepPositions){
+    // The same geometry in another format is another mesh
+    std::string key = name + "|" + GetVertexFormatName(format);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<Mesh> mesh;
+    if(Find(m_meshes, key, mesh, ready)){
+        return mesh;
+    }
+
+    mesh = std::shared_ptr<Mesh>(new Mesh(), GLThreadDeleter());
+    mesh->format = format;
+    JobSystem& jobs = JobSystem::Instance();
+    // The GPU has its own copy once this ran
+    auto release = [mesh, keepPositions](){
+        if(keepPositions){
+            mesh->geometry.ReleaseUploadData();
+        }else{
+            mesh->geometry.ReleaseCPUData();
+        }
+    };
+
+    if(format != VertexFormat::Float){
+        // Compact formats are encoded on the worker too
+        std::shared_ptr<CompactVertices> compact = std::make_shared<CompactVertices>();
+        JobHandle generate = jobs.Schedule([mesh, name, build, compact](){
+            StartupTimeline::Scope timer("Generate " + name + " geometry");
+            Geometry& geometry = mesh->geometry;
+            build(geometry);
+            geometry.GenerateTangentFrames();
+            PackCompactVertices(geometry, mesh->format, *compact);
+            mesh->positionScale = compact->positionScale;
+            mesh->positionOffset = compact->positionOffset;
+        });
+        ready = jobs.ScheduleOnGLThread([mesh, name, compact, release](){
+            StartupTimeline::Scope timer("Upload " + name + " geometry");
+            Geometry& geometry = mesh->geometry;
+            VertexStreamData vertices{ compact->data.data(), compact->data.size() };
+            mesh->layout.Create(*compact->layout, &vertices, geometry.GetIndicesSize(), geometry.GetIndicesDataPtr());
+            release();
+        }, {generate});
+        m_meshes[key] = { mesh, ready };
+        return mesh;
+    }
+
+    // Float vertices are interleaved by the workers straight into the
+    // mapped vertex buffer, there is no interleaved copy in memory
+    std::shared_ptr<void*> mapped = std::make_shared<void*>(nullptr);
+    JobHandle generate = jobs.Schedule([mesh, name, build](){
+        StartupTimeline::Scope timer("Generate " + name + " geometry");
+        build(mesh->geometry);
+        mesh->geometry.GenerateTangentFrames();
+    });
+    JobHandle map = jobs.ScheduleOnGLThread([mesh, mapped](){
+        size_t bytes = (size_t)mesh->geometry.GetVertexCount() * NORMAL_MAP_LAYOUT.GetStride(0);
+        mesh->layout.BeginCreate(NORMAL_MAP_LAYOUT, &bytes, mapped.get());
+    }, {generate});
+    JobHandle interleave = jobs.Schedule([mesh, name, mapped](){
+        if(*mapped == nullptr){
+            return;
+        }
+        StartupTimeline::Scope timer("Interleave " + name + " geometry");
+        mesh->geometry.InterleaveAll(static_cast<float*>(*mapped));
+    }, {map});
+    ready = jobs.ScheduleOnGLThread([mesh, name, release](){
+        StartupTimeline::Scope timer("Upload " + name + " geometry");
+        Geometry& geometry = mesh->geometry;
+        if(!mesh->layout.FinishCreate(NORMAL_MAP_LAYOUT, geometry.GetIndicesSize(), geometry.GetIndicesDataPtr())){
+            // Not mapped, or lost while it was: build it in memory
+            geometry.Gen();
+            mesh->layout.CreateNormalBufferLayout(geometry.GetBufferDataSize(),
+                                                  geometry.GetIndicesSize(),
+                                                  geometry.GetBufferDataPtr(),
+                                                  geometry.GetIndicesDataPtr());
+        }
+        release();
+    }, {interleave});
+
+    m_meshes[key] = { mesh, ready };
+    return mesh;
+}
+
+unsigned int ResourceManager::GetTextureCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Prune(m_textures);
+}
+
+unsigned int ResourceManager::GetShaderCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Prune(m_shaders);
+}
+
+unsigned int ResourceManager::GetMeshCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Prune(m_meshes);
+}
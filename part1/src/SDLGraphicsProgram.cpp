@@ -1,15 +1,25 @@
 #include "SDLGraphicsProgram.hpp"
 #include "ObjectManager.hpp"
+#include "GLExtensions.hpp"
+#include "UniformBlocks.hpp"
+#include "JobSystem.hpp"
+#include "StartupTimeline.hpp"
+#include "ShaderCompiler.hpp"
+#include "AllocationTracker.hpp"
+#include "TextureResidency.hpp"
 
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 
 // Initialization function
 // Returns a true or false value based on successful completion of setup.
 // Takes in dimensions of window.
-SDLGraphicsProgram::SDLGraphicsProgram(int w, int h):m_screenWidth(w),m_screenHeight(h){
+SDLGraphicsProgram::SDLGraphicsProgram(int w, int h, VertexFormat vertexFormat, std::string meshFile):m_screenWidth(w),m_screenHeight(h){
 	// Initialization flag
 	bool success = true;
 	// String to hold any errors that occur.
@@ -18,6 +28,25 @@ SDLGraphicsProgram::SDLGraphicsProgram(int w, int h):m_screenWidth(w),m_screenHe
 	m_window = NULL;
 	// Render flag
 
+	// Start the worker threads every parallel task shares.
+	// Loading starts right away: reading files, decoding images and
+	// building geometry need no OpenGL context, so they run on the
+	// workers while SDL and the context come up on this thread.
+	// The OpenGL half of loading waits in the job system until then.
+	JobSystem::Instance().Initialize();
+	std::vector<Object*> objects;
+	std::vector<JobHandle> loading;
+	for(int i= 0; i < 1; ++i){ 
+        Object* temp = new Object;
+		if(meshFile.empty()){
+			loading.push_back(temp->MakeTexturedQuadAsync("bricks2.ppm", vertexFormat));
+		}else{
+			loading.push_back(temp->MakeTexturedMeshAsync(meshFile, "bricks2.ppm", vertexFormat));
+		}
+		objects.push_back(temp);
+	}
+
+	unsigned int sdlPhase = StartupTimeline::Instance().Begin("SDL, window and OpenGL context");
 	// Initialize SDL
 	if(SDL_Init(SDL_INIT_VIDEO)< 0){
 		errorStream << "SDL could not initialize! SDL Error: " << SDL_GetError() << "\n";
@@ -53,13 +82,18 @@ SDLGraphicsProgram::SDLGraphicsProgram(int w, int h):m_screenWidth(w),m_screenHe
 			success = false;
 		}
 
+		StartupTimeline::Instance().End(sdlPhase);
+
 		// Initialize GLAD Library
+		unsigned int gladPhase = StartupTimeline::Instance().Begin("Load OpenGL functions");
 		if(!gladLoadGLLoader(SDL_GL_GetProcAddress)){
 			errorStream << "Failed to iniitalize GLAD\n";
 			success = false;
 		}
+		StartupTimeline::Instance().End(gladPhase);
 
 		//Initialize OpenGL
+		StartupTimeline::Scope initPhase("InitGL");
 		if(!InitGL()){
 			errorStream << "Unable to initialize OpenGL!\n";
 			success = false;
@@ -75,24 +109,62 @@ SDLGraphicsProgram::SDLGraphicsProgram(int w, int h):m_screenWidth(w),m_screenHe
         SDL_Log("SDLGraphicsProgram::SDLGraphicsProgram - No SDL, GLAD, or OpenGL, errors detected during initialization\n\n");
     }
 
+	// The context is current here, so GL jobs run on this thread for now.
+	JobSystem::Instance().SetGLThread();
+	SDL_Log("Job system: %u worker threads", JobSystem::Instance().GetWorkerCount());
+
 	// SDL_LogSetAllPriority(SDL_LOG_PRIORITY_WARN); // Uncomment to enable extra debug support!
 	GetOpenGLVersionInfo();
+	GLExtensions::Instance().PrintSupport();
 
 
 	// Setup our objects
-    for(int i= 0; i < 1; ++i){ 
-        Object* temp = new Object;
-		temp->MakeTexturedQuad("bricks2.ppm");
-        ObjectManager::Instance().AddObject(temp);
+	// Finish loading them, this thread runs the OpenGL uploads
+	// and shader compiles as soon as their inputs are ready.
+	{
+		StartupTimeline::Scope waitPhase("Wait for objects to load");
+		for(unsigned int i=0; i < loading.size(); ++i){
+			JobSystem::Instance().Wait(loading[i]);
+		}
+	}
+    for(unsigned int i= 0; i < objects.size(); ++i){ 
+        Object* temp = objects[i];
+		// Walls hide whatever is behind them
+		temp->SetOccluder(true);
+        ObjectHandle handle = ObjectManager::Instance().AddObject(temp);
+        if(i == 0){
+            m_wall = handle;
+        }
+    }
+
+    // Here we hard-code a giant scene
+    // Yuck, we'll fix this in a future assignment.
+    // Placed once here, so a still scene stays unchanged (see Update)
+    ObjectManager::ReadScope scope;
+    Object* wall = ObjectManager::Instance().GetObject(m_wall);
+    if(wall != nullptr){
+        wall->GetTransform().LoadIdentity();
+        // Push back our wall a bit
+        wall->GetTransform().Translate(0.0f,0.0f,-8.0f);
+        // Make our wall a little bigger
+        wall->GetTransform().Scale(2.0f,2.0f,2.0f);
     }
-    
 }
 
 
 // Proper shutdown of SDL and destroy initialized objects
 SDLGraphicsProgram::~SDLGraphicsProgram(){
+    // Let outstanding jobs finish before their data goes away
+    JobSystem::Instance().Shutdown();
+    // Anything that still needs the GL context runs now
+    JobSystem::Instance().RunGLJobs();
     // Reclaim all of our objects
     ObjectManager::Instance().RemoveAll();
+    // Stops the compile thread, after the objects cancelled their compiles
+    ShaderCompiler::Instance().Shutdown();
+    // Release GPU buffers while we still have a context
+    m_constantStream.Destroy();
+    DestroySceneFramebuffer();
 
     //Destroy window
 	SDL_DestroyWindow( m_window );
@@ -109,44 +181,122 @@ bool SDLGraphicsProgram::InitGL(){
 	//Success flag
 	bool success = true;
 
+	// Find out what our driver supports beyond OpenGL 3.3
+	GLExtensions::Instance().Load();
+	// Shaders compile in the background from here on
+	ShaderCompiler::Instance().Initialize(m_window, m_openGLContext);
+
+	// Per-frame uniforms are streamed through a ring buffer.
+	// 256KB per frame is room for roughly 1000 objects at
+	// the usual 256 byte uniform buffer offset alignment.
+	m_constantStream.Create(GL_UNIFORM_BUFFER, 256*1024, 3);
+
 	return success;
 }
 
 
 // Update OpenGL
-void SDLGraphicsProgram::Update(){
+void SDLGraphicsProgram::Update(FramePacket& frame){
+    // Objects this frame sees stay alive until the render thread drew it
+    frame.epochPin = ObjectManager::Instance().Pin();
+
     // Rotate brick wall
+    // Only touch the transform while animating, every change to it
+    // counts as a change to the scene for on-demand rendering.
     static float rot = 0;
-    rot+=0.01;
-    if(rot>360){rot=0;}
+    Object* wall = ObjectManager::Instance().GetObject(m_wall);
+    if(m_animate && wall != nullptr){
+        rot+=0.01;
+        if(rot>360){rot=0;}
+        wall->GetTransform().LoadIdentity();
+        wall->GetTransform().Translate(0.0f,0.0f,-8.0f);
+        // Rotate on y-axis
+        wall->GetTransform().Rotate(rot,0.0f,1.0f,0.0f);
+        wall->GetTransform().Scale(2.0f,2.0f,2.0f);
+    }
 
-    glm::mat4 viewMatrix = m_camera.GetViewMatrix(); // Get the camera's view matrix
+    // Set camera uniforms (assuming shader setup allows this)
+    glm::mat4 viewMatrix = m_camera.GetViewMatrix();
     glm::mat4 projectionMatrix = glm::perspective(
-        glm::radians(45.0f),
-        static_cast<float>(m_screenWidth) / m_screenHeight,
-        0.1f,
+        glm::radians(45.0f), 
+        static_cast<float>(m_screenWidth) / m_screenHeight, 
+        0.1f, 
         100.0f
     );
 
-    // Here we hard-code a giant scene
-    // Yuck, we'll fix this in a future assignment.
-    ObjectManager::Instance().GetObject(0).GetTransform().LoadIdentity();
-    // Push back our wall a bit
-    ObjectManager::Instance().GetObject(0).GetTransform().Translate(0.0f,0.0f,-8.0f);
-    // Rotate on y-axis
-    // ObjectManager::Instance().GetObject(0).GetTransform().Rotate(rot,0.0f,1.0f,0.0f);
-    // Make our wall a little bigger
-    ObjectManager::Instance().GetObject(0).GetTransform().Scale(2.0f,2.0f,2.0f);
-
-    // Update all of the objects
-    ObjectManager::Instance().UpdateAll(m_screenWidth,m_screenHeight, viewMatrix, projectionMatrix);
+    // Everything that is the same for every object goes in one block
+    frame.frameConstants.viewMatrix = viewMatrix;
+    frame.frameConstants.projectionMatrix = projectionMatrix;
+    // Create a first 'light'
+    frame.frameConstants.lightPos = glm::vec3(0.0f, -1.0f,-7.0f);
+    // Set a view and a vector
+    frame.frameConstants.viewPos = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    // Update all objects, each writes its own constants
+    ObjectManager::Instance().UpdateAll(m_screenHeight, viewMatrix, projectionMatrix, frame.objectConstants);
+
+    // Collect and sort all objects, the render thread only has to walk the list
+    ObjectManager::Instance().SubmitAll(frame.queue, 100.0f);
+    frame.queue.Sort();
+
+    // Work out what part of the screen changed since the last frame
+    frame.cameraVersion = m_camera.GetVersion();
+    frame.persistentTarget = m_partialRedraw;
+    if(m_partialRedraw){
+        bool cameraMoved = frame.cameraVersion != m_lastCameraVersion;
+        frame.redrawRegion = ObjectManager::Instance().UpdateDirtyRegion(projectionMatrix * viewMatrix,
+                                                                         m_screenWidth, m_screenHeight,
+                                                                         cameraMoved || m_redrawRequested);
+        frame.partialRedraw = !cameraMoved && !m_redrawRequested;
+    }
+    m_lastCameraVersion = frame.cameraVersion;
+    m_redrawRequested = false;
 }
 
 
 
 // Render
-// The render function gets called once per loop
-void SDLGraphicsProgram::Render(){
+// The render function gets called once per frame on the render thread
+bool SDLGraphicsProgram::Render(FramePacket& frame){
+    // Grab this frame's region of our uniform ring buffer first, so
+    // nothing is touched if the GPU still reads it
+    if(!m_constantStream.BeginFrame()){
+        return false;
+    }
+
+    // Late latch: the main thread culled and sorted with the camera it
+    // had back then, but we draw with the newest one, so the image
+    // reflects input from just before the upload instead of a frame ago.
+    // The difference is a few milliseconds of movement, small enough
+    // that culling and sorting with the older camera still hold up.
+    CameraPose camera = m_latchedCamera.Load();
+    frame.frameConstants.viewMatrix = Camera::GetViewMatrix(camera);
+
+    // When only part of the screen changed, keep the rest of last
+    // frame's image and only clear and draw inside the changed region.
+    // That needs our own framebuffer, since the back buffer is
+    // undefined after a swap.
+    bool scissor = false;
+    if(frame.persistentTarget){
+        if(!m_sceneFramebuffer){
+            CreateSceneFramebuffer();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFramebuffer.Get());
+        // The region was worked out for the camera of this packet,
+        // and the old image has to be from that camera as well
+        scissor = frame.partialRedraw && m_sceneValid &&
+                  camera.version == frame.cameraVersion &&
+                  camera.version == m_sceneCameraVersion;
+    }else if(m_sceneFramebuffer){
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        DestroySceneFramebuffer();
+    }
+    if(scissor){
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(frame.redrawRegion.x, frame.redrawRegion.y,
+                  frame.redrawRegion.width, frame.redrawRegion.height);
+    }
+
 	// Setup our OpenGL State machine
     // TODO: Read this
     // The below command is new!
@@ -169,28 +319,181 @@ void SDLGraphicsProgram::Render(){
     // Nice way to debug your scene in wireframe!
     //glPolygonMode(GL_FRONT_AND_BACK,GL_LINE);
 
-    // Set camera uniforms (assuming shader setup allows this)
-    glm::mat4 viewMatrix = m_camera.GetViewMatrix();
-    glm::mat4 projectionMatrix = glm::perspective(
-        glm::radians(45.0f), 
-        static_cast<float>(m_screenWidth) / m_screenHeight, 
-        0.1f, 
-        100.0f
-    );
-    // Update all objects with view and projection matrices
-    ObjectManager::Instance().UpdateAll(m_screenWidth, m_screenHeight, viewMatrix, projectionMatrix);
+    StreamAllocation frameBlock = m_constantStream.Allocate(sizeof(FrameConstants));
+    if(frameBlock.cpuPtr != nullptr){
+        std::memcpy(frameBlock.cpuPtr, &frame.frameConstants, sizeof(FrameConstants));
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING,
+                          frameBlock.bufferID, frameBlock.offset, frameBlock.size);
+    }
 
-    // Render all objects
-    ObjectManager::Instance().RenderAll();
+    // Copy every object's constants in one go. Each one starts
+    // on an offset the uniform buffer bindings accept.
+    GLsizeiptr alignment = m_constantStream.GetAlignment();
+    GLsizeiptr stride = (sizeof(ObjectConstants) + alignment-1) / alignment * alignment;
+    GLsizeiptr objectCount = (GLsizeiptr)frame.objectConstants.size();
+    StreamAllocation objectBlock = m_constantStream.Allocate(stride*objectCount);
+    if(objectBlock.cpuPtr != nullptr){
+        unsigned char* dst = (unsigned char*)objectBlock.cpuPtr;
+        for(GLsizeiptr i=0; i < objectCount; ++i){
+            std::memcpy(dst + stride*i, &frame.objectConstants[i], sizeof(ObjectConstants));
+        }
+    }
+    // Make the writes visible before any draw reads them
+    m_constantStream.Flush();
 
- 
-	// Delay to slow things down just a bit!
-    SDL_Delay(50); 
+    // Draw all objects in the order the main thread sorted them
+    if(objectBlock.cpuPtr != nullptr){
+        frame.queue.Execute(objectBlock.bufferID, objectBlock.offset, stride);
+    }
+
+    // Fence this region so we do not overwrite it while the GPU reads it
+    m_constantStream.EndFrame();
+
+    // Copy the whole scene image to the window
+    if(frame.persistentTarget){
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_sceneFramebuffer.Get());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, m_screenWidth, m_screenHeight,
+                          0, 0, m_screenWidth, m_screenHeight,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_sceneValid = true;
+        m_sceneCameraVersion = camera.version;
+    }
+    return true;
+}
+
+
+// Color and depth we keep between frames for partial redraws
+void SDLGraphicsProgram::CreateSceneFramebuffer(){
+    m_sceneColor = GLRenderbufferHandle::Create();
+    glBindRenderbuffer(GL_RENDERBUFFER, m_sceneColor.Get());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_screenWidth, m_screenHeight);
+    m_sceneDepth = GLRenderbufferHandle::Create();
+    glBindRenderbuffer(GL_RENDERBUFFER, m_sceneDepth.Get());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_screenWidth, m_screenHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    m_sceneFramebuffer = GLFramebufferHandle::Create();
+    glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFramebuffer.Get());
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_sceneColor.Get());
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_sceneDepth.Get());
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+        SDL_Log("SDLGraphicsProgram: scene framebuffer is incomplete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_sceneValid = false;
+}
+
+// Must run on the render thread while the context is still alive
+void SDLGraphicsProgram::DestroySceneFramebuffer(){
+    m_sceneFramebuffer.Reset();
+    m_sceneColor.Reset();
+    m_sceneDepth.Reset();
+    m_sceneValid = false;
+}
+
+
+// Entry point of the render thread
+void SDLGraphicsProgram::RenderThreadMain(){
+    AllocationScope allocationScope(AllocationSubsystem::RenderLoop);
+    // The context can only be current on one thread at a time,
+    // Loop() released it before starting us.
+    SDL_GL_MakeCurrent(m_window, m_openGLContext);
+    JobSystem::Instance().SetGLThread();
+
+    bool quit = false;
+    Uint32 lastReport = SDL_GetTicks();
+    // A frame the GPU was too far behind for, drawn on the next pass
+    FramePacket* frame = nullptr;
+    while(!quit){
+        // Sleep until the main thread submits a frame. Wake up now and
+        // then anyway, so GL jobs still run while nothing is drawn.
+        bool submitted = (frame != nullptr);
+        if(submitted){
+            // Give the GPU a moment to catch up
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }else{
+            std::unique_lock<std::mutex> lock(m_frameMutex);
+            submitted = m_frameSubmitted.wait_for(lock, std::chrono::milliseconds(16),
+                                                  [&](){ return m_submittedFrames.TryPop(frame); });
+        }
+        // Work other threads need done with the context (uploads etc.)
+        JobSystem::Instance().RunGLJobs();
+        // Delete removed objects no frame in flight uses anymore
+        ObjectManager::Instance().Reclaim();
+        // Hand finished shader programs to their objects. The main thread
+        // may be asleep in on-demand mode, wake it to draw with them.
+        // Same for textures that were shrunk or grown, and start the next
+        // ones if we are over the texture budget or they are back in view
+        unsigned int changed = ShaderCompiler::Instance().Update();
+        if(changed > 0){
+            ObjectManager::Instance().MarkSceneChanged();
+        }
+        changed += TextureResidency::Instance().Update();
+        if(changed > 0){
+            SDL_Event wakeUp = {};
+            wakeUp.type = SDL_USEREVENT;
+            SDL_PushEvent(&wakeUp);
+        }
+        if(!submitted){
+            continue;
+        }
+        if(frame->quit){
+            quit = true;
+        }else{
+            m_frameScheduler.BeginFrame();
+            if(!Render(*frame)){
+                // Keep it: skipping it would lose its changed region
+                continue;
+            }
+            //Update screen of our specified window
+            SDL_GL_SwapWindow(GetSDLWindow());
+            // Prints the startup timeline after the first frame
+            StartupTimeline::Instance().MarkFirstFrame();
+            // Waits here if we are ahead of the frame rate limit
+            m_frameScheduler.EndFrame();
+            // Done with the frame's objects (see Update)
+            ObjectManager::Instance().Unpin(frame->epochPin);
+            frame->epochPin = ObjectManager::NO_EPOCH_PIN;
+
+            // Report how we are doing about once a second
+            Uint32 now = SDL_GetTicks();
+            if(now - lastReport >= 1000){
+                lastReport = now;
+                double average = m_frameScheduler.GetAverageFrameMilliseconds();
+                SDL_Log("Frame: %.2f ms (%.1f FPS), work %.2f ms, pacing: %s",
+                        average, average > 0.0 ? 1000.0/average : 0.0,
+                        m_frameScheduler.GetWorkMilliseconds(),
+                        FrameScheduler::GetPolicyName(m_frameScheduler.GetPolicy()));
+                TextureResidency& residency = TextureResidency::Instance();
+                if(residency.GetBudget() != 0){
+                    SDL_Log("Textures: %.1f of %.1f MB budget (%.1f MB with every level)",
+                            residency.GetResidentBytes()/(1024.0*1024.0), residency.GetBudget()/(1024.0*1024.0),
+                            residency.GetFullBytes()/(1024.0*1024.0));
+                }
+            }
+        }
+        // Hand the packet back so the main thread can fill it again
+        m_freeFrames.TryPush(frame);
+        frame = nullptr;
+        {
+            // Same handshake as m_frameSubmitted, the other way around
+            std::lock_guard<std::mutex> lock(m_frameMutex);
+        }
+        m_frameReturned.notify_one();
+    }
+
+    // Give the context back for cleanup in the destructor
+    SDL_GL_MakeCurrent(m_window, NULL);
 }
 
 
 //Loops forever!
 void SDLGraphicsProgram::Loop(){
+    // Everything the main thread allocates from here on is frame work
+    AllocationScope allocationScope(AllocationSubsystem::RenderLoop);
     // Main loop flag
     // If this is quit = 'true' then the program terminates.
     bool quit = false;
@@ -204,114 +507,217 @@ void SDLGraphicsProgram::Loop(){
     // Enable text input
     SDL_StartTextInput();
 
-    // Set the camera speed for how fast we move.
-    float cameraSpeed = 0.5f;
-
-    // Mouse sensitivity
-    bool firstMouse = true; // To handle first movement
-    int lastMouseX = 0, lastMouseY = 0; // Store last mouse position    
+    // Set the camera speed for how fast we move, in units per second.
+    float cameraSpeed = 4.0f;
+    // Mouse motion not yet applied to the camera, in pixels
+    int mouseDeltaX = 0, mouseDeltaY = 0;
+    // UP/DOWN presses not yet applied to the wall's depth scale
+    int depthScaleSteps = 0;
+    // When we last moved the camera
+    Uint64 lastInputTime = SDL_GetPerformanceCounter();
+    const double secondsPerTick = 1.0 / (double)SDL_GetPerformanceFrequency();
+
+    // Every packet starts out free
+    for(unsigned int i=0; i < FRAMES_IN_FLIGHT; ++i){
+        m_freeFrames.TryPush(&m_framePackets[i]);
+    }
+    // The render thread latches the camera from here
+    m_latchedCamera.Store(m_camera.GetPose());
+    // Hand the OpenGL context over to the render thread
+    SDL_GL_MakeCurrent(m_window, NULL);
+    m_renderThread = std::thread(&SDLGraphicsProgram::RenderThreadMain, this);
 
     // While application is running
+    FramePacket* frame = nullptr;
     while(!quit){
-     	     	 //Handle events on queue
-		while(SDL_PollEvent( &e ) != 0){
-        	// User posts an event to quit
-	        // An example is hitting the "x" in the corner of the window.
-    	    if(e.type == SDL_QUIT){
-        		quit = true;
-	        }
-            // Handle keyboard input for the camera class
-            if(e.type==SDL_MOUSEMOTION){
-                // Handle mouse movements
-                int mouseX = e.motion.x;
-                int mouseY = e.motion.y;
-
-                // Update camera view direction
-                m_camera.MouseLook(mouseX,mouseY);
+        // Keep handling input until the render thread is ready for another
+        // frame. Every pass publishes the camera, so whatever the render
+        // thread draws next uses the newest input we have.
+        while(!quit){
+            //Handle events on queue
+            while(SDL_PollEvent( &e ) != 0){
+                // User posts an event to quit
+                // An example is hitting the "x" in the corner of the window.
+                if(e.type == SDL_QUIT){
+                    quit = true;
+                }
+                // The window was uncovered or resized, its contents are gone
+                if(e.type == SDL_WINDOWEVENT &&
+                   (e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)){
+                    m_redrawRequested = true;
+                }
+                // Handle keyboard input for the camera class
+                if(e.type==SDL_MOUSEMOTION){
+                    // Many motion events can arrive per frame, only
+                    // add them up here and turn the camera once below
+                    mouseDeltaX += e.motion.xrel;
+                    mouseDeltaY += e.motion.yrel;
+                }
+                switch(e.type){
+                    // Handle keyboard presses
+                    case SDL_KEYDOWN:
+                        switch(e.key.keysym.sym){
+                            case SDLK_ESCAPE:
+                                quit = true;
+                                break;
+                            case SDLK_UP:
+                                depthScaleSteps += 1; // Increase by 0.01
+                                break;
+                            case SDLK_DOWN:
+                                depthScaleSteps -= 1; // Decrease by 0.01
+                                break;
+                            case SDLK_1:  // Disable normal mapping
+                                useNormalMap = false;
+                                useParallaxMapping = false;
+                                useShadow = false;
+                                break;
+                            case SDLK_2:  // Enable normal mapping
+                                useNormalMap = true;
+                                useParallaxMapping = false;
+                                useShadow = false;
+                                break;
+                            case SDLK_3:  // Enable parallax mapping
+                                useNormalMap = true;
+                                useParallaxMapping = true;
+                                useShadow = false;
+                                break;
+                            case SDLK_4:  // Enable parallax mapping with self-shadowing 
+                                useNormalMap = true;
+                                useParallaxMapping = true;
+                                useShadow = true;
+                                break;
+                            case SDLK_v:  // Cycle vsync / adaptive / 60 FPS limit / uncapped
+                                {
+                                    FramePacing next = (FramePacing)(((int)m_frameScheduler.GetPolicy() + 1) % 4);
+                                    m_frameScheduler.SetPolicy(next, 60.0);
+                                    SDL_Log("Frame pacing: %s", FrameScheduler::GetPolicyName(next));
+                                }
+                                break;
+                            case SDLK_o:  // Only render when something changed
+                                m_onDemand = !m_onDemand;
+                                SDL_Log("On-demand rendering: %s", m_onDemand ? "on" : "off");
+                                break;
+                            case SDLK_p:  // Only redraw the part of the screen that changed
+                                m_partialRedraw = !m_partialRedraw;
+                                m_redrawRequested = true;
+                                SDL_Log("Partial redraw: %s", m_partialRedraw ? "on" : "off");
+                                break;
+                            case SDLK_r:  // Rotate the wall
+                                m_animate = !m_animate;
+                                break;
+                            }
+                    break;
+                }
+            } // End SDL_PollEvent loop.
+
+            // Move with whatever is held down right now, scaled by the time
+            // since we last moved so speed does not depend on frame rate
+            // or on key repeat.
+            Uint64 inputTime = SDL_GetPerformanceCounter();
+            float deltaTime = (float)((double)(inputTime - lastInputTime) * secondsPerTick);
+            lastInputTime = inputTime;
+            const Uint8* keys = SDL_GetKeyboardState(NULL);
+            bool moving = keys[SDL_SCANCODE_W] || keys[SDL_SCANCODE_S] || keys[SDL_SCANCODE_A] ||
+                          keys[SDL_SCANCODE_D] || keys[SDL_SCANCODE_Q] || keys[SDL_SCANCODE_E];
+            float step = cameraSpeed * deltaTime;
+            if(keys[SDL_SCANCODE_W]){ m_camera.MoveForward(step); }
+            if(keys[SDL_SCANCODE_S]){ m_camera.MoveBackward(step); }
+            if(keys[SDL_SCANCODE_A]){ m_camera.MoveLeft(step); }
+            if(keys[SDL_SCANCODE_D]){ m_camera.MoveRight(step); }
+            if(keys[SDL_SCANCODE_Q]){ m_camera.MoveUp(step); }
+            if(keys[SDL_SCANCODE_E]){ m_camera.MoveDown(step); }
+            // One turn for all the motion since last time
+            if(mouseDeltaX != 0 || mouseDeltaY != 0){
+                m_camera.Look((float)mouseDeltaX, (float)mouseDeltaY);
+                mouseDeltaX = 0;
+                mouseDeltaY = 0;
             }
-            switch(e.type){
-                // Handle keyboard presses
-                case SDL_KEYDOWN:
-                    switch(e.key.keysym.sym){
-                        case SDLK_ESCAPE:
-                            quit = true;
-                            break;
-                        case SDLK_LEFT:
-                        //    Camera::Instance().MoveLeft(cameraSpeed);
-                            break;
-                        case SDLK_RIGHT:
-                        //    Camera::Instance().MoveRight(cameraSpeed);
-                            break;
-                        case SDLK_UP:
-                        //    Camera::Instance().MoveForward(cameraSpeed);
-                            ObjectManager::Instance().GetObject(0).AdjustDepthScale(0.01f); // Increase by 0.01
-                            break;
-                        case SDLK_DOWN:
-                        //    Camera::Instance().MoveBackward(cameraSpeed);
-                            ObjectManager::Instance().GetObject(0).AdjustDepthScale(-0.01f); // Decrease by 0.01
-                            break;
-                        case SDLK_RSHIFT:
-                        //    Camera::Instance().MoveUp(cameraSpeed);
-                            break;
-                        case SDLK_RCTRL:
-                        //    Camera::Instance().MoveDown(cameraSpeed);
-                            break;
-                        case SDLK_w:
-                            m_camera.MoveForward(cameraSpeed);
-                        break;
-                        case SDLK_s:
-                            m_camera.MoveBackward(cameraSpeed);
-                            break;
-                        case SDLK_a:
-                            m_camera.MoveLeft(cameraSpeed);
-                            break;
-                        case SDLK_d:
-                            m_camera.MoveRight(cameraSpeed);
-                            break;
-                        case SDLK_q: // Move camera up
-                            m_camera.MoveUp(cameraSpeed);
-                            break;
-                        case SDLK_e: // Move camera down
-                            m_camera.MoveDown(cameraSpeed);
-                            break;
-                        case SDLK_1:  // Disable normal mapping
-                            useNormalMap = false;
-                            useParallaxMapping = false;
-                            useShadow = false;
-                            break;
-                        case SDLK_2:  // Enable normal mapping
-                            useNormalMap = true;
-                            useParallaxMapping = false;
-                            useShadow = false;
-                            break;
-                        case SDLK_3:  // Enable parallax mapping
-                            useNormalMap = true;
-                            useParallaxMapping = true;
-                            useShadow = false;
-                            break;
-                        case SDLK_4:  // Enable parallax mapping with self-shadowing 
-                            useNormalMap = true;
-                            useParallaxMapping = true;
-                            useShadow = true;
-                            break;
-                        }
+            m_latchedCamera.Store(m_camera.GetPose());
+
+            // Update all objects with the toggle
+            {
+                ObjectManager::ReadScope scope;
+                Object* wall = ObjectManager::Instance().GetObject(m_wall);
+                if(wall != nullptr){
+                    wall->SetUseNormalMap(useNormalMap);
+                    wall->SetUseParallaxMapping(useParallaxMapping);
+                    wall->SetUseSelfShadowing(useShadow);
+                    if(depthScaleSteps != 0){
+                        wall->AdjustDepthScale(0.01f*depthScaleSteps);
+                    }
+                }
+                depthScaleSteps = 0;
+            }
+
+            // Textures changing size touch every pixel they cover
+            unsigned int residencyVersion = TextureResidency::Instance().GetVersion();
+            if(residencyVersion != m_residencyVersion){
+                m_residencyVersion = residencyVersion;
+                m_redrawRequested = true;
+            }
+            // In on-demand mode a frame is only worth drawing if the
+            // camera or any object changed since the last one
+            unsigned long long version = ObjectManager::Instance().GetSceneVersion() + m_camera.GetVersion();
+            bool dirty = !m_onDemand || m_animate || moving || m_redrawRequested || version != m_submittedVersion;
+            if(!dirty){
+                // Nothing to do: sleep until an event arrives (it is left
+                // in the queue for the next pass) or half a second passes
+                SDL_WaitEventTimeout(NULL, 500);
+                // The time asleep is not time spent moving
+                lastInputTime = SDL_GetPerformanceCounter();
+                continue;
+            }
+
+            // Wait for a packet the render thread is done with. With two
+            // packets this lets us simulate frame N+1 while frame N is drawn.
+            // Only briefly, so input keeps being handled while it draws.
+            std::unique_lock<std::mutex> lock(m_frameMutex);
+            if(m_frameReturned.wait_for(lock, std::chrono::milliseconds(1),
+                                        [&](){ return m_freeFrames.TryPop(frame); })){
                 break;
             }
-      	} // End SDL_PollEvent loop.
-
-		// Update all objects with the toggle
-        ObjectManager::Instance().GetObject(0).SetUseNormalMap(useNormalMap);
-        ObjectManager::Instance().GetObject(0).SetUseParallaxMapping(useParallaxMapping);
-        ObjectManager::Instance().GetObject(0).SetUseSelfShadowing(useShadow);
-
-		// Update our scene
-		Update();
-		// Render using OpenGL
-	    Render(); 	// TODO: potentially move this depending on your logic
-					// for how you handle drawing a triangle or rectangle.
-      	//Update screen of our specified window
-      	SDL_GL_SwapWindow(GetSDLWindow());
-	}
+        }
+        if(quit){
+            break;
+        }
+
+        frame->Clear();
+        // Update our scene
+        Update(*frame);
+        m_submittedVersion = ObjectManager::Instance().GetSceneVersion() + m_camera.GetVersion();
+        // Render using OpenGL (on the render thread)
+        m_submittedFrames.TryPush(frame);
+        {
+            // Taking the lock means the render thread is either
+            // waiting already, or will see the frame before it waits
+            std::lock_guard<std::mutex> lock(m_frameMutex);
+        }
+        m_frameSubmitted.notify_one();
+        frame = nullptr;
+
+        if(m_allocationTest && CheckAllocationBudget()){
+            quit = true;
+        }
+    }
+
+    // Let the render thread finish the frames it has, then stop it
+    FramePacket* last = frame;
+    if(last == nullptr){
+        std::unique_lock<std::mutex> lock(m_frameMutex);
+        m_frameReturned.wait(lock, [&](){ return m_freeFrames.TryPop(last); });
+    }
+    last->Clear();
+    last->quit = true;
+    m_submittedFrames.TryPush(last);
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+    }
+    m_frameSubmitted.notify_one();
+    m_renderThread.join();
+    // The destructor releases OpenGL objects, so take the context back
+    SDL_GL_MakeCurrent(m_window, m_openGLContext);
+    JobSystem::Instance().SetGLThread();
+
     //Disable text input
     SDL_StopTextInput();
 }
@@ -322,6 +728,48 @@ SDL_Window* SDLGraphicsProgram::GetSDLWindow(){
   return m_window;
 }
 
+void SDLGraphicsProgram::EnableAllocationTest(unsigned int warmupFrames, unsigned int testFrames, unsigned long long budget){
+    m_allocationTest = true;
+    m_allocationWarmupFrames = warmupFrames;
+    m_allocationTestFrames = testFrames;
+    m_allocationBudget = budget;
+    m_allocationFrames = 0;
+    m_allocationTestFailed = false;
+    // Keep the scene changing so that every frame does the full work
+    m_animate = true;
+    m_onDemand = false;
+}
+
+bool SDLGraphicsProgram::AllocationTestFailed() const{
+    return m_allocationTestFailed;
+}
+
+// A frame here is the time between two submitted frames, which covers
+// building one frame and (on the other threads) drawing the previous.
+bool SDLGraphicsProgram::CheckAllocationBudget(){
+    ++m_allocationFrames;
+    if(m_allocationFrames > m_allocationWarmupFrames){
+        AllocationStats stats = AllocationTracker::GetFrameStats();
+        if(stats.Total().allocations > m_allocationBudget){
+            char title[96];
+            snprintf(title, sizeof(title), "frame %u is over its budget of %llu",
+                     m_allocationFrames, m_allocationBudget);
+            AllocationTracker::Log(title, stats);
+            m_allocationTestFailed = true;
+        }
+    }
+    AllocationTracker::BeginFrame();
+
+    if(m_allocationFrames < m_allocationWarmupFrames + m_allocationTestFrames){
+        return false;
+    }
+    SDL_Log("[Allocations] test %s: %u frames after %u warm-up frames, budget %llu per frame",
+            m_allocationTestFailed ? "FAILED" : "passed", m_allocationTestFrames,
+            m_allocationWarmupFrames, m_allocationBudget);
+    AllocationTracker::Log("whole run", AllocationTracker::GetTotalStats(), 0);
+    return true;
+}
+
 // Helper Function to get OpenGL Version Information
 void SDLGraphicsProgram::GetOpenGLVersionInfo(){
 	SDL_Log("(Note: If you have two GPU's, make sure the correct one is selected)");
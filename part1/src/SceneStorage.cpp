@@ -0,0 +1,106 @@
+#include "SceneStorage.hpp"
+
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+// Constructor
+SceneStorage::SceneStorage(){
+    for(unsigned int i=0; i < MAX_SCENE_CHUNKS; ++i){
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+// Destructor
+SceneStorage::~SceneStorage(){
+    for(unsigned int i=0; i < MAX_SCENE_CHUNKS; ++i){
+        delete m_chunks[i].load();
+    }
+}
+
+EntityID SceneStorage::Allocate(){
+    EntityID id;
+    if(!PopFree(id)){
+        id = m_entityLimit.fetch_add(1, std::memory_order_relaxed);
+        if(id >= SCENE_CHUNK_SIZE*MAX_SCENE_CHUNKS){
+            m_entityLimit.fetch_sub(1, std::memory_order_relaxed);
+            SDL_Log("SceneStorage::Allocate - out of entities (%u)", SCENE_CHUNK_SIZE*MAX_SCENE_CHUNKS);
+            return INVALID_ENTITY;
+        }
+        // The first thread into a new chunk allocates it
+        std::atomic<SceneChunk*>& chunk = m_chunks[id / SCENE_CHUNK_SIZE];
+        if(chunk.load(std::memory_order_acquire) == nullptr){
+            SceneChunk* fresh = new SceneChunk();
+            SceneChunk* expected = nullptr;
+            if(!chunk.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)){
+                // Another thread beat us to it
+                delete fresh;
+            }
+        }
+    }
+    ResetEntity(*GetChunk(id / SCENE_CHUNK_SIZE), id % SCENE_CHUNK_SIZE);
+    return id;
+}
+
+void SceneStorage::Free(EntityID id){
+    SceneChunk* chunk = GetChunk(id / SCENE_CHUNK_SIZE);
+    if(chunk == nullptr){
+        return;
+    }
+    uint64_t head = m_freeList.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do{
+        chunk->nextFree[id % SCENE_CHUNK_SIZE].store((uint32_t)head, std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | (uint64_t)(id + 1);
+    }while(!m_freeList.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool SceneStorage::PopFree(EntityID& id){
+    uint64_t head = m_freeList.load(std::memory_order_acquire);
+    while((uint32_t)head != 0){
+        EntityID top = (uint32_t)head - 1;
+        // May be stale if another thread popped 'top' meanwhile, but then
+        // the tag changed and the exchange below fails
+        uint32_t next = GetChunk(top / SCENE_CHUNK_SIZE)->nextFree[top % SCENE_CHUNK_SIZE].load(std::memory_order_relaxed);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | (uint64_t)next;
+        if(m_freeList.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)){
+            id = top;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t SceneStorage::GetEntityLimit() const{
+    return m_entityLimit.load(std::memory_order_acquire);
+}
+
+void SceneStorage::ResetEntity(SceneChunk& chunk, unsigned int lane){
+    // 'objects' and 'generations' belong to the ObjectManager and
+    // carry over, so stale handles keep failing
+    chunk.worldMatrices[lane] = glm::mat4(1.0f);
+    // Forces the first copy from the Transform
+    chunk.transformVersions[lane] = ~0u;
+    chunk.localBounds[lane] = AABB();
+    chunk.worldBounds[lane] = AABB();
+    chunk.boundsVersions[lane] = 0;
+    chunk.materialIds[lane] = 0;
+    chunk.shaders[lane] = nullptr;
+    chunk.vertexArrays[lane] = 0;
+    for(unsigned int slot=0; slot < DRAW_PACKET_TEXTURES; ++slot){
+        chunk.textures[lane][slot] = 0;
+        chunk.textureObjects[lane][slot] = nullptr;
+    }
+    chunk.indexCounts[lane] = 0;
+    chunk.positionScales[lane] = glm::vec3(1.0f);
+    chunk.positionOffsets[lane] = glm::vec3(0.0f);
+    // Same defaults Object always had: normal mapping on, the rest off
+    chunk.flags[lane] = ENTITY_NORMAL_MAP | ENTITY_TRANSFORM_DIRTY;
+    chunk.depthScales[lane] = 0.05f;
+    chunk.stateVersions[lane] = 0;
+    chunk.viewDepths[lane] = 0.0f;
+    chunk.lodLevels[lane] = 0;
+    chunk.constantsIndices[lane] = 0;
+}
@@ -0,0 +1,381 @@
+#include "ShaderCompiler.hpp"
+#include "Shader.hpp"
+#include "GLExtensions.hpp"
+#include "UniformBlocks.hpp"
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+
+// Prints the info log of a shader that did not compile
+static void LogShaderErrors(GLuint shader, const char* stage){
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string errorMessages(length > 0 ? length : 1, '\0');
+    glGetShaderInfoLog(shader, (GLsizei)errorMessages.size(), nullptr, &errorMessages[0]);
+    SDL_Log("[ShaderCompiler] %s compilation failed!\n%s", stage, errorMessages.c_str());
+}
+
+// Prints the info log of a program that did not link
+static void LogProgramErrors(GLuint program){
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string errorMessages(length > 0 ? length : 1, '\0');
+    glGetProgramInfoLog(program, (GLsizei)errorMessages.size(), nullptr, &errorMessages[0]);
+    SDL_Log("[ShaderCompiler] ERROR in linking process\n%s", errorMessages.c_str());
+}
+
+ShaderCompiler& ShaderCompiler::Instance(){
+    static ShaderCompiler* instance = new ShaderCompiler();
+    return *instance;
+}
+
+// Constructor
+ShaderCompiler::ShaderCompiler(){
+
+}
+
+// Destructor
+ShaderCompiler::~ShaderCompiler(){
+
+}
+
+void ShaderCompiler::Initialize(SDL_Window* window, SDL_GLContext context){
+    if(m_initialized){
+        return;
+    }
+    m_initialized = true;
+    m_window = window;
+
+    if(GLExtensions::Instance().HasParallelShaderCompile()){
+        // Let the driver use as many threads as it likes
+        GLExtensions::Instance().MaxShaderCompilerThreads(0xFFFFFFFF);
+        m_mode = ShaderCompileMode::ParallelExtension;
+    }else{
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        m_compileContext = SDL_GL_CreateContext(window);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+        // Creating a context makes it current, so switch back to ours
+        SDL_GL_MakeCurrent(window, context);
+        if(m_compileContext != nullptr){
+            m_mode = ShaderCompileMode::CompileThread;
+            m_quit = false;
+            m_compileThread = std::thread(&ShaderCompiler::CompileThreadMain, this);
+        }else{
+            SDL_Log("ShaderCompiler: no shared context (%s), compiling on the GL thread", SDL_GetError());
+            m_mode = ShaderCompileMode::Deferred;
+        }
+    }
+    SDL_Log("Shader compiles: %s", GetModeName(m_mode));
+    if(m_binaryCache.Initialize("./shadercache")){
+        SDL_Log("Program binary cache: ./shadercache");
+    }
+
+    CreateFallbackProgram();
+}
+
+void ShaderCompiler::Shutdown(){
+    if(!m_initialized){
+        return;
+    }
+    if(m_compileThread.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_quit = true;
+        }
+        m_queueChanged.notify_all();
+        m_compileThread.join();
+    }
+    // Whatever never got picked up by a shader
+    for(size_t i=0; i < m_pending.size(); ++i){
+        glDeleteShader(m_pending[i]->vertexShader);
+        glDeleteShader(m_pending[i]->fragmentShader);
+        glDeleteProgram(m_pending[i]->program);
+    }
+    m_pending.clear();
+    m_fallback.reset();
+    if(m_binaryCache.IsEnabled()){
+        SDL_Log("Program binary cache: %u hits, %u misses", m_binaryCache.GetHitCount(), m_binaryCache.GetMissCount());
+    }
+    if(m_compileContext != nullptr){
+        SDL_GL_DeleteContext(m_compileContext);
+        m_compileContext = nullptr;
+    }
+    m_initialized = false;
+}
+
+void ShaderCompiler::Submit(Shader& shader, const std::string& vertexShaderSource, const std::string& fragmentShaderSource,
+                            const std::string& defines, std::function<void(Shader&)> onReady){
+    AllocationScope allocationScope(AllocationSubsystem::Shader);
+    // Only the newest program for a shader counts
+    Cancel(shader);
+
+    RequestHandle request = std::make_shared<Request>();
+    request->shader = &shader;
+    request->onReady = std::move(onReady);
+    m_pending.push_back(request);
+
+    // Linked on an earlier run? Then there is nothing to compile.
+    if(m_binaryCache.IsEnabled()){
+        request->cacheKey = m_binaryCache.MakeKey(vertexShaderSource, fragmentShaderSource, defines);
+        request->program = m_binaryCache.Load(request->cacheKey);
+        if(request->program != 0){
+            request->fromCache = true;
+            request->compiled.store(true, std::memory_order_release);
+            return;
+        }
+    }
+
+    request->vertexSource = ApplyDefines(vertexShaderSource, defines);
+    request->fragmentSource = ApplyDefines(fragmentShaderSource, defines);
+
+    if(m_mode == ShaderCompileMode::CompileThread){
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_queue.push_back(request);
+        }
+        m_queueChanged.notify_all();
+    }else{
+        // The driver gets going right away, we only ask how it went later
+        Start(*request);
+    }
+}
+
+void ShaderCompiler::Finish(Shader& shader){
+    for(size_t i=0; i < m_pending.size(); ++i){
+        if(m_pending[i]->shader == &shader){
+            RequestHandle request = m_pending[i];
+            m_pending.erase(m_pending.begin()+i);
+            if(m_mode == ShaderCompileMode::CompileThread){
+                WaitForCompileThread(*request);
+            }
+            // Status queries block until the driver is done
+            Complete(*request);
+            return;
+        }
+    }
+}
+
+void ShaderCompiler::Cancel(Shader& shader){
+    for(size_t i=0; i < m_pending.size(); ++i){
+        if(m_pending[i]->shader == &shader){
+            RequestHandle request = m_pending[i];
+            m_pending.erase(m_pending.begin()+i);
+            if(m_mode == ShaderCompileMode::CompileThread){
+                {
+                    // Not started yet, so nothing to clean up
+                    std::lock_guard<std::mutex> lock(m_queueMutex);
+                    std::deque<RequestHandle>::iterator queued = std::find(m_queue.begin(), m_queue.end(), request);
+                    if(queued != m_queue.end()){
+                        m_queue.erase(queued);
+                        return;
+                    }
+                }
+                WaitForCompileThread(*request);
+            }
+            glDeleteShader(request->vertexShader);
+            glDeleteShader(request->fragmentShader);
+            glDeleteProgram(request->program);
+            return;
+        }
+    }
+}
+
+unsigned int ShaderCompiler::Update(){
+    AllocationScope allocationScope(AllocationSubsystem::Shader);
+    // Take the finished ones out first, an onReady callback may submit again
+    std::vector<RequestHandle> done;
+    for(size_t i=0; i < m_pending.size(); ){
+        if(IsDone(*m_pending[i])){
+            done.push_back(m_pending[i]);
+            m_pending.erase(m_pending.begin()+i);
+        }else{
+            ++i;
+        }
+    }
+    for(size_t i=0; i < done.size(); ++i){
+        Complete(*done[i]);
+    }
+    return (unsigned int)done.size();
+}
+
+GLuint ShaderCompiler::GetFallbackProgram() const{
+    return (m_fallback != nullptr && m_fallback->IsReady()) ? m_fallback->GetID() : 0;
+}
+
+unsigned int ShaderCompiler::GetPendingCount() const{
+    return (unsigned int)m_pending.size();
+}
+
+ShaderCompileMode ShaderCompiler::GetMode() const{
+    return m_mode;
+}
+
+const char* ShaderCompiler::GetModeName(ShaderCompileMode mode){
+    switch(mode){
+        case ShaderCompileMode::Deferred: return "deferred status checks";
+        case ShaderCompileMode::ParallelExtension: return "KHR_parallel_shader_compile";
+        case ShaderCompileMode::CompileThread: return "shared context compile thread";
+    }
+    return "unknown";
+}
+
+std::string ShaderCompiler::ApplyDefines(const std::string& source, const std::string& defines){
+    if(defines.empty()){
+        return source;
+    }
+    // #version has to stay the first line
+    size_t version = source.find("#version");
+    if(version == std::string::npos){
+        return defines + source;
+    }
+    size_t lineEnd = source.find('\n', version);
+    if(lineEnd == std::string::npos){
+        return source + "\n" + defines;
+    }
+    std::string result = source;
+    result.insert(lineEnd+1, defines.back() == '\n' ? defines : defines + "\n");
+    return result;
+}
+
+void ShaderCompiler::Start(Request& request){
+    const char* vertexSource = request.vertexSource.c_str();
+    const char* fragmentSource = request.fragmentSource.c_str();
+
+    request.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(request.vertexShader, 1, &vertexSource, nullptr);
+    glCompileShader(request.vertexShader);
+
+    request.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(request.fragmentShader, 1, &fragmentSource, nullptr);
+    glCompileShader(request.fragmentShader);
+
+    // Linking does not need the compile results yet either
+    request.program = glCreateProgram();
+    glAttachShader(request.program, request.vertexShader);
+    glAttachShader(request.program, request.fragmentShader);
+    m_binaryCache.PrepareForLink(request.program);
+    glLinkProgram(request.program);
+
+    // The sources are not needed anymore
+    request.vertexSource.clear();
+    request.vertexSource.shrink_to_fit();
+    request.fragmentSource.clear();
+    request.fragmentSource.shrink_to_fit();
+}
+
+bool ShaderCompiler::IsDone(Request& request) const{
+    switch(m_mode){
+        case ShaderCompileMode::ParallelExtension:{
+            GLint done = GL_FALSE;
+            glGetProgramiv(request.program, GL_COMPLETION_STATUS_KHR, &done);
+            return done == GL_TRUE;
+        }
+        case ShaderCompileMode::CompileThread:
+            return request.compiled.load(std::memory_order_acquire);
+        case ShaderCompileMode::Deferred:
+            // Submitted at least one Update() ago, check it now
+            return true;
+    }
+    return true;
+}
+
+void ShaderCompiler::Complete(Request& request){
+    if(request.fromCache){
+        // Loading already checked the link status
+        request.shader->SetProgram(request.program);
+        request.program = 0;
+        if(request.onReady){
+            request.onReady(*request.shader);
+        }
+        return;
+    }
+
+    bool success = true;
+    GLint result = GL_FALSE;
+    glGetShaderiv(request.vertexShader, GL_COMPILE_STATUS, &result);
+    if(result == GL_FALSE){
+        LogShaderErrors(request.vertexShader, "GL_VERTEX_SHADER");
+        success = false;
+    }
+    glGetShaderiv(request.fragmentShader, GL_COMPILE_STATUS, &result);
+    if(result == GL_FALSE){
+        LogShaderErrors(request.fragmentShader, "GL_FRAGMENT_SHADER");
+        success = false;
+    }
+    glGetProgramiv(request.program, GL_LINK_STATUS, &result);
+    if(result == GL_FALSE){
+        LogProgramErrors(request.program);
+        success = false;
+    }
+
+    // Once the shaders have been linked in, we can delete them.
+    glDetachShader(request.program, request.vertexShader);
+    glDetachShader(request.program, request.fragmentShader);
+    glDeleteShader(request.vertexShader);
+    glDeleteShader(request.fragmentShader);
+    request.vertexShader = 0;
+    request.fragmentShader = 0;
+
+    if(!success){
+        // The shader keeps drawing with the fallback
+        SDL_Log("[ShaderCompiler] ERROR, shader did not link! Were there compile errors in the shader?");
+        glDeleteProgram(request.program);
+        request.program = 0;
+        return;
+    }
+    // Next time this program loads without compiling
+    m_binaryCache.Save(request.cacheKey, request.program);
+    request.shader->SetProgram(request.program);
+    request.program = 0;
+    if(request.onReady){
+        request.onReady(*request.shader);
+    }
+}
+
+void ShaderCompiler::WaitForCompileThread(Request& request){
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_queueChanged.wait(lock, [&](){ return request.compiled.load(std::memory_order_acquire); });
+}
+
+void ShaderCompiler::CompileThreadMain(){
+    AllocationScope allocationScope(AllocationSubsystem::Shader);
+    SDL_GL_MakeCurrent(m_window, m_compileContext);
+    while(true){
+        RequestHandle request;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueChanged.wait(lock, [&](){ return m_quit || !m_queue.empty(); });
+            if(m_queue.empty()){
+                break;
+            }
+            request = m_queue.front();
+            m_queue.pop_front();
+        }
+        Start(*request);
+        // Objects changed in one context are only safe to use in
+        // another once the commands that changed them completed
+        glFinish();
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            request->compiled.store(true, std::memory_order_release);
+        }
+        m_queueChanged.notify_all();
+    }
+    SDL_GL_MakeCurrent(m_window, NULL);
+}
+
+void ShaderCompiler::CreateFallbackProgram(){
+    m_fallback = Shader::Create();
+    std::string vertexShader = m_fallback->LoadShader("./shaders/fallback_vert.glsl");
+    std::string fragmentShader = m_fallback->LoadShader("./shaders/fallback_frag.glsl");
+    // Needed before anything can be drawn, so wait for it
+    m_fallback->CreateShader(vertexShader, fragmentShader);
+    if(!m_fallback->IsReady()){
+        return;
+    }
+    m_fallback->SetUniformBlockBinding("FrameConstants", FRAME_CONSTANTS_BINDING);
+    m_fallback->SetUniformBlockBinding("ObjectConstants", OBJECT_CONSTANTS_BINDING);
+    m_fallback->Bind();
+    m_fallback->SetUniform1i("u_DiffuseMap", 0);
+    m_fallback->Unbind();
+}
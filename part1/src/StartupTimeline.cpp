@@ -0,0 +1,94 @@
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include "StartupTimeline.hpp"
+
+#include <algorithm>
+
+// Width of the bar chart in characters
+const int TIMELINE_COLUMNS = 50;
+
+// Constructor
+StartupTimeline::StartupTimeline(){
+    m_start = std::chrono::steady_clock::now();
+}
+
+StartupTimeline& StartupTimeline::Instance(){
+    static StartupTimeline* instance = new StartupTimeline();
+    return *instance;
+}
+
+double StartupTimeline::GetMilliseconds() const{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+unsigned int StartupTimeline::Begin(const std::string& name){
+    Phase phase;
+    phase.name = name;
+    phase.thread = std::this_thread::get_id();
+    phase.start = GetMilliseconds();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phases.push_back(phase);
+    return (unsigned int)m_phases.size()-1;
+}
+
+void StartupTimeline::End(unsigned int id){
+    double now = GetMilliseconds();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(id < m_phases.size()){
+        m_phases[id].end = now;
+    }
+}
+
+void StartupTimeline::MarkFirstFrame(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_firstFrame >= 0.0){
+            return;
+        }
+        m_firstFrame = GetMilliseconds();
+    }
+    Report();
+}
+
+// Prints one line per phase with a bar showing when it ran, e.g.
+//   [   12.3 ..   80.1 ms] thread 1 |   ######            | Decode bricks2.ppm
+void StartupTimeline::Report(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    double total = std::max(1.0, m_firstFrame >= 0.0 ? m_firstFrame : GetMilliseconds());
+
+    // Number threads in the order they first show up
+    std::vector<std::thread::id> threads;
+    SDL_Log("Startup timeline:");
+    for(unsigned int i=0; i < m_phases.size(); ++i){
+        const Phase& phase = m_phases[i];
+        unsigned int threadIndex = (unsigned int)(std::find(threads.begin(), threads.end(), phase.thread) - threads.begin());
+        if(threadIndex == threads.size()){
+            threads.push_back(phase.thread);
+        }
+        double end = phase.end >= 0.0 ? phase.end : total;
+
+        std::string bar(TIMELINE_COLUMNS, ' ');
+        int first = std::min(TIMELINE_COLUMNS-1, (int)(phase.start / total * TIMELINE_COLUMNS));
+        int last = std::min(TIMELINE_COLUMNS-1, (int)(end / total * TIMELINE_COLUMNS));
+        for(int c=first; c <= last; ++c){
+            bar[c] = '#';
+        }
+        SDL_Log("  [%8.1f ..%8.1f ms] thread %u |%s| %s",
+                phase.start, end, threadIndex, bar.c_str(), phase.name.c_str());
+    }
+    if(m_firstFrame >= 0.0){
+        SDL_Log("  Time to first frame: %.1f ms", m_firstFrame);
+    }
+}
+
+StartupTimeline::Scope::Scope(const std::string& name){
+    m_id = StartupTimeline::Instance().Begin(name);
+}
+
+StartupTimeline::Scope::~Scope(){
+    StartupTimeline::Instance().End(m_id);
+}
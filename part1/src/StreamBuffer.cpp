@@ -0,0 +1,237 @@
+#if defined(LINUX) || defined(MINGW)
+    #include <SDL2/SDL.h>
+#else // This works for Mac
+    #include <SDL.h>
+#endif
+
+#include "StreamBuffer.hpp"
+#include "GLExtensions.hpp"
+
+// Constructor
+StreamBuffer::StreamBuffer(){
+
+}
+
+// Destructor
+StreamBuffer::~StreamBuffer(){
+    Destroy();
+}
+
+void StreamBuffer::Create(GLenum target, GLsizeiptr regionSize, unsigned int regionCount){
+    Destroy();
+
+    m_target = target;
+    m_regionSize = regionSize;
+    m_regionCount = regionCount;
+    m_currentRegion = regionCount-1; // BeginFrame advances to region 0
+    m_fences.clear();
+    m_fences.resize(regionCount);
+
+    // Uniform blocks can only be bound at multiples of this value
+    m_minAlignment = 4;
+    if(m_target == GL_UNIFORM_BUFFER){
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        if(alignment > 0){
+            m_minAlignment = alignment;
+        }
+    }
+
+    GLsizeiptr totalSize = m_regionSize*m_regionCount;
+
+    m_buffer = GLBufferHandle::Create();
+    glBindBuffer(m_target, m_buffer.Get());
+
+    // Prefer an immutable buffer that stays mapped for its whole life.
+    // We still flush explicitly (no GL_MAP_COHERENT_BIT) so the driver
+    // only has to make the bytes we actually wrote visible.
+    if(GLExtensions::Instance().HasBufferStorage()){
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+        GLExtensions::Instance().BufferStorage(m_target, totalSize, nullptr, flags);
+        m_persistentPtr = (char*)glMapBufferRange(m_target, 0, totalSize,
+                                                  flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+        m_persistent = (m_persistentPtr != nullptr);
+    }
+
+    // Fallback: a regular buffer that we map one region at a time
+    if(!m_persistent){
+        // If storage was made immutable above we need a fresh buffer
+        if(m_persistentPtr == nullptr && GLExtensions::Instance().HasBufferStorage()){
+            m_buffer = GLBufferHandle::Create();
+            glBindBuffer(m_target, m_buffer.Get());
+        }
+        glBufferData(m_target, totalSize, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(m_target, 0);
+}
+
+void StreamBuffer::Destroy(){
+    if(!m_buffer){
+        return;
+    }
+    for(unsigned int i=0; i < m_fences.size(); ++i){
+        ReleaseFence(i);
+    }
+    glBindBuffer(m_target, m_buffer.Get());
+    if(m_persistent || m_mapped){
+        glUnmapBuffer(m_target);
+    }
+    glBindBuffer(m_target, 0);
+    m_buffer.Reset();
+
+    m_persistentPtr = nullptr;
+    m_regionPtr = nullptr;
+    m_persistent = false;
+    m_mapped = false;
+}
+
+// Polls a fence without waiting for it
+bool StreamBuffer::IsRegionFree(unsigned int region){
+    if(!m_fences[region]){
+        return true;
+    }
+    GLenum result = glClientWaitSync(m_fences[region].Get(), 0, 0);
+    if(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED){
+        ReleaseFence(region);
+        return true;
+    }
+    return false;
+}
+
+void StreamBuffer::ReleaseFence(unsigned int region){
+    m_fences[region].Reset();
+}
+
+bool StreamBuffer::BeginFrame(){
+    unsigned int next = (m_currentRegion+1) % m_regionCount;
+    bool regionFree = IsRegionFree(next);
+    if(!regionFree){
+        ++m_stallCount;
+    }
+
+    // Persistent storage is immutable so it cannot be orphaned. With
+    // three regions and a swap in between, the GPU is essentially never
+    // this far behind; if it is, the caller draws this frame later
+    // instead of us blocking on the fence.
+    if(m_persistent && !regionFree){
+        return false;
+    }
+    m_currentRegion = next;
+    m_head = 0;
+    m_flushed = 0;
+
+    if(m_persistent){
+        m_regionPtr = m_persistentPtr + m_regionSize*m_currentRegion;
+        return true;
+    }
+
+    glBindBuffer(m_target, m_buffer.Get());
+    if(!regionFree){
+        // Orphan the storage instead of waiting. The driver hands us
+        // a new block of memory and frees the old one once the GPU is
+        // done with it, so every fence we had is now meaningless.
+        glBufferData(m_target, m_regionSize*m_regionCount, nullptr, GL_STREAM_DRAW);
+        for(unsigned int i=0; i < m_fences.size(); ++i){
+            ReleaseFence(i);
+        }
+    }
+    // We checked the fence ourselves, so tell the driver not to.
+    m_regionPtr = (char*)glMapBufferRange(m_target,
+                                          m_regionSize*m_currentRegion,
+                                          m_regionSize,
+                                          GL_MAP_WRITE_BIT |
+                                          GL_MAP_UNSYNCHRONIZED_BIT |
+                                          GL_MAP_FLUSH_EXPLICIT_BIT |
+                                          GL_MAP_INVALIDATE_RANGE_BIT);
+    m_mapped = (m_regionPtr != nullptr);
+    m_mapOffset = 0;
+    glBindBuffer(m_target, 0);
+    return true;
+}
+
+StreamAllocation StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment){
+    StreamAllocation result;
+    if(alignment <= 0){
+        alignment = m_minAlignment;
+    }
+
+    // Round our head up to the requested alignment
+    GLsizeiptr start = (m_head + alignment-1) / alignment * alignment;
+    if(start + size > m_regionSize || m_regionPtr == nullptr){
+        SDL_Log("StreamBuffer::Allocate - region is full (%ld of %ld bytes requested)",
+                (long)(start+size), (long)m_regionSize);
+        return result;
+    }
+    // In the mapped path Flush() unmaps the region, so anything
+    // allocated afterwards is mapped again (the GPU has not read it yet).
+    if(!m_persistent && !m_mapped){
+        glBindBuffer(m_target, m_buffer.Get());
+        char* tail = (char*)glMapBufferRange(m_target,
+                                             m_regionSize*m_currentRegion + m_flushed,
+                                             m_regionSize - m_flushed,
+                                             GL_MAP_WRITE_BIT |
+                                             GL_MAP_UNSYNCHRONIZED_BIT |
+                                             GL_MAP_FLUSH_EXPLICIT_BIT);
+        glBindBuffer(m_target, 0);
+        if(tail == nullptr){
+            return result;
+        }
+        m_regionPtr = tail - m_flushed;
+        m_mapOffset = m_flushed;
+        m_mapped = true;
+    }
+
+    m_head = start + size;
+    result.bufferID = m_buffer.Get();
+    result.cpuPtr = m_regionPtr + start;
+    result.offset = m_regionSize*m_currentRegion + start;
+    result.size = size;
+    return result;
+}
+
+void StreamBuffer::Flush(){
+    if(m_head == m_flushed){
+        return;
+    }
+    glBindBuffer(m_target, m_buffer.Get());
+    if(m_persistent){
+        // Offsets are relative to the start of the mapping (the whole buffer)
+        glFlushMappedBufferRange(m_target, m_regionSize*m_currentRegion + m_flushed, m_head - m_flushed);
+    }else if(m_mapped){
+        // Offsets are relative to the mapped range
+        glFlushMappedBufferRange(m_target, m_flushed - m_mapOffset, m_head - m_flushed);
+        glUnmapBuffer(m_target);
+        m_mapped = false;
+    }
+    glBindBuffer(m_target, 0);
+    m_flushed = m_head;
+}
+
+void StreamBuffer::EndFrame(){
+    Flush();
+    if(m_mapped){
+        glBindBuffer(m_target, m_buffer.Get());
+        glUnmapBuffer(m_target);
+        glBindBuffer(m_target, 0);
+        m_mapped = false;
+    }
+    // Replacing the handle deletes the old fence
+    m_fences[m_currentRegion] = GLSyncHandle::Create();
+}
+
+GLuint StreamBuffer::GetID() const{
+    return m_buffer.Get();
+}
+
+GLsizeiptr StreamBuffer::GetAlignment() const{
+    return m_minAlignment;
+}
+
+bool StreamBuffer::IsPersistent() const{
+    return m_persistent;
+}
+
+unsigned int StreamBuffer::GetStallCount() const{
+    return m_stallCount;
+}
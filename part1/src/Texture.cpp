@@ -6,6 +6,7 @@
 
 
 #include "Texture.hpp"
+#include "TextureResidency.hpp"
 
 #include <stdio.h>
 #include <string.h>
@@ -13,8 +14,12 @@
 #include <fstream>
 #include <iostream>
 #include <glad/glad.h>
+#include <algorithm>
 #include <memory>
 
+// Drivers keep RGB8 textures as RGBA8, so count 4 bytes per texel
+static const size_t BYTES_PER_TEXEL = 4;
+
 // Default Constructor
 Texture::Texture(){
 
@@ -22,32 +27,67 @@ Texture::Texture(){
 
 
 // Default Destructor
+// The handle deletes our texture from the GPU
 Texture::~Texture(){
-	// Delete our texture from the GPU
-	glDeleteTextures(1,&m_textureID);
+    TextureResidency::Instance().Unregister(this);
+}
 
-    // Delete our image
-    if(m_image != nullptr){
-        delete m_image;
-    }
+// The residency manager follows the texture to its new address
+Texture::Texture(Texture&& other) noexcept
+    : m_texture(std::move(other.m_texture)),
+      m_filepath(std::move(other.m_filepath)),
+      m_image(std::move(other.m_image)),
+      m_width(other.m_width),
+      m_height(other.m_height),
+      m_levelCount(other.m_levelCount),
+      m_droppedLevels(other.m_droppedLevels),
+      m_footprint(other.m_footprint.load()){
+    TextureResidency::Instance().Retarget(other, *this);
+}
 
+Texture& Texture::operator=(Texture&& other) noexcept{
+    if(this != &other){
+        TextureResidency::Instance().Unregister(this);
+        m_texture = std::move(other.m_texture);
+        m_filepath = std::move(other.m_filepath);
+        m_image = std::move(other.m_image);
+        m_width = other.m_width;
+        m_height = other.m_height;
+        m_levelCount = other.m_levelCount;
+        m_droppedLevels = other.m_droppedLevels;
+        m_footprint = other.m_footprint.load();
+        TextureResidency::Instance().Retarget(other, *this);
+    }
+    return *this;
 }
 
 void Texture::LoadTexture(const std::string filepath){
+    Decode(filepath);
+    Upload();
+}
+
+void Texture::Decode(const std::string filepath){
 	// Set member variable
     m_filepath = filepath;
     // Load our actual image data
     // This method loads .ppm files of pixel data
-    m_image = new Image(filepath);
+    m_image.reset(new Image(filepath));
     m_image->LoadPPM(true);
+}
 
+void Texture::Upload(){
+    if(m_image == nullptr || m_image->GetPixelDataPtr() == nullptr){
+        SDL_Log("Texture::Upload - nothing decoded for %s", m_filepath.c_str());
+        return;
+    }
     glEnable(GL_TEXTURE_2D); 
 	// Generate a buffer for our texture
-    glGenTextures(1,&m_textureID);
+    // (an earlier upload, if any, is deleted)
+    m_texture = GLTextureHandle::Create();
     // Similar to our vertex buffers, we now 'select'
     // a texture we want to bind to.
     // Note the type of data is 'GL_TEXTURE_2D'
-    glBindTexture(GL_TEXTURE_2D, m_textureID);
+    glBindTexture(GL_TEXTURE_2D, m_texture.Get());
 	// Now we are going to setup some information about
 	// our textures.
 	// There are four parameters that must be set.
@@ -58,21 +98,52 @@ void Texture::LoadTexture(const std::string filepath){
 	// texture.
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); 
+    // Mip levels of a full chain, rounding sizes down like OpenGL
+    m_width = m_image->GetWidth();
+    m_height = m_image->GetHeight();
+    m_levelCount = 1;
+    while((std::max(m_width, m_height) >> m_levelCount) > 0){
+        ++m_levelCount;
+    }
+    Reupload(*m_image, 0);
+    TextureResidency::Instance().Register(this);
+    // The GPU has its own copy, so the decoded image can go
+    m_image.reset();
+}
+
+bool Texture::Reupload(Image& image, unsigned int dropped){
+    if(!m_texture || image.GetPixelDataPtr() == nullptr){
+        return false;
+    }
+    glBindTexture(GL_TEXTURE_2D, m_texture.Get());
+    // Rows of a shrunk image are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    // Level 0 of the texture is level 'dropped' of the full image.
+    // The max level goes first, it limits what glGenerateMipmap fills in.
+    unsigned int levels = m_levelCount - std::min(dropped, m_levelCount-1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels-1);
 	// At this point, we are now ready to load and send some data to OpenGL.
 	glTexImage2D(GL_TEXTURE_2D,
 							0 ,
 						GL_RGB,
-                        m_image->GetWidth(),
-                        m_image->GetHeight(),
+                        image.GetWidth(),
+                        image.GetHeight(),
 						0,
 						GL_RGB,
 						GL_UNSIGNED_BYTE,
-						 m_image->GetPixelDataPtr()); // Here is the raw pixel data
-    // We are done with our texture data so we can unbind.
+						 image.GetPixelDataPtr()); // Here is the raw pixel data
     // Generate a mipmap
-    glGenerateMipmap(GL_TEXTURE_2D);                        
-	// We are done with our texture data so we can unbind.    
+    glGenerateMipmap(GL_TEXTURE_2D);
+    // Levels past the end of the new chain are left over from a larger
+    // one, give their memory back
+    for(unsigned int level=levels; level < m_levelCount; ++level){
+        glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	// We are done with our texture data so we can unbind.
 	glBindTexture(GL_TEXTURE_2D, 0);
+    m_droppedLevels = m_levelCount - levels;
+    return true;
 }
 
 
@@ -87,11 +158,54 @@ void Texture::Bind(unsigned int slot) const{
 	// on your hardware.
     glEnable(GL_TEXTURE_2D);
 	glActiveTexture(GL_TEXTURE0+slot);
-	glBindTexture(GL_TEXTURE_2D, m_textureID);
+	glBindTexture(GL_TEXTURE_2D, m_texture.Get());
 }
 
 void Texture::Unbind(){
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+GLuint Texture::GetID() const{
+	return m_texture.Get();
+}
+
+int Texture::GetWidth() const{
+    return m_width;
+}
+
+int Texture::GetHeight() const{
+    return m_height;
+}
+
+unsigned int Texture::GetLevelCount() const{
+    return m_levelCount;
+}
+
+unsigned int Texture::GetDroppedLevels() const{
+    return m_droppedLevels;
+}
+
+size_t Texture::GetBytes(unsigned int dropped) const{
+    size_t bytes = 0;
+    for(unsigned int level=dropped; level < m_levelCount; ++level){
+        size_t width = (size_t)std::max(1, m_width >> level);
+        size_t height = (size_t)std::max(1, m_height >> level);
+        bytes += width*height*BYTES_PER_TEXEL;
+    }
+    return bytes;
+}
+
+const std::string& Texture::GetFilepath() const{
+    return m_filepath;
+}
 
+// Many objects may share us, keep the largest
+void Texture::MarkUsed(float pixels) const{
+    float current = m_footprint.load(std::memory_order_relaxed);
+    while(pixels > current && !m_footprint.compare_exchange_weak(current, pixels, std::memory_order_relaxed)){
+    }
+}
+
+float Texture::TakeFootprint() const{
+    return m_footprint.exchange(0.0f, std::memory_order_relaxed);
+}
@@ -0,0 +1,241 @@
+#include "TextureResidency.hpp"
+#include "Texture.hpp"
+#include "Image.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+
+TextureResidency& TextureResidency::Instance(){
+    static TextureResidency* instance = new TextureResidency();
+    return *instance;
+}
+
+// Constructor
+TextureResidency::TextureResidency(){
+
+}
+
+// Destructor
+TextureResidency::~TextureResidency(){
+
+}
+
+void TextureResidency::SetBudget(size_t bytes){
+    m_budget.store(bytes, std::memory_order_relaxed);
+}
+
+size_t TextureResidency::GetBudget() const{
+    return m_budget.load(std::memory_order_relaxed);
+}
+
+size_t TextureResidency::GetResidentBytes(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for(const Record& record : m_records){
+        bytes += record.texture->GetBytes(record.texture->GetDroppedLevels());
+    }
+    return bytes;
+}
+
+size_t TextureResidency::GetFullBytes(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for(const Record& record : m_records){
+        bytes += record.texture->GetBytes(0);
+    }
+    return bytes;
+}
+
+unsigned int TextureResidency::GetVersion() const{
+    return m_version.load(std::memory_order_acquire);
+}
+
+void TextureResidency::Register(Texture* texture){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(Record& record : m_records){
+        if(record.texture == texture){
+            // Uploaded again, and with every level
+            record.serial = m_nextSerial++;
+            record.target = texture->GetDroppedLevels();
+            record.pending = false;
+            record.retryAfter = 0;
+            return;
+        }
+    }
+    // Counts as just used, so it is not the first to shrink
+    m_records.push_back({ texture, m_nextSerial++, m_updates, 0.0f, texture->GetDroppedLevels(), false, 0 });
+}
+
+void TextureResidency::Unregister(Texture* texture){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(size_t i=0; i < m_records.size(); ++i){
+        if(m_records[i].texture == texture){
+            // A pending reload finds nothing and is dropped
+            m_records[i] = m_records.back();
+            m_records.pop_back();
+            return;
+        }
+    }
+}
+
+void TextureResidency::Retarget(Texture& from, Texture& to){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(Record& record : m_records){
+        if(record.texture == &from){
+            record.texture = &to;
+            return;
+        }
+    }
+}
+
+unsigned int TextureResidency::GetMaxDrop(const Record& record){
+    const Texture& texture = *record.texture;
+    unsigned int size = (unsigned int)std::max(texture.GetWidth(), texture.GetHeight());
+    unsigned int drop = 0;
+    while(drop+1 < texture.GetLevelCount() && (size >> (drop+1)) >= RESIDENCY_MIN_TEXTURE_SIZE){
+        ++drop;
+    }
+    return drop;
+}
+
+// About one texel per pixel is all the screen can show, so a texture
+// twice as large as its footprint can lose a level without looking worse
+unsigned int TextureResidency::GetWantedDrop(const Record& record){
+    unsigned int maxDrop = GetMaxDrop(record);
+    if(record.footprint <= 0.0f){
+        return maxDrop;
+    }
+    const Texture& texture = *record.texture;
+    float size = (float)std::max(texture.GetWidth(), texture.GetHeight());
+    if(size <= record.footprint){
+        return 0;
+    }
+    return std::min(maxDrop, (unsigned int)std::floor(std::log2(size / record.footprint)));
+}
+
+unsigned int TextureResidency::Update(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_updates;
+    // Usage marked by the frames built since the last update
+    for(Record& record : m_records){
+        float footprint = record.texture->TakeFootprint();
+        if(footprint > 0.0f){
+            record.lastUsed = m_updates;
+            record.footprint = footprint;
+        }
+    }
+
+    // What the GPU will hold once the reloads on their way are done
+    size_t planned = 0;
+    for(const Record& record : m_records){
+        planned += record.texture->GetBytes(record.target);
+    }
+
+    unsigned int reloads = 0;
+    size_t budget = m_budget.load(std::memory_order_relaxed);
+    if(budget != 0){
+        // Over budget: shrink by one level at a time, least useful first
+        while(planned > budget && reloads < RESIDENCY_MAX_RELOADS){
+            Record* victim = nullptr;
+            bool victimHasExtra = false;
+            for(Record& record : m_records){
+                if(record.pending || m_updates < record.retryAfter || record.target >= GetMaxDrop(record)){
+                    continue;
+                }
+                // More detail than the screen shows
+                bool hasExtra = record.target < GetWantedDrop(record);
+                if(victim == nullptr || record.lastUsed < victim->lastUsed ||
+                   (record.lastUsed == victim->lastUsed &&
+                    (hasExtra > victimHasExtra ||
+                     (hasExtra == victimHasExtra && record.footprint < victim->footprint)))){
+                    victim = &record;
+                    victimHasExtra = hasExtra;
+                }
+            }
+            if(victim == nullptr){
+                break;
+            }
+            planned -= victim->texture->GetBytes(victim->target) - victim->texture->GetBytes(victim->target+1);
+            Reload(*victim, victim->target+1);
+            ++reloads;
+        }
+    }
+
+    // Textures in view that lost detail their footprint needs grow
+    // back, the largest on screen first
+    std::vector<Record*> grow;
+    for(Record& record : m_records){
+        if(!record.pending && m_updates >= record.retryAfter &&
+           record.lastUsed == m_updates && record.target > GetWantedDrop(record)){
+            grow.push_back(&record);
+        }
+    }
+    std::sort(grow.begin(), grow.end(), [](const Record* a, const Record* b){
+        return a->footprint > b->footprint;
+    });
+    for(Record* record : grow){
+        if(reloads >= RESIDENCY_MAX_RELOADS){
+            break;
+        }
+        // As close to the wanted size as the budget allows
+        size_t current = record->texture->GetBytes(record->target);
+        for(unsigned int drop=GetWantedDrop(*record); drop < record->target; ++drop){
+            size_t grown = planned - current + record->texture->GetBytes(drop);
+            if(budget == 0 || grown <= budget){
+                planned = grown;
+                Reload(*record, drop);
+                ++reloads;
+                break;
+            }
+        }
+    }
+
+    unsigned int finished = m_finished;
+    m_finished = 0;
+    return finished;
+}
+
+void TextureResidency::Reload(Record& record, unsigned int dropped){
+    record.target = dropped;
+    record.pending = true;
+    uint64_t serial = record.serial;
+    std::string filepath = record.texture->GetFilepath();
+    // Decoded on a worker, uploaded on the GL thread
+    std::shared_ptr<Image> image = std::make_shared<Image>(filepath);
+    JobSystem& jobs = JobSystem::Instance();
+    JobHandle decode = jobs.Schedule([image, dropped](){
+        image->LoadPPM(true);
+        image->Downsample(dropped);
+    });
+    jobs.ScheduleOnGLThread([this, serial, image, dropped](){
+        FinishReload(serial, *image, dropped);
+    }, {decode});
+}
+
+void TextureResidency::FinishReload(uint64_t serial, Image& image, unsigned int dropped){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(Record& record : m_records){
+        if(record.serial == serial){
+            // Unregistering waits for the lock, so the texture
+            // stays alive while we upload
+            unsigned int before = record.texture->GetDroppedLevels();
+            bool uploaded = record.texture->Reupload(image, dropped);
+            record.target = record.texture->GetDroppedLevels();
+            record.pending = false;
+            if(!uploaded){
+                // The file may have gone missing meanwhile. Picking it
+                // again next frame would only read it again, so wait.
+                record.retryAfter = m_updates + RESIDENCY_RETRY_UPDATES;
+                return;
+            }
+            if(record.target != before){
+                ++m_finished;
+                m_version.fetch_add(1, std::memory_order_release);
+            }
+            return;
+        }
+    }
+}
@@ -13,6 +13,7 @@ Transform::~Transform(){
 // Resets the model transform as the identity matrix.
 void Transform::LoadIdentity(){
     m_modelTransformMatrix = glm::mat4(1.0f);
+    ++m_version;
 }
 
 void Transform::Translate(float x, float y, float z){
@@ -24,14 +25,17 @@ void Transform::Translate(float x, float y, float z){
         // We supply the first argument which is the matrix we want to apply
         // this transformation to (Our previous transformation matrix.
         m_modelTransformMatrix = glm::translate(m_modelTransformMatrix,glm::vec3(x,y,z));                            
+        ++m_version;
 }
 
 void Transform::Rotate(float radians, float x, float y, float z){
     m_modelTransformMatrix = glm::rotate(m_modelTransformMatrix, radians,glm::vec3(x,y,z));        
+    ++m_version;
 }
 
 void Transform::Scale(float x, float y, float z){
     m_modelTransformMatrix = glm::scale(m_modelTransformMatrix,glm::vec3(x,y,z));        
+    ++m_version;
 }
 
 // Returns the actual transform matrix
@@ -46,8 +50,13 @@ glm::mat4 Transform::GetInternalMatrix() const{
     return m_modelTransformMatrix;
 }
 
+unsigned int Transform::GetVersion() const{
+    return m_version;
+}
+
 void Transform::ApplyTransform(Transform t){
     m_modelTransformMatrix = t.GetInternalMatrix();
+    ++m_version;
 }
 
 
@@ -55,18 +64,21 @@ void Transform::ApplyTransform(Transform t){
 // Perform a matrix multiplication with our Transform
 Transform& Transform::operator*=(const Transform& t) {
     m_modelTransformMatrix =  m_modelTransformMatrix * t.GetInternalMatrix();
+    ++m_version;
     return *this;
 }
 
 // Perform a matrix addition with our Transform
 Transform& Transform::operator+=(const Transform& t) {
     m_modelTransformMatrix =  m_modelTransformMatrix + t.GetInternalMatrix();
+    ++m_version;
     return *this;
 }
 
 // Matrix assignment
 Transform& Transform::operator=(const Transform& t) {
     m_modelTransformMatrix =  t.GetInternalMatrix();
+    ++m_version;
     return *this;
 }
 
@@ -0,0 +1,127 @@
+#include "VertexFormat.hpp"
+#include "AllocationTracker.hpp"
+#include "Geometry.hpp"
+
+#include "glm/gtc/packing.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// snorm16 cannot tell +0 from -0, so w stays at least one step away
+static const float QTANGENT_BIAS = 1.0f / 32767.0f;
+
+glm::quat EncodeQTangent(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent){
+    // Make the frame orthonormal, a quaternion can only hold a rotation
+    glm::vec3 n = glm::normalize(normal);
+    glm::vec3 t = tangent - n * glm::dot(n, tangent);
+    if(glm::dot(t, t) < 1e-12f){
+        // No usable tangent, any direction in the surface will do
+        t = std::fabs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f,0.0f,0.0f)) : glm::cross(n, glm::vec3(0.0f,1.0f,0.0f));
+    }
+    t = glm::normalize(t);
+    glm::vec3 b = glm::cross(n, t);
+    bool flipped = glm::dot(b, bitangent) < 0.0f;
+
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+    // q and -q are the same rotation, so the sign of w is free to use
+    if(q.w < 0.0f){
+        q = -q;
+    }
+    if(q.w < QTANGENT_BIAS){
+        float scale = std::sqrt(1.0f - QTANGENT_BIAS*QTANGENT_BIAS);
+        q.x *= scale;
+        q.y *= scale;
+        q.z *= scale;
+        q.w = QTANGENT_BIAS;
+    }
+    return flipped ? -q : q;
+}
+
+void DecodeQTangent(const glm::quat& qtangent, glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent){
+    glm::quat q = glm::normalize(qtangent);
+    // Columns of the rotation matrix
+    tangent = glm::vec3(1.0f - 2.0f*(q.y*q.y + q.z*q.z), 2.0f*(q.x*q.y + q.w*q.z), 2.0f*(q.x*q.z - q.w*q.y));
+    bitangent = glm::vec3(2.0f*(q.x*q.y - q.w*q.z), 1.0f - 2.0f*(q.x*q.x + q.z*q.z), 2.0f*(q.y*q.z + q.w*q.x));
+    normal = glm::vec3(2.0f*(q.x*q.z + q.w*q.y), 2.0f*(q.y*q.z - q.w*q.x), 1.0f - 2.0f*(q.x*q.x + q.y*q.y));
+    if(q.w < 0.0f){
+        bitangent = -bitangent;
+    }
+}
+
+// Vertices are converted this many at a time, so the temporary
+// float arrays stay small however large the mesh is
+static const unsigned int PACK_BLOCK_SIZE = 256;
+
+void PackCompactVertices(const Geometry& geometry, VertexFormat format, CompactVertices& packed){
+    AllocationScope allocationScope(AllocationSubsystem::Geometry);
+    const unsigned int vertexCount = geometry.GetVertexCount();
+    const AABB& bounds = geometry.GetLocalBounds();
+    const bool quantized = (format == VertexFormat::Quantized) && !bounds.IsEmpty();
+
+    packed.positionScale = glm::vec3(1.0f);
+    packed.positionOffset = glm::vec3(0.0f);
+    packed.layout = &COMPACT_HALF_LAYOUT;
+    if(quantized){
+        // 65535 steps across the box on each axis
+        packed.positionOffset = bounds.min;
+        packed.positionScale = glm::max(bounds.max - bounds.min, glm::vec3(1e-20f));
+        // unorm16 only covers [0,1], repeating coordinates stay half floats
+        packed.layout = &COMPACT_QUANTIZED_LAYOUT;
+        const float* texCoords = geometry.GetTextureCoordsPtr();
+        for(unsigned int i=0; i < vertexCount; ++i){
+            const float* uv = texCoords + i*2;
+            if(uv[0] < 0.0f || uv[0] > 1.0f || uv[1] < 0.0f || uv[1] > 1.0f){
+                packed.layout = &COMPACT_QUANTIZED_HALF_UV_LAYOUT;
+                break;
+            }
+        }
+    }
+
+    const VertexLayout& layout = *packed.layout;
+    const unsigned int stride = layout.GetStride(0);
+    packed.data.resize((size_t)vertexCount*stride);
+
+    float block[PACK_BLOCK_SIZE*FLOAT_VERTEX_COMPONENTS];
+    float positions[PACK_BLOCK_SIZE*3];
+    float qtangents[PACK_BLOCK_SIZE*4];
+    for(unsigned int first=0; first < vertexCount; first+=PACK_BLOCK_SIZE){
+        unsigned int count = std::min(PACK_BLOCK_SIZE, vertexCount-first);
+        // Only one block of floats exists at a time
+        geometry.Interleave(block, first, count);
+        for(unsigned int i=0; i < count; ++i){
+            const float* v = block + i*FLOAT_VERTEX_COMPONENTS;
+            glm::vec3 position = (glm::vec3(v[0], v[1], v[2]) - packed.positionOffset) / packed.positionScale;
+            positions[i*3+0] = position.x;
+            positions[i*3+1] = position.y;
+            positions[i*3+2] = position.z;
+            glm::quat q = EncodeQTangent(glm::vec3(v[3], v[4], v[5]), glm::vec3(v[8], v[9], v[10]), glm::vec3(v[11], v[12], v[13]));
+            qtangents[i*4+0] = q.x;
+            qtangents[i*4+1] = q.y;
+            qtangents[i*4+2] = q.z;
+            qtangents[i*4+3] = q.w;
+        }
+        // In the order the COMPACT_ layouts declare them
+        AttributeSource sources[3];
+        sources[0] = { positions, 3 };
+        sources[1] = { qtangents, 4 };
+        sources[2] = { block + 6, FLOAT_VERTEX_COMPONENTS };
+        layout.Pack(0, sources, count, packed.data.data() + (size_t)first*stride);
+    }
+}
+
+unsigned int GetVertexFormatStride(VertexFormat format){
+    return format == VertexFormat::Float ? NORMAL_MAP_LAYOUT.GetStride(0) : COMPACT_HALF_LAYOUT.GetStride(0);
+}
+
+std::string GetVertexFormatDefines(VertexFormat format){
+    return format == VertexFormat::Float ? "" : "#define QTANGENT_VERTICES\n";
+}
+
+const char* GetVertexFormatName(VertexFormat format){
+    switch(format){
+        case VertexFormat::Float:     return "float";
+        case VertexFormat::Half:      return "half";
+        case VertexFormat::Quantized: return "quantized";
+    }
+    return "unknown";
+}
@@ -0,0 +1,92 @@
+#include "VertexLayout.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Converts one float to 'type'
+static void PackComponent(AttributeType type, bool normalized, float value, unsigned char* destination){
+    switch(type){
+        case AttributeType::Float:
+            std::memcpy(destination, &value, sizeof(float));
+            break;
+        case AttributeType::HalfFloat:{
+            uint16_t half = glm::packHalf1x16(value);
+            std::memcpy(destination, &half, sizeof(half));
+            break;
+        }
+        case AttributeType::Byte:{
+            int8_t packed = normalized ? (int8_t)std::round(glm::clamp(value, -1.0f, 1.0f) * 127.0f)
+                                       : (int8_t)glm::clamp(std::round(value), -128.0f, 127.0f);
+            std::memcpy(destination, &packed, sizeof(packed));
+            break;
+        }
+        case AttributeType::UnsignedByte:{
+            uint8_t packed = normalized ? (uint8_t)std::round(glm::clamp(value, 0.0f, 1.0f) * 255.0f)
+                                        : (uint8_t)glm::clamp(std::round(value), 0.0f, 255.0f);
+            std::memcpy(destination, &packed, sizeof(packed));
+            break;
+        }
+        case AttributeType::Short:{
+            int16_t packed = normalized ? (int16_t)glm::packSnorm1x16(value)
+                                        : (int16_t)glm::clamp(std::round(value), -32768.0f, 32767.0f);
+            std::memcpy(destination, &packed, sizeof(packed));
+            break;
+        }
+        case AttributeType::UnsignedShort:{
+            uint16_t packed = normalized ? glm::packUnorm1x16(value)
+                                         : (uint16_t)glm::clamp(std::round(value), 0.0f, 65535.0f);
+            std::memcpy(destination, &packed, sizeof(packed));
+            break;
+        }
+    }
+}
+
+void VertexLayout::Pack(unsigned int stream, const AttributeSource* sources, unsigned int count, void* destination) const{
+    unsigned char* bytes = static_cast<unsigned char*>(destination);
+    const unsigned int stride = m_strides[stream];
+    std::memset(bytes, 0, (size_t)count*stride);
+    // One attribute at a time, so the type is only looked at once per vertex
+    for(unsigned int a=0; a < m_attributeCount; ++a){
+        const VertexAttribute& attribute = m_attributes[a];
+        const AttributeSource& source = sources[a];
+        if(attribute.stream != stream || source.data == nullptr){
+            continue;
+        }
+        const unsigned int componentSize = GetAttributeTypeSize(attribute.type);
+        if(attribute.type == AttributeType::Float && source.stride == attribute.components){
+            // Already the right format and tightly packed
+            for(unsigned int i=0; i < count; ++i){
+                std::memcpy(bytes + (size_t)i*stride + attribute.offset, source.data + (size_t)i*source.stride,
+                            attribute.components*sizeof(float));
+            }
+            continue;
+        }
+        for(unsigned int i=0; i < count; ++i){
+            const float* values = source.data + (size_t)i*source.stride;
+            unsigned char* vertex = bytes + (size_t)i*stride + attribute.offset;
+            for(unsigned int c=0; c < attribute.components; ++c){
+                PackComponent(attribute.type, attribute.normalized, values[c], vertex + c*componentSize);
+            }
+        }
+    }
+}
+
+void VertexLayout::Apply(const GLuint* buffers) const{
+    for(unsigned int a=0; a < m_attributeCount; ++a){
+        const VertexAttribute& attribute = m_attributes[a];
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[attribute.stream]);
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location,
+                              (GLint)attribute.components,
+                              GetAttributeTypeGL(attribute.type),
+                              attribute.normalized ? GL_TRUE : GL_FALSE,
+                              (GLsizei)m_strides[attribute.stream],
+                              (char*)(size_t)attribute.offset);
+        // Per-instance streams move on once per 'divisor' instances
+        glVertexAttribDivisor(attribute.location, m_divisors[attribute.stream]);
+    }
+}
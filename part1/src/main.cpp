@@ -1,18 +1,73 @@
 #define SDL_MAIN_HANDLED
 // Functionality that we created
 #include "SDLGraphicsProgram.hpp"
+#include "StartupTimeline.hpp"
+#include "AllocationTracker.hpp"
+#include "TextureResidency.hpp"
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+// Allocation test mode defaults (see SDLGraphicsProgram::EnableAllocationTest)
+const unsigned int ALLOCATION_TEST_WARMUP_FRAMES = 120;
+const unsigned int ALLOCATION_TEST_FRAMES = 300;
+
 int main(int argc, char** argv){
+	// --allocation-test [frames] [budget]: runs that many steady-state
+	// frames and exits with 1 if any made more than 'budget' allocations
+	bool allocationTest = false;
+	unsigned int allocationTestFrames = ALLOCATION_TEST_FRAMES;
+	unsigned long long allocationBudget = 0;
+	// --texture-budget <MB>: GPU memory all textures together may use
+	// (see TextureResidency), unlimited by default
+	// --vertex-format float|half|quantized: how meshes store their
+	// vertices (see VertexFormat.hpp), float by default
+	VertexFormat vertexFormat = VertexFormat::Float;
+	// --mesh <file.obj>: draws this mesh instead of the quad
+	std::string meshFile;
+	for(int i=1; i < argc; ++i){
+		if(std::strcmp(argv[i], "--allocation-test") == 0){
+			allocationTest = true;
+			if(i+1 < argc && argv[i+1][0] != '-'){
+				allocationTestFrames = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+			}
+			if(i+1 < argc && argv[i+1][0] != '-'){
+				allocationBudget = std::strtoull(argv[++i], nullptr, 10);
+			}
+		}else if(std::strcmp(argv[i], "--texture-budget") == 0 && i+1 < argc){
+			TextureResidency::Instance().SetBudget((size_t)(std::strtod(argv[++i], nullptr)*1024.0*1024.0));
+		}else if(std::strcmp(argv[i], "--vertex-format") == 0 && i+1 < argc){
+			++i;
+			if(std::strcmp(argv[i], "half") == 0){
+				vertexFormat = VertexFormat::Half;
+			}else if(std::strcmp(argv[i], "quantized") == 0){
+				vertexFormat = VertexFormat::Quantized;
+			}else if(std::strcmp(argv[i], "float") != 0){
+				std::cout << "Unknown vertex format " << argv[i] << ", using float" << std::endl;
+			}
+		}else if(std::strcmp(argv[i], "--mesh") == 0 && i+1 < argc){
+			meshFile = argv[++i];
+		}
+	}
+	if(allocationTest && !AllocationTracker::IsEnabled()){
+		std::cout << "--allocation-test needs a build with -D TRACK_ALLOCATIONS (see build.py)" << std::endl;
+		return 1;
+	}
+
+	// Start the clock for the startup timeline
+	StartupTimeline::Instance();
 
 	std::cout << "Please remember:\n For this starter code you only need to work in the shader. That also means, once you compile your .cpp files, you need only run your ./lab or ./lab.exe once, because every time your program runs it will recompile the shaders which you are making changes to. So save yourself some time :)\n\n" << std::endl;
 
 	// Create an instance of an object for a SDLGraphicsProgram
-	SDLGraphicsProgram mySDLGraphicsProgram(1280,720);
+	SDLGraphicsProgram mySDLGraphicsProgram(1280,720,vertexFormat,meshFile);
+	if(allocationTest){
+		mySDLGraphicsProgram.EnableAllocationTest(ALLOCATION_TEST_WARMUP_FRAMES, allocationTestFrames, allocationBudget);
+	}
 	// Run our program forever
 	mySDLGraphicsProgram.Loop();
 	// When our program ends, it will exit scope, the
 	// destructor will then be called and clean up the program.
-	return 0;
+	return mySDLGraphicsProgram.AllocationTestFailed() ? 1 : 0;
 }